@@ -132,10 +132,14 @@ void BasicSearchUI::displaySearchPage(Request &request, Reply &reply){
 	// the page will be refreshed rather than loaded from cache.
 	reply.setHeader("Cache-Control", "no-store");
 
-	string search_id = request.getFormData("sid");
-	string query = request.getFormData("query");
-
-	string search_engine_id = request.getFormData("seng");
+	shared_ptr<SearchPageState> state(new SearchPageState);
+	string &search_id = state->search_id;
+	string &query = state->query;
+	search_id = request.getFormData("sid");
+	query = request.getFormData("query");
+
+	string &search_engine_id = state->search_engine_id;
+	search_engine_id = request.getFormData("seng");
 	if (search_engine_id.empty()){
 		search_engine_id = user->getDefaultSearchEngine();
 	}
@@ -144,7 +148,8 @@ void BasicSearchUI::displaySearchPage(Request &request, Reply &reply){
 		search_engine_id = "bing";
 	}
 
-	int start_pos = 0;
+	int &start_pos = state->start_pos;
+	start_pos = 0;
 	try {
 		string s = request.getFormData("start");
 		if (! s.empty()){
@@ -153,57 +158,106 @@ void BasicSearchUI::displaySearchPage(Request &request, Reply &reply){
 	}
 	catch (bad_lexical_cast &){
 	}
-	bool use_last_start_pos = false;
+	state->use_last_start_pos = false;
 	if (start_pos < 1){
-		use_last_start_pos = true;
+		state->use_last_start_pos = true;
 		start_pos = 1;
 	}
 	else if (start_pos > 1000) {
 		getUCAIRServer().err(reply_status::bad_request, "Start pos exceeds limit");
 	}
 
-	int result_count = 10;
+	state->result_count = 10;
 	int result_fetch_count = start_pos == 1 ? first_page_fetch_result_count : next_pages_fetch_result_count;
 
-	string search_view_id = request.getFormData("view");
+	string &search_view_id = state->search_view_id;
+	search_view_id = request.getFormData("view");
 	if (search_view_id.empty()){
 		search_view_id = user->getDefaultSearchView();
 	}
-	PageModule *search_view = getPageModuleManager().getPageModule(search_view_id);
-	if (! search_view){
+	if (! getPageModuleManager().getPageModule(search_view_id)){
 		getUCAIRServer().err(reply_status::bad_request, "Invalid search view");
 	}
 
+	state->top_rendered = false;
+
 	// Search id is needed to identify a search.
 	// For a new search we only have query but no search id.
 	// SearchProxy can fetch search results for the query, and return a search id.
 	// We then reload the page using this search id.
 	if (! query.empty() || ! search_id.empty()){
-		string orig_search_id = search_id;
+		state->orig_search_id = search_id;
 
 		if (user->isSearchExpired(search_id)){
 			getUCAIRServer().err(reply_status::bad_request, "Search session expired");
 		}
 
-		SearchProxy::ReturnCode rc = getSearchProxy().search(search_id, query, search_engine_id, start_pos, result_fetch_count);
-		if (rc == SearchProxy::BAD_PARAM){
-			search_id.clear();
-		}
-		else if (rc == SearchProxy::BAD_CONNECTION){
-			getUCAIRServer().err(reply_status::bad_gateway, "Failed to fetch results from " + search_engine_id);
+		// More results of an existing search may have to be fetched from the search engine, which can take a while.
+		// Meanwhile the client can already load the top of the page, which does not depend on results.
+		if (const Search *existing_search = getSearchProxy().getSearch(search_id)){
+			int top_start_pos = start_pos;
+			UserSearchRecord *existing_search_record = user->getSearchRecord(search_id);
+			if (state->use_last_start_pos && existing_search_record){
+				top_start_pos = existing_search_record->getLastStartPos(search_view_id);
+			}
+			try{
+				reply.content = renderSearchPageTop(state->t_main, *user, search_id, top_start_pos, existing_search->query.text,
+						existing_search->getSearchEngineId(), search_view_id);
+			}
+			catch (templating::Error &e) {
+				if (const string* error_info = boost::get_error_info<templating::ErrorInfo>(e)){
+					getLogger().error(*error_info);
+				}
+				throw e;
+			}
+			state->top_rendered = true;
+			getUCAIRServer().flush(reply);
 		}
 
-		if (orig_search_id != search_id){
-			http::util::URLComponents url_components = request.url_components;
-			url_components.eraseQueryParam("query");
-			url_components.eraseQueryParam("seng");
-			url_components.setQueryParam("sid", search_id);
-			getUCAIRServer().externalRedirect(url_components.rebuildURL());
-		}
+		// Other requests are handled while results are being fetched.
+		RequestHandler::Completion completion = getUCAIRServer().suspend(reply);
+		getSearchProxy().asyncSearch(search_id, query, search_engine_id, start_pos, result_fetch_count,
+				bind(&BasicSearchUI::onSearchDone, this, ref(request), ref(reply), state, completion, _1));
+		return;
 	}
 
-	string encoded_query;
-	http::util::urlEncode(query, encoded_query);
+	renderSearchPage(request, reply, *state);
+}
+
+void BasicSearchUI::onSearchDone(Request &request, Reply &reply, const shared_ptr<SearchPageState> &state,
+		const RequestHandler::Completion &completion, SearchProxy::ReturnCode rc){
+	completion.resume(bind(&BasicSearchUI::continueSearchPage, this, ref(request), ref(reply), state, rc));
+}
+
+void BasicSearchUI::continueSearchPage(Request &request, Reply &reply, const shared_ptr<SearchPageState> &state, SearchProxy::ReturnCode rc){
+	if (rc == SearchProxy::BAD_PARAM){
+		state->search_id.clear();
+	}
+	else if (rc == SearchProxy::BAD_CONNECTION){
+		getUCAIRServer().err(reply_status::bad_gateway, "Failed to fetch results from " + state->search_engine_id);
+	}
+
+	if (state->orig_search_id != state->search_id){
+		http::util::URLComponents url_components = request.url_components;
+		url_components.eraseQueryParam("query");
+		url_components.eraseQueryParam("seng");
+		url_components.setQueryParam("sid", state->search_id);
+		getUCAIRServer().externalRedirect(url_components.rebuildURL());
+	}
+
+	renderSearchPage(request, reply, *state);
+}
+
+void BasicSearchUI::renderSearchPage(Request &request, Reply &reply, SearchPageState &state){
+	User *user = getUserManager().getUser(request, true);
+	assert(user);
+
+	const string &search_id = state.search_id;
+	int start_pos = state.start_pos;
+	int result_count = state.result_count;
+	const string &search_view_id = state.search_view_id;
+	PageModule *search_view = getPageModuleManager().getPageModule(search_view_id);
+	TemplateData &t_main = state.t_main;
 
 	const Search *search = NULL;
 	UserSearchRecord *search_record = NULL;
@@ -218,7 +272,7 @@ void BasicSearchUI::displaySearchPage(Request &request, Reply &reply){
 			search_record = user->addSearchRecord(search_id);
 		}
 		else{
-			if (use_last_start_pos){
+			if (state.use_last_start_pos){
 				start_pos = search_record->getLastStartPos(search_view_id);
 			}
 		}
@@ -229,6 +283,7 @@ void BasicSearchUI::displaySearchPage(Request &request, Reply &reply){
 				indexDocument(*search_record->getIndex(), itr->second);
 			}
 		}
+		getSearchProxy().clearStemmedTerms(search_id);
 
 		// Add the event of user viewing this page.
 		shared_ptr<ViewSearchPageEvent> event(new ViewSearchPageEvent);
@@ -252,30 +307,14 @@ void BasicSearchUI::displaySearchPage(Request &request, Reply &reply){
 				search_record->addViewedResult(result_pos);
 			}
 		}
+
+		// Fetch the next page while the user reads this one.
+		getSearchProxy().schedulePrefetch(search_id, start_pos + result_count, next_pages_fetch_result_count);
 	}
 
 	try{
-		TemplateData t_main;
-		t_main.set("user_id", user->getUserId())
-			.set("search_id", search_id)
-			.set("start_pos", lexical_cast<string>(start_pos))
-			.set("query", query)
-			.set("encoded_query", encoded_query)
-			.set("search_engine_id", search_engine_id)
-			.set("view_id", search_view_id)
-			.set("timestamp", lexical_cast<string>(time(NULL)));
-
-		BOOST_FOREACH(const ExternalSearchEngine *external_search_engine, getAllExternalSearchEngines()){
-			t_main.addChild("external_search_engine")
-				.set("external_search_engine_id", external_search_engine->getSearchEngineId())
-				.set("external_search_engine_name", external_search_engine->getSearchEngineName());
-		}
-
-		BOOST_FOREACH(const SearchEngine* search_engine, getSearchProxy().getAllSearchEngines()){
-			t_main.addChild("internal_search_engine")
-				.set("internal_search_engine_id", search_engine->getSearchEngineId())
-				.set("internal_search_engine_name", search_engine->getSearchEngineName())
-				.set("active", search_engine->getSearchEngineId() == search_engine_id ? "active" : "inactive");
+		if (! state.top_rendered){
+			reply.content = renderSearchPageTop(t_main, *user, search_id, start_pos, state.query, state.search_engine_id, search_view_id);
 		}
 
 		getSearchMenu().render(t_main, request);
@@ -300,8 +339,9 @@ void BasicSearchUI::displaySearchPage(Request &request, Reply &reply){
 			search_view->recursiveRender(t_main, request, params);
 		}
 
+		// The top of the page may have been sent already, in which case content is empty.
 		string content = getTemplateEngine().render(t_main, "basic_search.htm");
-		reply.content = content;
+		reply.content += content;
 		// Uncomment below if you want to work on the DOM tree.
 		/*reply.dom_root.fromString(content);
 		if (! reply.dom_root){
@@ -316,6 +356,36 @@ void BasicSearchUI::displaySearchPage(Request &request, Reply &reply){
 	}
 }
 
+string BasicSearchUI::renderSearchPageTop(TemplateData &t_main, User &user, const string &search_id, int start_pos,
+		const string &query, const string &search_engine_id, const string &search_view_id){
+	string encoded_query;
+	http::util::urlEncode(query, encoded_query);
+
+	t_main.set("user_id", user.getUserId())
+		.set("search_id", search_id)
+		.set("start_pos", lexical_cast<string>(start_pos))
+		.set("query", query)
+		.set("encoded_query", encoded_query)
+		.set("search_engine_id", search_engine_id)
+		.set("view_id", search_view_id)
+		.set("timestamp", lexical_cast<string>(time(NULL)));
+
+	BOOST_FOREACH(const ExternalSearchEngine *external_search_engine, getAllExternalSearchEngines()){
+		t_main.addChild("external_search_engine")
+			.set("external_search_engine_id", external_search_engine->getSearchEngineId())
+			.set("external_search_engine_name", external_search_engine->getSearchEngineName());
+	}
+
+	BOOST_FOREACH(const SearchEngine* search_engine, getSearchProxy().getAllSearchEngines()){
+		t_main.addChild("internal_search_engine")
+			.set("internal_search_engine_id", search_engine->getSearchEngineId())
+			.set("internal_search_engine_name", search_engine->getSearchEngineName())
+			.set("active", search_engine->getSearchEngineId() == search_engine_id ? "active" : "inactive");
+	}
+
+	return getTemplateEngine().render(t_main, "basic_search_top.htm");
+}
+
 void BasicSearchUI::clickResult(Request &request, Reply &reply){
 	User *user = getUserManager().getUser(request, true);
 	assert(user);
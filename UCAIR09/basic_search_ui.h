@@ -7,6 +7,7 @@
 #include "component.h"
 #include "page_module.h"
 #include "search_menu.h"
+#include "search_proxy.h"
 #include "template_engine.h"
 #include "ucair_server.h"
 
@@ -53,6 +54,32 @@ public:
 	static void renderPrevNextPage(templating::TemplateData &t_main, long long total_result_count, int start_pos, int result_count);
 
 private:
+	/// What displaySearchPage carries over while it waits for search results.
+	struct SearchPageState {
+		std::string search_id;
+		std::string orig_search_id; ///< search id in the request
+		std::string query;
+		std::string search_engine_id;
+		std::string search_view_id;
+		int start_pos;
+		int result_count;
+		bool use_last_start_pos; ///< whether to go to the page the user last viewed
+		bool top_rendered; ///< whether the top of the page has been rendered (and sent)
+		templating::TemplateData t_main;
+	};
+
+	/// Called in the application strand when the search done by displaySearchPage completes.
+	void onSearchDone(Request &request, Reply &reply, const boost::shared_ptr<SearchPageState> &state,
+			const RequestHandler::Completion &completion, SearchProxy::ReturnCode rc);
+	/// Continuation of displaySearchPage after the search: redirects a new search to its search id, or renders the page.
+	void continueSearchPage(Request &request, Reply &reply, const boost::shared_ptr<SearchPageState> &state, SearchProxy::ReturnCode rc);
+	/// Renders the search page (the part below the top if that has been sent already).
+	void renderSearchPage(Request &request, Reply &reply, SearchPageState &state);
+
+	/// Renders the part of the search page above the results (page head, search box and search engine menu).
+	std::string renderSearchPageTop(templating::TemplateData &t_main, User &user, const std::string &search_id, int start_pos,
+			const std::string &query, const std::string &search_engine_id, const std::string &search_view_id);
+
 	std::list<std::string> search_view_ids;
 	int first_page_fetch_result_count; ///< Number of results to fetch when you start a search
 	int next_pages_fetch_result_count; ///< Number of results to fetch when you click "Next"
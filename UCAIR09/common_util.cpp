@@ -17,14 +17,12 @@ void readFile(ifstream &fin, string &content){
 	fin.seekg(0, ios::end);
 	size_t length = fin.tellg();
 	fin.seekg(0, ios::beg);
-	content.reserve(length);
-	while (true){
-		int ch = fin.get();
-		if (! fin){
-			break;
-		}
-		content.push_back(ch);
+	if (length == 0){
+		return;
 	}
+	content.resize(length);
+	fin.read(&content[0], length);
+	content.resize(fin.gcount());
 }
 
 string makeId(){
@@ -1,5 +1,10 @@
 #include "connection.h"
+#include <cstring>
+#include <boost/algorithm/string.hpp>
 #include <boost/bind.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/format.hpp>
+#include <boost/lexical_cast.hpp>
 #include <boost/tuple/tuple.hpp>
 #include "connection_manager.h"
 
@@ -11,11 +16,34 @@ namespace server {
 
 const int MAX_CONTENT_LENGTH = 8 * 1024;
 
-Connection::Connection(asio::io_service& io_service, ConnectionManager& manager, const RequestHandler& handler):
+ConnectionOptions::ConnectionOptions():
+	keep_alive_timeout(15),
+	max_keep_alive_requests(100),
+	header_timeout(10),
+	body_timeout(30),
+	write_timeout(30),
+	max_connections(0),
+	max_queued_requests(0),
+	retry_after(5)
+{
+}
+
+Connection::Connection(asio::io_service& io_service, asio::io_service::strand &handler_strand_, ConnectionManager& manager, const RequestHandler& handler, const ConnectionOptions &options_):
 	socket_(io_service),
+	strand_(io_service),
+	timer(io_service),
+	phase(reading_header),
+	buffer_begin(0),
+	buffer_end(0),
 	connection_manager(manager),
 	request_parser(MAX_CONTENT_LENGTH),
-	request_handler(handler)
+	handler_strand(handler_strand_),
+	request_handler(handler),
+	options(options_),
+	request_count(0),
+	keep_alive(false),
+	deferred(false),
+	write_pending(false)
 {
 }
 
@@ -24,48 +52,273 @@ asio::ip::tcp::socket& Connection::socket(){
 }
 
 void Connection::start(){
-	socket_.async_read_some(
-			asio::buffer(buffer),
-			bind(&Connection::handleRead, shared_from_this(),
-			asio::placeholders::error,
-			asio::placeholders::bytes_transferred));
+	// Browsers may open connections ahead of time, so this counts as waiting until data arrives.
+	phase = waiting;
+	setDeadline(options.header_timeout);
+	timer.async_wait(strand_.wrap(bind(&Connection::checkDeadline, shared_from_this(), asio::placeholders::error)));
+	read();
+}
+
+void Connection::reject(){
+	keep_alive = false;
+	setServiceUnavailable();
+	write();
+	timer.async_wait(strand_.wrap(bind(&Connection::checkDeadline, shared_from_this(), asio::placeholders::error)));
 }
 
 void Connection::stop(){
-	socket_.close();
+	boost::system::error_code ignored_e;
+	timer.cancel(ignored_e);
+	socket_.close(ignored_e);
 }
 
-void Connection::handleRead(const boost::system::error_code& e, size_t bytes_transferred){
-	if (!e){
-		tribool result;
-		tie(result, tuples::ignore) = request_parser.parse(request, buffer.data(), buffer.data() + bytes_transferred);
-
-		if (result){
-			request_handler(request, reply);
-			asio::async_write(
-					socket_,
-					reply.toBuffers(),
-					bind(&Connection::handleWrite, shared_from_this(), asio::placeholders::error));
+void Connection::setDeadline(int seconds){
+	// This cancels the pending wait; checkDeadline then waits again for the new deadline.
+	if (seconds < 0){
+		timer.expires_at(posix_time::pos_infin);
+	}
+	else{
+		timer.expires_from_now(posix_time::seconds(seconds));
+	}
+}
+
+void Connection::checkDeadline(const boost::system::error_code& e){
+	if (! socket_.is_open()){
+		return;
+	}
+	if (timer.expires_at() <= asio::deadline_timer::traits_type::now()){
+		if (phase != waiting){
+			// Closing an idle persistent connection is normal; other phases mean a slow or stalled client.
+			connection_manager.countTimeout();
+		}
+		connection_manager.stop(shared_from_this());
+		return;
+	}
+	timer.async_wait(strand_.wrap(bind(&Connection::checkDeadline, shared_from_this(), asio::placeholders::error)));
+}
+
+void Connection::setServiceUnavailable(){
+	reply.status = reply_status::service_unavailable;
+	reply.headers.insert(make_pair("Retry-After", lexical_cast<string>(options.retry_after)));
+}
+
+void Connection::read(){
+	socket_.async_read_some(
+			asio::buffer(buffer.data() + buffer_end, buffer.size() - buffer_end),
+			strand_.wrap(bind(&Connection::handleRead, shared_from_this(),
+			asio::placeholders::error,
+			asio::placeholders::bytes_transferred)));
+}
+
+void Connection::processBuffer(){
+	const char *begin = buffer.data() + buffer_begin;
+	const char *end = buffer.data() + buffer_end;
+	tribool result;
+	tie(result, begin) = request_parser.parse(request, begin, end);
+	buffer_begin = begin - buffer.data();
+	if (buffer_begin == buffer_end){
+		buffer_begin = buffer_end = 0;
+	}
+
+	if (result){
+		++ request_count;
+		keep_alive = isKeepAlive();
+		if (! connection_manager.queueRequest()){
+			// Shed load early rather than queueing up behind the serialized request handler.
+			keep_alive = false;
+			setServiceUnavailable();
+			write();
+			return;
 		}
-		else if (!result){
-			reply.status = reply_status::bad_request;
-			asio::async_write(
-					socket_,
-					reply.toBuffers(),
-					bind(&Connection::handleWrite, shared_from_this(), asio::placeholders::error));
+		// Time spent in the handler is not the client's fault.
+		phase = handling;
+		setDeadline(-1);
+		// Parsing is done on whichever io thread got here; the handler itself is serialized.
+		handler_strand.post(bind(&Connection::handleRequest, shared_from_this()));
+	}
+	else if (!result){
+		keep_alive = false;
+		reply.status = reply_status::bad_request;
+		write();
+	}
+	else{
+		if (request_parser.isReadingBody()){
+			if (phase != reading_body){
+				phase = reading_body;
+				setDeadline(options.body_timeout);
+			}
 		}
-		else{
-			socket_.async_read_some(
-					asio::buffer(buffer),
-					bind(&Connection::handleRead,shared_from_this(), asio::placeholders::error, asio::placeholders::bytes_transferred));
+		else if (phase == waiting && buffer_begin < buffer_end){
+			// The next request has begun to arrive.
+			phase = reading_header;
+			setDeadline(options.header_timeout);
+		}
+
+		// The parser leaves an incomplete header block in the buffer.
+		if (buffer_end == buffer.size()){
+			if (buffer_begin == 0){
+				// Request header does not fit in the buffer.
+				keep_alive = false;
+				reply.status = reply_status::bad_request;
+				write();
+				return;
+			}
+			// Move it to the front to make room for the rest.
+			memmove(buffer.data(), buffer.data() + buffer_begin, buffer_end - buffer_begin);
+			buffer_end -= buffer_begin;
+			buffer_begin = 0;
 		}
+		read();
+	}
+}
+
+void Connection::handleRead(const boost::system::error_code& e, size_t bytes_transferred){
+	if (!e){
+		buffer_end += bytes_transferred;
+		processBuffer();
 	}
 	else if (e != asio::error::operation_aborted){
 		connection_manager.stop(shared_from_this());
 	}
 }
 
+void Connection::handleRequest(){
+	// Chunked replies are only understood by HTTP/1.1 clients.
+	if (isHTTP11()){
+		reply.flush_handler = bind(&Connection::flush, shared_from_this());
+	}
+	reply.defer_handler = bind(&Connection::defer, this);
+	deferred = false;
+	connection_manager.dequeueRequest();
+	request_handler(request, reply);
+	reply.defer_handler.clear();
+	if (deferred){
+		// Written when the handler calls back.
+		return;
+	}
+	// Back to the connection strand, which owns the timer.
+	strand_.post(bind(&Connection::write, shared_from_this()));
+}
+
+function<void ()> Connection::defer(){
+	deferred = true;
+	return strand_.wrap(bind(&Connection::write, shared_from_this()));
+}
+
+void Connection::write(){
+	// The reply is complete.
+	reply.flush_handler.clear();
+	if (! chunk_in_flight.empty()){
+		// Flushed chunks go first; handleWriteChunk comes back here.
+		write_pending = true;
+		return;
+	}
+	if (! reply.isStreaming()){
+		setConnectionHeaders();
+	}
+	phase = writing;
+	setDeadline(options.write_timeout);
+	write_start = posix_time::microsec_clock::universal_time();
+	asio::async_write(
+			socket_,
+			reply.toBuffers(),
+			strand_.wrap(bind(&Connection::handleWrite, shared_from_this(), asio::placeholders::error)));
+}
+
+void Connection::setConnectionHeaders(){
+	if (keep_alive){
+		reply.headers.insert(make_pair("Connection", "keep-alive"));
+		reply.headers.insert(make_pair("Keep-Alive", str(format("timeout=%1%, max=%2%") % options.keep_alive_timeout % (options.max_keep_alive_requests - request_count))));
+	}
+	else{
+		reply.headers.insert(make_pair("Connection", "close"));
+	}
+}
+
+bool Connection::flush(){
+	if (! reply.isStreaming()){
+		setConnectionHeaders();
+	}
+	// The reply keeps changing while the chunk is written, so the chunk is written from a copy.
+	shared_ptr<string> chunk(new string);
+	vector<asio::const_buffer> buffers = reply.chunkToBuffers();
+	for (vector<asio::const_buffer>::const_iterator itr = buffers.begin(); itr != buffers.end(); ++ itr){
+		chunk->append(asio::buffer_cast<const char *>(*itr), asio::buffer_size(*itr));
+	}
+	reply.content.clear();
+	// Back to the connection strand, which owns the socket and the timer.
+	strand_.post(bind(&Connection::writeChunk, shared_from_this(), chunk));
+	return true;
+}
+
+void Connection::writeChunk(const shared_ptr<string> &chunk){
+	queued_chunks += *chunk;
+	if (chunk_in_flight.empty()){
+		writeQueuedChunks();
+	}
+}
+
+void Connection::writeQueuedChunks(){
+	if (queued_chunks.empty()){
+		return;
+	}
+	chunk_in_flight.swap(queued_chunks);
+	phase = writing;
+	setDeadline(options.write_timeout);
+	write_start = posix_time::microsec_clock::universal_time();
+	asio::async_write(
+			socket_,
+			asio::buffer(chunk_in_flight),
+			strand_.wrap(bind(&Connection::handleWriteChunk, shared_from_this(), asio::placeholders::error)));
+}
+
+void Connection::handleWriteChunk(const boost::system::error_code& e){
+	chunk_in_flight.clear();
+	if (e){
+		// The rest of the reply will fail to be written as well, which closes the connection.
+		keep_alive = false;
+		queued_chunks.clear();
+	}
+	else{
+		connection_manager.recordWrite(write_start);
+	}
+	if (! queued_chunks.empty()){
+		writeQueuedChunks();
+	}
+	else if (write_pending){
+		write_pending = false;
+		write();
+	}
+	else{
+		// The request handler is still producing the reply.
+		phase = handling;
+		setDeadline(-1);
+	}
+}
+
 void Connection::handleWrite(const boost::system::error_code& e){
+	if (!e){
+		connection_manager.recordWrite(write_start);
+	}
+	if (!e && keep_alive){
+		// Get ready for the next request, reusing the same objects.
+		request.reset();
+		reply.reset();
+		request_parser.reset();
+		if (buffer_begin < buffer_end){
+			// The client has pipelined the next request.
+			phase = reading_header;
+			setDeadline(options.header_timeout);
+			processBuffer();
+		}
+		else{
+			phase = waiting;
+			setDeadline(options.keep_alive_timeout);
+			read();
+		}
+		return;
+	}
+
 	if (!e){
 		// Initiate graceful connection closure.
 		boost::system::error_code ignored_e;
@@ -77,5 +330,27 @@ void Connection::handleWrite(const boost::system::error_code& e){
 	}
 }
 
+bool Connection::isKeepAlive() const {
+	if (request_count >= options.max_keep_alive_requests){
+		return false;
+	}
+	string connection_header;
+	for (multimap<string, string>::const_iterator itr = request.headers.begin(); itr != request.headers.end(); ++ itr){
+		if (iequals(itr->first, "Connection")){
+			connection_header = itr->second;
+			break;
+		}
+	}
+	if (isHTTP11()){
+		// HTTP/1.1 connections are persistent unless the client says otherwise.
+		return ! icontains(connection_header, "close");
+	}
+	return icontains(connection_header, "keep-alive");
+}
+
+bool Connection::isHTTP11() const {
+	return request.http_version_major > 1 || (request.http_version_major == 1 && request.http_version_minor >= 1);
+}
+
 } // namespace server
 } // namespace http
@@ -17,17 +17,44 @@ namespace server {
 /// Handler type: takes in a request and sends out a reply
 typedef boost::function<void (Request& request, Reply& reply)> RequestHandler;
 
+/// Tunable parameters shared by all connections of a server.
+class ConnectionOptions {
+public:
+	ConnectionOptions();
+
+	int keep_alive_timeout; ///< seconds an idle persistent connection is kept open
+	int max_keep_alive_requests; ///< max number of requests served over one connection (1 disables keep-alive)
+	int header_timeout; ///< seconds allowed for receiving a request header
+	int body_timeout; ///< seconds allowed for receiving a request body
+	int write_timeout; ///< seconds allowed for sending a reply
+	size_t max_connections; ///< more connections are rejected with 503 (0 for no limit)
+	size_t max_queued_requests; ///< more requests waiting for the request handler are rejected with 503 (0 for no limit)
+	int retry_after; ///< seconds a rejected client is told to wait before retrying
+};
+
 class ConnectionManager;
 
-/// Represents a single connection from a client.
+/*! \brief Represents a single connection from a client.
+ *
+ *  Supports HTTP/1.1 persistent connections. Pipelined requests are handled one at a time, in order:
+ *  bytes of the next request that arrive early are kept in the buffer until the current reply is written.
+ *  All socket and timer handlers of a connection run through its own strand.
+ *  The request handler may defer the reply (see Reply::defer), in which case nothing happens on the connection
+ *  until the reply is complete.
+ *
+ *  A single timer enforces a deadline on whatever the connection is waiting for from the client
+ *  (a request header or body, the next request, or a reply to be taken); the connection is closed when it passes.
+ */
 class Connection: public boost::enable_shared_from_this<Connection>, private boost::noncopyable {
 public:
 	/*! \brief Constructs a connection.
 	 *  \param io_service IO service
+	 *  \param handler_strand strand through which requests are handed to the request handler
 	 *  \param manager connection manager
 	 *  \param RequestHandler handler that processes requests to produce replies
+	 *  \param options connection parameters
 	 */
-	explicit Connection(boost::asio::io_service& io_service, ConnectionManager& manager, const RequestHandler& request_handler);
+	explicit Connection(boost::asio::io_service& io_service, boost::asio::io_service::strand &handler_strand, ConnectionManager& manager, const RequestHandler& request_handler, const ConnectionOptions &options);
 
 	/// Returns the socket associated with the connection.
 	boost::asio::ip::tcp::socket& socket();
@@ -35,22 +62,96 @@ public:
 	/// Starts the first asynchronous operation for the connection.
 	void start();
 
+	/// Replies 503 without reading the request, and closes the connection.
+	void reject();
+
 	/// Stops all asynchronous operations associated with the connection.
 	void stop();
 
 private:
+	/// Starts reading more data into the free part of the buffer.
+	void read();
+
+	/// Parses buffered data, and either dispatches a complete request or reads more.
+	void processBuffer();
+
 	/// Handles completion of a read operation.
 	void handleRead(const boost::system::error_code& e, std::size_t bytes_transferred);
 
+	/// Invokes the request handler (in the handler strand) and starts writing the reply.
+	void handleRequest();
+
+	/// Starts writing the reply.
+	void write();
+
+	/// Implements Reply::defer.
+	boost::function<void ()> defer();
+
+	/// Adds the Connection and Keep-Alive headers to the reply.
+	void setConnectionHeaders();
+
+	/*! \brief Sends the part of the reply produced so far, while the request handler is still running.
+	 *
+	 *  Called in the handler strand. The chunk is copied out of the reply and written from the connection strand,
+	 *  so the request handler does not wait for the client.
+	 *  Nothing else uses the socket in the meantime: no read is pending while a request is handled.
+	 */
+	bool flush();
+
+	/// Queues a flushed chunk, and starts writing it unless a chunk is being written already.
+	void writeChunk(const boost::shared_ptr<std::string> &chunk);
+
+	/// Starts writing the queued chunks.
+	void writeQueuedChunks();
+
+	/// Handles completion of writing a flushed chunk.
+	void handleWriteChunk(const boost::system::error_code& e);
+
 	/// Handles completion of a write operation.
 	void handleWrite(const boost::system::error_code& e);
 
+	/// Sets the deadline for the current phase, in seconds from now (negative for none).
+	void setDeadline(int seconds);
+
+	/// Closes the connection if the deadline has passed, otherwise waits for it again.
+	void checkDeadline(const boost::system::error_code& e);
+
+	/// Sets up a 503 reply telling the client to retry later.
+	void setServiceUnavailable();
+
+	/// Whether the connection can stay open after replying to the current request.
+	bool isKeepAlive() const;
+
+	/// Whether the client speaks HTTP/1.1 or later.
+	bool isHTTP11() const;
+
 	/// Socket for the connection.
 	boost::asio::ip::tcp::socket socket_;
 
+	/// Serializes the handlers of this connection.
+	boost::asio::io_service::strand strand_;
+
+	/// Fires when the deadline of the current phase passes.
+	boost::asio::deadline_timer timer;
+
+	/// What the connection is doing.
+	enum Phase {
+		waiting, ///< waiting for the next request on a persistent connection
+		reading_header,
+		reading_body,
+		handling,
+		writing
+	} phase;
+
 	/// Buffer for incoming data.
 	boost::array<char, 8 * 1024> buffer;
 
+	/// Start of data in buffer not yet consumed by the parser.
+	std::size_t buffer_begin;
+
+	/// End of data in buffer.
+	std::size_t buffer_end;
+
 	/// The manager for this connection.
 	ConnectionManager& connection_manager;
 
@@ -60,11 +161,38 @@ private:
 	/// The parser for the incoming request.
 	RequestParser request_parser;
 
+	/// Strand through which the request handler is invoked.
+	boost::asio::io_service::strand &handler_strand;
+
 	/// The handler used to process the incoming request.
 	const RequestHandler& request_handler;
 
+	/// Connection parameters.
+	const ConnectionOptions &options;
+
 	/// The reply to be sent back to the client.
 	Reply reply;
+
+	/// Number of requests received over this connection.
+	int request_count;
+
+	/// Whether to keep the connection open after the current reply.
+	bool keep_alive;
+
+	/// Whether the request handler has deferred the current reply.
+	bool deferred;
+
+	/// When the current write started.
+	boost::posix_time::ptime write_start;
+
+	/// Flushed chunk being written.
+	std::string chunk_in_flight;
+
+	/// Flushed chunks waiting for chunk_in_flight to be written.
+	std::string queued_chunks;
+
+	/// Whether the reply was completed while flushed chunks were still being written.
+	bool write_pending;
 };
 
 typedef boost::shared_ptr<Connection> ConnectionPtr;
@@ -8,19 +8,83 @@ using namespace boost;
 namespace http {
 namespace server {
 
+AdmissionStats::AdmissionStats():
+	active_connections(0),
+	queued_requests(0),
+	accepted_connections(0),
+	rejected_connections(0),
+	shed_requests(0),
+	timed_out_connections(0)
+{
+}
+
+ConnectionManager::ConnectionManager(const ConnectionOptions &options_): options(options_) {
+}
+
 void ConnectionManager::start(ConnectionPtr c){
-	connections.insert(c);
-	c->start();
+	bool accepted;
+	{
+		boost::mutex::scoped_lock lock(connections_mutex);
+		accepted = options.max_connections == 0 || connections.size() < options.max_connections;
+		if (accepted){
+			connections.insert(c);
+			++ stats.accepted_connections;
+		}
+		else{
+			++ stats.rejected_connections;
+		}
+	}
+	if (accepted){
+		c->start();
+	}
+	else{
+		// The rejected connection is not managed; it closes itself once the reply is written.
+		c->reject();
+	}
 }
 
 void ConnectionManager::stop(ConnectionPtr c){
-	connections.erase(c);
+	{
+		boost::mutex::scoped_lock lock(connections_mutex);
+		connections.erase(c);
+	}
 	c->stop();
 }
 
 void ConnectionManager::stopAll(){
-	for_each(connections.begin(), connections.end(), bind(&Connection::stop, _1));
-	connections.clear();
+	set<ConnectionPtr> temp;
+	{
+		boost::mutex::scoped_lock lock(connections_mutex);
+		swap(temp, connections);
+	}
+	for_each(temp.begin(), temp.end(), bind(&Connection::stop, _1));
+}
+
+bool ConnectionManager::queueRequest(){
+	boost::mutex::scoped_lock lock(connections_mutex);
+	if (options.max_queued_requests != 0 && stats.queued_requests >= options.max_queued_requests){
+		++ stats.shed_requests;
+		return false;
+	}
+	++ stats.queued_requests;
+	return true;
+}
+
+void ConnectionManager::dequeueRequest(){
+	boost::mutex::scoped_lock lock(connections_mutex);
+	-- stats.queued_requests;
+}
+
+void ConnectionManager::countTimeout(){
+	boost::mutex::scoped_lock lock(connections_mutex);
+	++ stats.timed_out_connections;
+}
+
+AdmissionStats ConnectionManager::getStats() const {
+	boost::mutex::scoped_lock lock(connections_mutex);
+	AdmissionStats result = stats;
+	result.active_connections = connections.size();
+	return result;
 }
 
 } // namespace server
@@ -3,15 +3,36 @@
 
 #include <set>
 #include <boost/noncopyable.hpp>
+#include <boost/thread/mutex.hpp>
 #include "connection.h"
+#include "latency_histogram.h"
 
 namespace http {
 namespace server {
 
-/// Manages open connections so that they may be cleanly stopped when the server needs to shut down.
+/// Counters of connection admission.
+class AdmissionStats {
+public:
+	AdmissionStats();
+
+	std::size_t active_connections; ///< connections currently open
+	std::size_t queued_requests; ///< requests currently waiting for the request handler
+	long long accepted_connections; ///< total connections accepted
+	long long rejected_connections; ///< total connections rejected because there were too many
+	long long shed_requests; ///< total requests rejected because too many were waiting for the request handler
+	long long timed_out_connections; ///< total connections closed because the client was too slow
+};
+
+/*! \brief Manages open connections so that they may be cleanly stopped when the server needs to shut down.
+ *
+ *  Also does admission control: connections and queued requests beyond the configured limits are turned away with 503.
+ *  Thread-safe, since connections are started and stopped from different io threads.
+ */
 class ConnectionManager: private boost::noncopyable {
 public:
-	/// Adds the specified connection to the manager and start it.
+	explicit ConnectionManager(const ConnectionOptions &options);
+
+	/// Adds the specified connection to the manager and start it, or rejects it if there are too many connections.
 	void start(ConnectionPtr c);
 
 	/// Stops the specified connection.
@@ -20,9 +41,41 @@ public:
 	/// Stops all connections.
 	void stopAll();
 
+	/*! \brief Called when a request is about to be queued for the request handler.
+	 *  \return false if too many requests are queued already, in which case the request should be rejected
+	 */
+	bool queueRequest();
+
+	/// Called when the request handler takes a queued request.
+	void dequeueRequest();
+
+	/// Called when a connection is closed because the client missed a deadline.
+	void countTimeout();
+
+	/// Returns current counters.
+	AdmissionStats getStats() const;
+
+	/// Records how long it took to write (part of) a reply to the socket.
+	void recordWrite(const boost::posix_time::ptime &start) { write_latency.recordSince(start); }
+
+	/// Returns latencies of socket writes.
+	const ::util::LatencyHistogram& getWriteLatency() const { return write_latency; }
+
 private:
+	/// Connection parameters, including limits.
+	const ConnectionOptions &options;
+
 	/// The managed connections.
 	std::set<ConnectionPtr> connections;
+
+	/// Admission counters (active_connections is taken from connections).
+	AdmissionStats stats;
+
+	/// Guards connections and stats.
+	mutable boost::mutex connections_mutex;
+
+	/// Latencies of socket writes.
+	::util::LatencyHistogram write_latency;
 };
 
 } // namespace server
@@ -1,7 +1,9 @@
 #include "console_ui.h"
 #include <boost/bind.hpp>
 #include <boost/foreach.hpp>
+#include <boost/lexical_cast.hpp>
 #include "logger.h"
+#include "search_proxy.h"
 #include "template_engine.h"
 #include "user_manager.h"
 #include "ucair_server.h"
@@ -66,6 +68,46 @@ void ConsoleUI::displayConsole(Request &request, Reply &reply){
 
 		t_main.set("address", getUCAIRServer().getAddress() + ":" + getUCAIRServer().getPort());
 
+		long long bytes_before_compression = getUCAIRServer().getBytesBeforeCompression();
+		long long bytes_after_compression = getUCAIRServer().getBytesAfterCompression();
+		long long compression_saved_percent = bytes_before_compression == 0 ? 0 : (bytes_before_compression - bytes_after_compression) * 100 / bytes_before_compression;
+		t_main.set("uncompressed_kb", lexical_cast<string>(bytes_before_compression / 1024))
+			.set("compressed_kb", lexical_cast<string>(bytes_after_compression / 1024))
+			.set("compression_saved_percent", lexical_cast<string>(compression_saved_percent));
+
+		http::server::AdmissionStats admission_stats = getUCAIRServer().getAdmissionStats();
+		t_main.set("active_connections", lexical_cast<string>(admission_stats.active_connections))
+			.set("queued_requests", lexical_cast<string>(admission_stats.queued_requests))
+			.set("accepted_connections", lexical_cast<string>(admission_stats.accepted_connections))
+			.set("rejected_connections", lexical_cast<string>(admission_stats.rejected_connections))
+			.set("shed_requests", lexical_cast<string>(admission_stats.shed_requests))
+			.set("timed_out_connections", lexical_cast<string>(admission_stats.timed_out_connections));
+
+		const SearchResultCache &result_cache = getSearchProxy().getResultCache();
+		t_main.set("cache_hits", lexical_cast<string>(result_cache.getHitCount()))
+			.set("cache_misses", lexical_cast<string>(result_cache.getMissCount()))
+			.set("cache_pages", lexical_cast<string>(result_cache.getPageCount()))
+			.set("cache_kb", lexical_cast<string>(result_cache.getSize() / 1024));
+		const SearchProxy &search_proxy = getSearchProxy();
+		t_main.set("searches_in_memory", lexical_cast<string>(search_proxy.getSearchCount()))
+			.set("searches_kb", lexical_cast<string>(search_proxy.getSearchesSize() / 1024))
+			.set("evicted_searches", lexical_cast<string>(search_proxy.getEvictedSearchCount()))
+			.set("evicted_kb", lexical_cast<string>(search_proxy.getEvictedSize() / 1024))
+			.set("prefetches", lexical_cast<string>(search_proxy.getPrefetchCount()))
+			.set("coalesced_fetches", lexical_cast<string>(search_proxy.getCoalescedFetchCount()));
+		BOOST_FOREACH(const shared_ptr<SearchEngineBreaker> &breaker, search_proxy.getBreakers()) {
+			SearchEngineBreaker::Health health = breaker->getHealth();
+			t_main.addChild("breaker")
+					.set("search_engine_id", breaker->getSearchEngineId())
+					.set("state", SearchEngineBreaker::toString(health.state))
+					.set("error_percent", lexical_cast<string>((int) (health.error_rate * 100 + 0.5)))
+					.set("latency", lexical_cast<string>((int) (health.latency + 0.5)))
+					.set("requests", lexical_cast<string>(health.request_count))
+					.set("failures", lexical_cast<string>(health.failure_count))
+					.set("fast_failures", lexical_cast<string>(health.fast_failure_count))
+					.set("fallbacks", lexical_cast<string>(health.fallback_count));
+		}
+
 		string content = templating::getTemplateEngine().render(t_main, "console.htm");
 		reply.content = content;
 	}
@@ -0,0 +1,193 @@
+#include "content_encoding.h"
+#include <cassert>
+#include <cstdlib>
+#include <new>
+#include <vector>
+#include <boost/algorithm/string.hpp>
+
+using namespace std;
+using namespace boost;
+
+namespace http {
+namespace util {
+
+string toString(ContentEncoding encoding){
+	switch (encoding){
+	case GZIP:
+		return "gzip";
+	case DEFLATE:
+		return "deflate";
+	default:
+		return "identity";
+	}
+}
+
+ContentEncoding negotiateContentEncoding(const string &accept_encoding){
+	// q-values of gzip, deflate and *; -1 if not mentioned.
+	double gzip_q = -1.0, deflate_q = -1.0, any_q = -1.0;
+	vector<string> codings;
+	split(codings, accept_encoding, is_any_of(","));
+	for (vector<string>::const_iterator itr = codings.begin(); itr != codings.end(); ++ itr){
+		string coding = *itr;
+		double q = 1.0;
+		string::size_type pos = coding.find(';');
+		if (pos != string::npos){
+			string param = trim_copy(coding.substr(pos + 1));
+			if (istarts_with(param, "q=")){
+				q = atof(param.c_str() + 2);
+			}
+			coding.erase(pos);
+		}
+		trim(coding);
+		if (iequals(coding, "gzip") || iequals(coding, "x-gzip")){
+			gzip_q = q;
+		}
+		else if (iequals(coding, "deflate")){
+			deflate_q = q;
+		}
+		else if (coding == "*"){
+			any_q = q;
+		}
+	}
+	if (gzip_q < 0.0){
+		gzip_q = any_q;
+	}
+	if (deflate_q < 0.0){
+		deflate_q = any_q;
+	}
+	if (gzip_q > 0.0 && gzip_q >= deflate_q){
+		return GZIP;
+	}
+	if (deflate_q > 0.0){
+		return DEFLATE;
+	}
+	return IDENTITY;
+}
+
+Compressor::Compressor(ContentEncoding encoding, int level){
+	assert(encoding == GZIP || encoding == DEFLATE);
+	stream.zalloc = Z_NULL;
+	stream.zfree = Z_NULL;
+	stream.opaque = Z_NULL;
+	// Window bits 15 gives zlib format, which is what "deflate" means in HTTP; adding 16 gives gzip format.
+	int window_bits = encoding == GZIP ? 15 + 16 : 15;
+	if (deflateInit2(&stream, level, Z_DEFLATED, window_bits, 8, Z_DEFAULT_STRATEGY) != Z_OK){
+		throw bad_alloc();
+	}
+}
+
+Compressor::~Compressor(){
+	deflateEnd(&stream);
+}
+
+void Compressor::compress(const string &in, string &out, bool finish){
+	stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in.data()));
+	stream.avail_in = static_cast<uInt>(in.size());
+	int flush = finish ? Z_FINISH : Z_SYNC_FLUSH;
+	char buffer[16 * 1024];
+	// With Z_SYNC_FLUSH deflate is done when it leaves space in the output buffer; with Z_FINISH it returns Z_STREAM_END.
+	while (true){
+		stream.next_out = reinterpret_cast<Bytef*>(buffer);
+		stream.avail_out = sizeof(buffer);
+		int rc = deflate(&stream, flush);
+		assert(rc != Z_STREAM_ERROR);
+		out.append(buffer, sizeof(buffer) - stream.avail_out);
+		if (finish ? rc == Z_STREAM_END : stream.avail_out != 0){
+			break;
+		}
+	}
+}
+
+void compress(const string &in, string &out, ContentEncoding encoding, int level){
+	Compressor compressor(encoding, level);
+	compressor.compress(in, out, true);
+}
+
+Decompressor::Decompressor(ContentEncoding encoding_):
+	encoding(encoding_),
+	raw(false),
+	finished(false)
+{
+	assert(encoding == GZIP || encoding == DEFLATE);
+	// Adding 32 to window bits makes zlib detect gzip or zlib format from the header.
+	init(15 + 32);
+}
+
+Decompressor::~Decompressor(){
+	inflateEnd(&stream);
+}
+
+void Decompressor::init(int window_bits){
+	stream.zalloc = Z_NULL;
+	stream.zfree = Z_NULL;
+	stream.opaque = Z_NULL;
+	stream.next_in = Z_NULL;
+	stream.avail_in = 0;
+	if (inflateInit2(&stream, window_bits) != Z_OK){
+		throw bad_alloc();
+	}
+}
+
+bool Decompressor::decompress(const char *data, size_t size, string &out){
+	if (finished){
+		// Anything after the end is ignored.
+		return true;
+	}
+	bool may_be_raw = encoding == DEFLATE && ! raw && stream.total_out == 0;
+	if (may_be_raw){
+		head.append(data, size);
+	}
+	if (inflate(data, size, out)){
+		if (stream.total_out > 0){
+			head.clear();
+		}
+		return true;
+	}
+	if (! may_be_raw){
+		return false;
+	}
+	// Not zlib format; start over as raw deflate (negative window bits).
+	inflateEnd(&stream);
+	init(-15);
+	raw = true;
+	string input;
+	input.swap(head);
+	return inflate(input.data(), input.size(), out);
+}
+
+bool Decompressor::inflate(const char *data, size_t size, string &out){
+	stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+	stream.avail_in = static_cast<uInt>(size);
+	char buffer[16 * 1024];
+	do {
+		stream.next_out = reinterpret_cast<Bytef*>(buffer);
+		stream.avail_out = sizeof(buffer);
+		int rc = ::inflate(&stream, Z_NO_FLUSH);
+		if (rc != Z_OK && rc != Z_STREAM_END && rc != Z_BUF_ERROR){
+			return false;
+		}
+		out.append(buffer, sizeof(buffer) - stream.avail_out);
+		if (rc == Z_STREAM_END){
+			finished = true;
+			return true;
+		}
+		if (rc == Z_BUF_ERROR){
+			// Needs more input.
+			break;
+		}
+	} while (stream.avail_in > 0 || stream.avail_out == 0);
+	return true;
+}
+
+bool decompress(const string &in, string &out, ContentEncoding encoding){
+	size_t original_size = out.size();
+	Decompressor decompressor(encoding);
+	if (decompressor.decompress(in.data(), in.size(), out) && decompressor.isFinished()){
+		return true;
+	}
+	out.resize(original_size);
+	return false;
+}
+
+} // namespace util
+} // namespace http
@@ -0,0 +1,105 @@
+/*! \file content_encoding.h
+ *  \brief Utilities to compress and decompress HTTP content with gzip or deflate.
+ *
+ *  http://en.wikipedia.org/wiki/HTTP_compression
+ */
+
+#ifndef __content_encoding_h__
+#define __content_encoding_h__
+
+#include <string>
+#include <boost/noncopyable.hpp>
+#include <zlib.h>
+
+namespace http {
+namespace util {
+
+/// Content codings supported.
+enum ContentEncoding {
+	IDENTITY, GZIP, DEFLATE
+};
+
+/// Returns the name of a content coding as used in Content-Encoding header.
+std::string toString(ContentEncoding encoding);
+
+/*! \brief Picks the preferred content coding accepted by the client.
+ *  \param accept_encoding value of Accept-Encoding header
+ *  \return GZIP if acceptable, otherwise DEFLATE if acceptable, otherwise IDENTITY
+ */
+ContentEncoding negotiateContentEncoding(const std::string &accept_encoding);
+
+/*! \brief Compresses content with zlib.
+ *
+ *  Content can be fed in several pieces, e.g. one per chunk of a chunked reply.
+ */
+class Compressor: private boost::noncopyable {
+public:
+	/*! \brief Constructor
+	 *  \param encoding GZIP or DEFLATE
+	 *  \param level compression level, from 1 (fastest) to 9 (best)
+	 */
+	Compressor(ContentEncoding encoding, int level);
+	~Compressor();
+
+	/*! \brief Compresses a piece of content.
+	 *  \param[in] in content
+	 *  \param[out] out compressed data is appended to it
+	 *  \param finish true if this is the last piece, otherwise out is flushed so that it can be decompressed by the client so far
+	 */
+	void compress(const std::string &in, std::string &out, bool finish);
+
+private:
+	z_stream stream;
+};
+
+/// Compresses content in one go.
+void compress(const std::string &in, std::string &out, ContentEncoding encoding, int level);
+
+/*! \brief Decompresses content piece by piece, as it arrives.
+ *
+ *  For DEFLATE, both zlib format and raw deflate data (which some servers send instead) are accepted.
+ */
+class Decompressor: private boost::noncopyable {
+public:
+	/// \param encoding GZIP or DEFLATE
+	explicit Decompressor(ContentEncoding encoding);
+	~Decompressor();
+
+	/*! \brief Decompresses a piece of content.
+	 *  \param[in] data compressed data
+	 *  \param[in] size size of data
+	 *  \param[out] out decompressed data is appended to it
+	 *  \return false if the data is corrupt
+	 */
+	bool decompress(const char *data, size_t size, std::string &out);
+
+	/// Whether the end of compressed data has been reached; if not, the data is truncated so far.
+	bool isFinished() const { return finished; }
+
+private:
+	/// Sets up zlib with given window bits.
+	void init(int window_bits);
+	/// Inflates as much of the data as possible.
+	bool inflate(const char *data, size_t size, std::string &out);
+
+	z_stream stream;
+	ContentEncoding encoding;
+	bool raw; ///< whether the data is taken as raw deflate
+	std::string head; ///< data taken in before any output, to start over as raw deflate if it is not zlib format
+	bool finished;
+};
+
+/*! \brief Decompresses content in one go.
+ *
+ *  For DEFLATE, both zlib format and raw deflate data (which some servers send instead) are accepted.
+ *  \param[in] in compressed content
+ *  \param[out] out decompressed content is appended to it
+ *  \param encoding GZIP or DEFLATE
+ *  \return false if the data is corrupt or truncated
+ */
+bool decompress(const std::string &in, std::string &out, ContentEncoding encoding);
+
+} // namespace util
+} // namespace http
+
+#endif
@@ -6,7 +6,8 @@ using namespace boost;
 
 namespace ucair {
 
-DelayedSignal::DelayedSignal(asio::io_service &io_service):
+DelayedSignal::DelayedSignal(asio::io_service &io_service, asio::io_service::strand &strand_):
+	strand(strand_),
 	timer(io_service),
 	fire_time(posix_time::not_a_date_time),
 	active(false)
@@ -18,7 +19,7 @@ void DelayedSignal::waitTill(posix_time::ptime t){
 	if (! active){
 		active = true;
 		timer.expires_at(fire_time);
-		timer.async_wait(bind(&DelayedSignal::handler, this, asio::placeholders::error));
+		timer.async_wait(strand.wrap(bind(&DelayedSignal::handler, this, asio::placeholders::error)));
 	}
 }
 
@@ -43,7 +44,7 @@ void DelayedSignal::handler(const boost::system::error_code &error){
 	}
 	else{
 		timer.expires_at(fire_time);
-		timer.async_wait(bind(&DelayedSignal::handler, this, asio::placeholders::error));
+		timer.async_wait(strand.wrap(bind(&DelayedSignal::handler, this, asio::placeholders::error)));
 	}
 }
 
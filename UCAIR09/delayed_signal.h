@@ -10,7 +10,8 @@ namespace ucair {
 /// Extension of boost::signal, in that the signal can be scheduled to fire at a future time or pushed off.
 class DelayedSignal{
 public:
-	DelayedSignal(boost::asio::io_service &io_service);
+	/// The signal fires through the given strand, so slots never run concurrently with other code on it.
+	DelayedSignal(boost::asio::io_service &io_service, boost::asio::io_service::strand &strand);
 
 	/// Signal will be activated and fire at a given time.
 	void waitTill(boost::posix_time::ptime t);
@@ -26,6 +27,7 @@ public:
 
 private:
 	void handler(const boost::system::error_code& error);
+	boost::asio::io_service::strand &strand;
 	boost::asio::deadline_timer timer;
 	boost::posix_time::ptime fire_time;
 	volatile bool active;
@@ -1,4 +1,5 @@
 #include "doc_stream_manager.h"
+#include <boost/bind.hpp>
 #include <boost/foreach.hpp>
 #include <boost/tuple/tuple.hpp>
 #include "config.h"
@@ -36,11 +37,46 @@ void DocStream::update() {
 	DocProducer *doc_producer = getDocStreamManager().getDocProducer(doc_producer_id);
 	assert(doc_producer);
 	doc_producer->produceDoc(*this);
+	indexDocs();
+}
+
+void DocStream::asyncUpdate(const function<void ()> &callback) {
+	DocProducer *doc_producer = getDocStreamManager().getDocProducer(doc_producer_id);
+	assert(doc_producer);
+	shared_ptr<string> source(new string);
+	shared_ptr<bool> ok(new bool(false));
+	Main::instance().postBlocking(bind(&DocStream::download, doc_producer, source, ok),
+			bind(&DocStream::onDownloaded, doc_stream_id, doc_producer, source, ok, callback));
+}
+
+void DocStream::download(const DocProducer *doc_producer, const shared_ptr<string> &source, const shared_ptr<bool> &ok) {
+	*ok = doc_producer->download(*source);
+}
+
+void DocStream::onDownloaded(const string &doc_stream_id, DocProducer *doc_producer, const shared_ptr<string> &source,
+		const shared_ptr<bool> &ok, const function<void ()> &callback) {
+	DocStream *doc_stream = getDocStreamManager().getDocStream(doc_stream_id);
+	if (doc_stream && *ok) {
+		doc_producer->produceDoc(*doc_stream, *source);
+		doc_stream->indexDocs();
+	}
+	callback();
+}
+
+void DocStream::indexDocs() {
 	BOOST_FOREACH(const Document &doc, doc_list) {
 		indexDocument(*index, doc);
 	}
 }
 
+bool DocProducer::produceDoc(DocStream &doc_stream) {
+	string source;
+	if (! download(source)) {
+		return false;
+	}
+	return produceDoc(doc_stream, source);
+}
+
 bool DocStreamManager::initialize() {
 	recommend_min_sim = util::getParam<double>(Main::instance().getConfig(), "recommend_min_sim");
 	return true;
@@ -83,10 +119,11 @@ bool DocStreamManager::isRecommended(const User &user, const Document &doc, doub
 	map<int, double> doc_term_counts;
 	map<int, double> doc_model;
 	indexing::countTerms(getIndexManager().getTermDict(), doc.title + " " + doc.summary, doc_term_counts);
+	const indexing::ColProbs &col_probs = getIndexManager().getColProbs();
 	vector<tuple<double, double, double> > values;
 	for (map<int, double>::const_iterator itr = doc_term_counts.begin(); itr != doc_term_counts.end(); ++ itr) {
 		double f = itr->second;
-		double p = getIndexManager().getColProb(itr->first);
+		double p = col_probs.get(itr->first);
 		values.push_back(make_tuple(f, p, 0.0));
 	}
 	estimateMixture(values, 0.9);
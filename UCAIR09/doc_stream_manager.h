@@ -8,6 +8,7 @@
 #include <boost/multi_index/member.hpp>
 #include <boost/multi_index/ordered_index.hpp>
 #include <boost/multi_index/sequenced_index.hpp>
+#include <boost/function.hpp>
 #include <boost/shared_ptr.hpp>
 #include "component.h"
 #include "main.h"
@@ -27,6 +28,8 @@ typedef boost::multi_index::multi_index_container<
 
 typedef IndexedDocList::nth_index<1>::type DocIdIndex;
 
+class DocProducer;
+
 /// Models a document stream.
 class DocStream {
 public:
@@ -49,6 +52,10 @@ public:
 
 	/// Updates documents from the producer and indexes them.
 	void update();
+	/*! \brief Same as update, but downloads on a worker thread instead of blocking.
+	 *  \param callback invoked in the application strand once the stream is updated
+	 */
+	void asyncUpdate(const boost::function<void ()> &callback);
 
 	/// Returns the index for documents in the stream.
 	indexing::SimpleIndex* getIndex() const { return index.get(); }
@@ -56,6 +63,14 @@ public:
 	util::Properties properties; ///< additional properties
 
 private:
+	/// Indexes documents in the stream.
+	void indexDocs();
+	/// Downloads for asyncUpdate on a worker thread.
+	static void download(const DocProducer *doc_producer, const boost::shared_ptr<std::string> &source, const boost::shared_ptr<bool> &ok);
+	/// Produces documents from what asyncUpdate has downloaded, and invokes its callback.
+	static void onDownloaded(const std::string &doc_stream_id, DocProducer *doc_producer, const boost::shared_ptr<std::string> &source,
+			const boost::shared_ptr<bool> &ok, const boost::function<void ()> &callback);
+
 	IndexedDocList doc_list;
 	std::string doc_stream_id;
 	std::string doc_producer_id;
@@ -73,8 +88,17 @@ public:
 	/// Returns id of the doc producer.
 	std::string getId() const { return doc_producer_id; }
 
-	/// Injects documents into the given doc stream.
-	virtual bool produceDoc(DocStream &doc_stream) = 0;
+	/*! \brief Downloads what documents are produced from, such as a feed.
+	 *
+	 *  May be called on a worker thread, so it must not touch anything other than the producer itself.
+	 *  \param[out] source downloaded data, to be passed to produceDoc
+	 *  \return false if failed
+	 */
+	virtual bool download(std::string &source) const { return true; }
+	/// Injects documents made from downloaded data into the given doc stream.
+	virtual bool produceDoc(DocStream &doc_stream, const std::string &source) = 0;
+	/// Downloads and injects documents into the given doc stream.
+	bool produceDoc(DocStream &doc_stream);
 
 protected:
 	std::string doc_producer_id;
@@ -99,12 +123,12 @@ public:
 	DocProducer* getDocProducer(const std::string &doc_producer_id);
 
 	/*! \brief Decides whether a document should be recommended to a user based on its similarity to a search topic.
-	 *
-	 *  \param[in] user
-	 *  \param[in] doc
-	 *  \param[out] user-doc maximal similarity between the document and a user search topic
-	 *  \param[out] topic_id which topic is matched
-	 *  \return true if recommended
+	 *
+	 *  \param[in] user
+	 *  \param[in] doc
+	 *  \param[out] user-doc maximal similarity between the document and a user search topic
+	 *  \param[out] topic_id which topic is matched
+	 *  \return true if recommended
 	 */
 	bool isRecommended(const User &user, const Document &doc, double &sim, int &topic_id);
 
@@ -1,5 +1,6 @@
 #include "doc_stream_ui.h"
 #include <vector>
+#include <boost/bind.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/foreach.hpp>
 #include <boost/lexical_cast.hpp>
@@ -43,7 +44,7 @@ bool DocStreamMenuItem::isActive(const Request &request) const {
 }
 
 bool DocStreamUI::initialize(){
-	getUCAIRServer().registerHandler(RequestHandler::CGI_HTML, "/stream", bind(&DocStreamUI::displayDocStream, this, _1, _2));
+	getUCAIRServer().registerAsyncHandler(RequestHandler::CGI_HTML, "/stream", bind(&DocStreamUI::displayDocStream, this, _1, _2, _3));
 	getSearchMenu().addMenuItem(shared_ptr<DocStreamMenuItem>(new DocStreamMenuItem));
 
 	//TODO: allow user to edit sources rather than hardcoding here.
@@ -74,7 +75,7 @@ bool DocStreamUI::initialize(){
 	return true;
 }
 
-void DocStreamUI::displayDocStream(Request &request, Reply &reply) {
+void DocStreamUI::displayDocStream(Request &request, Reply &reply, const RequestHandler::Completion &completion) {
 	User *user = getUserManager().getUser(request, true);
 	assert(user);
 
@@ -86,6 +87,23 @@ void DocStreamUI::displayDocStream(Request &request, Reply &reply) {
 		}
 	}
 
+	DocStream *doc_stream = getDocStreamManager().getDocStream(stream_id);
+	if (doc_stream) {
+		doc_stream->asyncUpdate(bind(&DocStreamUI::onDocStreamUpdated, this, ref(request), ref(reply), stream_id, completion));
+	}
+	else {
+		completion.resume(bind(&DocStreamUI::renderDocStream, this, ref(request), ref(reply), stream_id));
+	}
+}
+
+void DocStreamUI::onDocStreamUpdated(Request &request, Reply &reply, const string &stream_id, const RequestHandler::Completion &completion) {
+	completion.resume(bind(&DocStreamUI::renderDocStream, this, ref(request), ref(reply), stream_id));
+}
+
+void DocStreamUI::renderDocStream(Request &request, Reply &reply, const string &stream_id) {
+	User *user = getUserManager().getUser(request, true);
+	assert(user);
+
 	DocStream *doc_stream = getDocStreamManager().getDocStream(stream_id);
 
 	try {
@@ -101,7 +119,6 @@ void DocStreamUI::displayDocStream(Request &request, Reply &reply) {
 		}
 
 		if (doc_stream) {
-			doc_stream->update();
 			renderDocList(t_main, *user, *doc_stream);
 			user->setLastViewedDocStreamId(stream_id);
 		}
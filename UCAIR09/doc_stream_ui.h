@@ -5,12 +5,10 @@
 #include "doc_stream_manager.h"
 #include "search_menu.h"
 #include "template_engine.h"
+#include "ucair_server.h"
 
 namespace ucair {
 
-class Request;
-class Reply;
-
 /// A search menu item that links to this document stream page.
 class DocStreamMenuItem: public SearchMenuItem {
 public:
@@ -24,9 +22,15 @@ class DocStreamUI: public Component {
 public:
 	bool initialize();
 
-	void displayDocStream(Request &request, Reply &reply);
+	/// Called when a user views a document stream. The stream is updated first, without holding up the server.
+	void displayDocStream(Request &request, Reply &reply, const RequestHandler::Completion &completion);
 
 private:
+	/// Called in the application strand once the stream to display is updated.
+	void onDocStreamUpdated(Request &request, Reply &reply, const std::string &stream_id, const RequestHandler::Completion &completion);
+	/// Renders the document stream page.
+	void renderDocStream(Request &request, Reply &reply, const std::string &stream_id);
+
 	void renderDocList(templating::TemplateData &t_main, const User &user, const DocStream &doc_stream);
 };
 
@@ -4,6 +4,7 @@
 #include <ctime>
 #include <string>
 #include <iostream>
+#include <vector>
 #include "properties.h"
 
 namespace ucair {
@@ -44,6 +45,11 @@ public:
 	std::string mime_type; ///< document mime type (e.g. html, pdf)
 	util::Properties attrs;
 
+	/*! \brief Stemmed terms of title and summary, if extracted ahead of indexing (see indexDocument).
+	 *  Not saved or cached, and freed once the document is indexed (see SearchProxy::clearStemmedTerms).
+	 */
+	std::vector<std::string> stemmed_terms;
+
 friend std::ostream& operator << (std::ostream &out, const Document &doc);
 };
 
@@ -0,0 +1,242 @@
+#include "federated_search_engine.h"
+#include <algorithm>
+#include <map>
+#include <boost/algorithm/string.hpp>
+#include <boost/bind.hpp>
+#include <boost/foreach.hpp>
+#include <boost/thread.hpp>
+#include "logger.h"
+#include "main.h"
+#include "ucair_util.h"
+
+using namespace std;
+using namespace boost;
+
+namespace {
+
+/// A result being merged.
+class FusedResult {
+public:
+	ucair::SearchResult result;
+	double score;
+	int best_rank; ///< best rank given by a search engine, to break ties
+	size_t order; ///< order of arrival, to keep the merge stable
+
+	bool operator < (const FusedResult &other) const {
+		if (score != other.score) {
+			return score > other.score;
+		}
+		if (best_rank != other.best_rank) {
+			return best_rank < other.best_rank;
+		}
+		return order < other.order;
+	}
+};
+
+} // anonymous namespace
+
+namespace ucair {
+
+FederatedSearchEngine::FederatedSearchEngine(const vector<shared_ptr<SearchEngine> > &search_engines_, int deadline_):
+		search_engines(search_engines_),
+		deadline(max(deadline_, 0)) {
+}
+
+string FederatedSearchEngine::getSearchEngineName() const {
+	vector<string> names;
+	BOOST_FOREACH(const shared_ptr<SearchEngine> &search_engine, search_engines) {
+		names.push_back(search_engine->getSearchEngineName());
+	}
+	return join(names, " + ");
+}
+
+int FederatedSearchEngine::maxAllowedResultCount() const {
+	int result_count = 0;
+	BOOST_FOREACH(const shared_ptr<SearchEngine> &search_engine, search_engines) {
+		int count = search_engine->maxAllowedResultCount();
+		if (result_count == 0 || count < result_count) {
+			result_count = count;
+		}
+	}
+	return max(result_count, 1);
+}
+
+string FederatedSearchEngine::normalizeUrl(const string &url) {
+	string s = url.substr(0, url.find('#'));
+	size_t scheme_end = s.find("://");
+	size_t host_begin = scheme_end == string::npos ? 0 : scheme_end + 3;
+	size_t host_end = s.find_first_of("/?", host_begin);
+	if (host_end == string::npos) {
+		host_end = s.size();
+	}
+	string host = to_lower_copy(s.substr(host_begin, host_end - host_begin));
+	if (starts_with(host, "www.")) {
+		host.erase(0, 4);
+	}
+	string rest = s.substr(host_end);
+	if (ends_with(rest, "/")) {
+		rest.erase(rest.size() - 1);
+	}
+	return host + rest;
+}
+
+bool FederatedSearchEngine::fetchResults(Search &search, int &start_pos, int &result_count) {
+	if (search_engines.empty()) {
+		return false;
+	}
+	shared_ptr<Fetch> fetch(new Fetch);
+	fetch->search_engines = search_engines;
+	fetch->searches.resize(search_engines.size());
+	fetch->start_positions.resize(search_engines.size());
+	fetch->result_counts.resize(search_engines.size(), result_count);
+	fetch->next_index = 0;
+	fetch->done.resize(search_engines.size(), false);
+	fetch->ok.resize(search_engines.size(), false);
+	fetch->done_count = 0;
+	fetch->ok_count = 0;
+	for (size_t i = 0; i < search_engines.size(); ++ i) {
+		Search &engine_search = fetch->searches[i];
+		engine_search.query = search.query;
+		engine_search.setSearchId(search.getSearchId());
+		engine_search.setSearchEngineId(search_engines[i]->getSearchEngineId());
+		// A search engine that has not answered for earlier pages is read from the top.
+		map<string, int>::const_iterator depth_itr = search.source_depths.find(search_engines[i]->getSearchEngineId());
+		if (depth_itr != search.source_depths.end()) {
+			fetch->start_positions[i] = depth_itr->second + 1;
+		}
+		else {
+			fetch->start_positions[i] = search.source_depths.empty() ? start_pos : 1;
+		}
+	}
+
+	fetch->deadline_time = get_system_time() + posix_time::milliseconds(deadline);
+
+	// Unlike SearchEngineRepeater, this thread takes no search engine itself: a fetch cannot be given up at the deadline.
+	// If worker threads are too busy to take them in time, the fetch fails instead.
+	for (size_t i = 0; i < search_engines.size(); ++ i) {
+		Main::instance().postBlocking(bind(&FederatedSearchEngine::fetchFromSearchEngines, fetch), function<void ()>());
+	}
+
+	mutex::scoped_lock lock(fetch->fetch_mutex);
+	while (fetch->done_count < (int) search_engines.size()) {
+		if (! fetch->fetch_finished.timed_wait(lock, fetch->deadline_time)) {
+			break;
+		}
+	}
+	fetch->next_index = search_engines.size();
+	if (fetch->ok_count == 0) {
+		getLogger().error("No results of query ( " + search.query.text + " ) from any search engine by the deadline");
+		return false;
+	}
+	for (size_t i = 0; i < search_engines.size(); ++ i) {
+		if (! fetch->done[i]) {
+			getLogger().info("Dropped results of query ( " + search.query.text + " ) from " + search_engines[i]->getSearchEngineId() + ", past the deadline");
+		}
+	}
+	result_count = merge(*fetch, search, start_pos);
+	return true;
+}
+
+void FederatedSearchEngine::fetchFromSearchEngines(const shared_ptr<Fetch> &fetch) {
+	while (true) {
+		size_t index;
+		Search search;
+		int start_pos;
+		int result_count;
+		{
+			mutex::scoped_lock lock(fetch->fetch_mutex);
+			if (get_system_time() >= fetch->deadline_time) {
+				fetch->next_index = fetch->search_engines.size();
+			}
+			if (fetch->next_index >= fetch->search_engines.size()) {
+				return;
+			}
+			index = fetch->next_index ++;
+			search = fetch->searches[index];
+			start_pos = fetch->start_positions[index];
+			result_count = fetch->result_counts[index];
+		}
+		bool ok = fetch->search_engines[index]->fetchResults(search, start_pos, result_count);
+		{
+			mutex::scoped_lock lock(fetch->fetch_mutex);
+			fetch->done[index] = true;
+			++ fetch->done_count;
+			if (ok) {
+				fetch->ok[index] = true;
+				++ fetch->ok_count;
+				fetch->searches[index].results.swap(search.results);
+				fetch->searches[index].query = search.query;
+				fetch->searches[index].setTotalResultCount(search.getTotalResultCount());
+				fetch->start_positions[index] = start_pos;
+				fetch->result_counts[index] = result_count;
+			}
+		}
+		fetch->fetch_finished.notify_all();
+	}
+}
+
+int FederatedSearchEngine::merge(const Fetch &fetch, Search &search, int start_pos) const {
+	vector<FusedResult> fused;
+	map<string, size_t> fused_by_url; // index in fused, by normalized url
+	long long total_result_count = 0;
+	for (size_t i = 0; i < search_engines.size(); ++ i) {
+		if (! fetch.ok[i]) {
+			continue;
+		}
+		const Search &engine_search = fetch.searches[i];
+		string search_engine_id = search_engines[i]->getSearchEngineId();
+		total_result_count = max(total_result_count, engine_search.getTotalResultCount());
+		if (! engine_search.results.empty()) {
+			search.source_depths[search_engine_id] = engine_search.results.rbegin()->first;
+		}
+		else {
+			search.source_depths.insert(make_pair(search_engine_id, fetch.start_positions[i] - 1));
+		}
+		if (search.query.spell_suggestion.empty()) {
+			search.query.spell_suggestion = engine_search.query.spell_suggestion;
+		}
+		for (map<int, SearchResult>::const_iterator itr = engine_search.results.begin(); itr != engine_search.results.end(); ++ itr) {
+			const SearchResult &result = itr->second;
+			int rank = itr->first;
+			string url = normalizeUrl(result.url);
+			map<string, size_t>::iterator url_itr = fused_by_url.find(url);
+			if (url_itr == fused_by_url.end()) {
+				fused_by_url.insert(make_pair(url, fused.size()));
+				fused.push_back(FusedResult());
+				FusedResult &f = fused.back();
+				f.result = result;
+				f.result.source_ranks.clear();
+				f.score = 0.0;
+				f.best_rank = rank;
+				f.order = fused.size();
+				url_itr = fused_by_url.find(url);
+			}
+			FusedResult &f = fused[url_itr->second];
+			f.score += 1.0 / (RRF_K + rank);
+			f.best_rank = min(f.best_rank, rank);
+			f.result.source_ranks.push_back(make_pair(search_engine_id, rank));
+			if (f.result.summary.empty()) {
+				f.result.summary = result.summary;
+				f.result.formatted_summary = result.formatted_summary;
+				// Stemmed again from title and summary when indexed.
+				f.result.stemmed_terms.clear();
+			}
+		}
+	}
+	// Nothing is cut: the search engines are read on from where they were left on the next page.
+	sort(fused.begin(), fused.end());
+
+	search.setTotalResultCount(total_result_count);
+	int rank = start_pos;
+	BOOST_FOREACH(FusedResult &f, fused) {
+		SearchResult &result = search.results[rank];
+		result = f.result;
+		result.search_id = search.getSearchId();
+		result.original_rank = rank;
+		result.doc_id = buildDocName(result.search_id, rank);
+		++ rank;
+	}
+	return (int) fused.size();
+}
+
+}
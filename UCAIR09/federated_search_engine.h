@@ -0,0 +1,89 @@
+#ifndef __federated_search_engine_h__
+#define __federated_search_engine_h__
+
+#include <string>
+#include <vector>
+#include <boost/smart_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread_time.hpp>
+#include "search_engine.h"
+
+namespace ucair {
+
+/*! \brief Sends a query to several search engines at once, and merges their results.
+ *
+ *  Each search engine is asked for as many results as the search, from the rank after the last one taken from it
+ *  (see Search::source_depths), on worker threads (see Main::postBlocking).
+ *  Whatever has arrived by the deadline is merged; search engines that are later are dropped, and if none has answered by then
+ *  the fetch fails.
+ *  Results with the same normalized url are merged into one, ranked by reciprocal rank fusion:
+ *  the score of a result is the sum of 1 / (RRF_K + rank) over the search engines that returned it.
+ *  Each merged result records the search engines it came from, with their ranks (see SearchResult::source_ranks).
+ *  All merged results are kept, so a fetch may return more results than asked for.
+ *  Results repeated on different pages are not merged.
+ */
+class FederatedSearchEngine: public SearchEngine {
+public:
+	/*! \brief Constructor.
+	 *  \param search_engines search engines to send queries to; when merging, results of earlier ones are preferred
+	 *  \param deadline time given to the search engines, in milliseconds
+	 */
+	FederatedSearchEngine(const std::vector<boost::shared_ptr<SearchEngine> > &search_engines, int deadline);
+
+	std::string getSearchEngineId() const { return "federated"; }
+	std::string getSearchEngineName() const;
+
+	/*! \brief Retrieves results for a query from all search engines, and merges them.
+	 *
+	 *  start_pos is kept; result_count is set to the number of merged results.
+	 *  \return true if at least one search engine answered
+	 */
+	bool fetchResults(Search &search, int &start_pos, int &result_count);
+
+	/// Returns the smallest max result count of the search engines, so that each returns the same range.
+	int maxAllowedResultCount() const;
+
+	/// Returns a url with scheme, "www.", fragment and trailing slash removed, and host in lower case.
+	static std::string normalizeUrl(const std::string &url);
+
+	/// Constant added to ranks in reciprocal rank fusion, which keeps top ranks from dominating.
+	static const int RRF_K = 60;
+
+private:
+	/// Results of a query from all search engines; shared with the threads fetching them, which may outlive the search.
+	class Fetch {
+	public:
+		std::vector<boost::shared_ptr<SearchEngine> > search_engines;
+		std::vector<Search> searches; ///< asked of each search engine, then its results
+		std::vector<int> start_positions; ///< start pos asked of each search engine, then the one it answered with
+		std::vector<int> result_counts; ///< result count asked of each search engine, then the one it answered with
+		size_t next_index; ///< first search engine not taken by a thread yet
+		boost::system_time deadline_time; ///< no search engine is taken after this
+		std::vector<bool> done;
+		std::vector<bool> ok;
+		int done_count;
+		int ok_count;
+		boost::mutex fetch_mutex;
+		boost::condition_variable fetch_finished;
+	};
+
+	/*! \brief Takes search engines that no thread has taken yet and fetches results from them, until none is left.
+	 *  Run by helpers posted to worker threads. At the deadline the search engines left are given up,
+	 *  so a helper that starts late finds nothing to do.
+	 */
+	static void fetchFromSearchEngines(const boost::shared_ptr<Fetch> &fetch);
+
+	/*! \brief Merges all results that have arrived into a search, from start_pos on, and records how far each search engine
+	 *  has been read in Search::source_depths.
+	 *  \return number of merged results
+	 */
+	int merge(const Fetch &fetch, Search &search, int start_pos) const;
+
+	std::vector<boost::shared_ptr<SearchEngine> > search_engines;
+	int deadline;
+};
+
+}
+
+#endif
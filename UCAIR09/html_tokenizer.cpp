@@ -0,0 +1,307 @@
+#include "html_tokenizer.h"
+
+using namespace std;
+
+namespace html {
+
+namespace {
+
+bool isSpace(char c){
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f';
+}
+
+bool isLetter(char c){
+	return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+char toLower(char c){
+	return c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c;
+}
+
+} // anonymous namespace
+
+Token::Token():
+	type(TEXT),
+	self_closing(false)
+{
+}
+
+void Token::clear(){
+	type = TEXT;
+	name.clear();
+	text.clear();
+	attrs.clear();
+	self_closing = false;
+}
+
+bool Token::getAttr(const string &name, string &value) const {
+	const string *p = findAttr(name);
+	if (! p){
+		return false;
+	}
+	value = *p;
+	return true;
+}
+
+string Token::getAttr(const string &name) const {
+	const string *p = findAttr(name);
+	return p ? *p : string();
+}
+
+const string* Token::findAttr(const string &name) const {
+	for (vector<pair<string, string> >::const_iterator itr = attrs.begin(); itr != attrs.end(); ++ itr){
+		if (itr->first == name){
+			return &itr->second;
+		}
+	}
+	return NULL;
+}
+
+Tokenizer::Tokenizer():
+	pos(0),
+	finished(false),
+	raw_text_checked(0)
+{
+}
+
+void Tokenizer::feed(const char *data, size_t size){
+	// Drop what has been taken, so that the buffer mostly holds input not yet tokenized.
+	if (pos > 0 && pos >= buffer.size() / 2){
+		buffer.erase(0, pos);
+		pos = 0;
+	}
+	buffer.append(data, size);
+}
+
+void Tokenizer::finish(){
+	finished = true;
+}
+
+bool Tokenizer::next(Token &token){
+	token.clear();
+	if (pos >= buffer.size()){
+		return false;
+	}
+	if (! raw_text_element.empty()){
+		return readRawText(token);
+	}
+	size_t text_begin = pos;
+	if (buffer[pos] == '<'){
+		if (pos + 1 >= buffer.size() && ! finished){
+			return false;
+		}
+		if (pos + 1 < buffer.size()){
+			char c = buffer[pos + 1];
+			if (c == '!' || c == '?'){
+				return readComment(token);
+			}
+			if (isLetter(c) || c == '/'){
+				return readTag(token);
+			}
+		}
+		// A '<' that does not start a tag.
+		++ text_begin;
+	}
+	size_t text_end = buffer.find('<', text_begin);
+	if (text_end == string::npos){
+		if (! finished){
+			return false;
+		}
+		text_end = buffer.size();
+	}
+	token.type = Token::TEXT;
+	token.text.assign(buffer, pos, text_end - pos);
+	pos = text_end;
+	return true;
+}
+
+bool Tokenizer::readTag(Token &token){
+	const size_t size = buffer.size();
+	size_t p = pos + 1;
+	bool end_tag = buffer[p] == '/';
+	if (end_tag){
+		++ p;
+	}
+
+	// Find the closing '>', skipping quoted attribute values.
+	size_t close = p;
+	char quote = 0;
+	char last = 0; // last character outside quotes, other than space
+	for (; close < size; ++ close){
+		char c = buffer[close];
+		if (quote){
+			if (c == quote){
+				quote = 0;
+			}
+		}
+		else if (c == '>'){
+			break;
+		}
+		else if ((c == '"' || c == '\'') && last == '='){
+			quote = c;
+		}
+		else if (! isSpace(c)){
+			last = c;
+		}
+	}
+	if (close >= size){
+		if (! finished){
+			return false;
+		}
+		// Unterminated at the end of input.
+		token.type = Token::TEXT;
+		token.text.assign(buffer, pos, string::npos);
+		pos = size;
+		return true;
+	}
+
+	size_t name_begin = p;
+	while (p < close && ! isSpace(buffer[p]) && buffer[p] != '/'){
+		++ p;
+	}
+	token.name.reserve(p - name_begin);
+	for (size_t i = name_begin; i < p; ++ i){
+		token.name += toLower(buffer[i]);
+	}
+	if (token.name.empty()){
+		// E.g. "</ >"
+		token.type = Token::COMMENT;
+		token.text.assign(buffer, pos, close + 1 - pos);
+		pos = close + 1;
+		return true;
+	}
+	token.type = end_tag ? Token::END_TAG : Token::START_TAG;
+
+	if (! end_tag){
+		while (p < close){
+			while (p < close && (isSpace(buffer[p]) || buffer[p] == '/')){
+				++ p;
+			}
+			if (p >= close){
+				break;
+			}
+			size_t attr_name_begin = p;
+			while (p < close && ! isSpace(buffer[p]) && buffer[p] != '=' && buffer[p] != '/'){
+				++ p;
+			}
+			token.attrs.push_back(make_pair(string(), string()));
+			string &attr_name = token.attrs.back().first;
+			string &attr_value = token.attrs.back().second;
+			for (size_t i = attr_name_begin; i < p; ++ i){
+				attr_name += toLower(buffer[i]);
+			}
+			while (p < close && isSpace(buffer[p])){
+				++ p;
+			}
+			if (p >= close || buffer[p] != '='){
+				continue;
+			}
+			++ p;
+			while (p < close && isSpace(buffer[p])){
+				++ p;
+			}
+			if (p < close && (buffer[p] == '"' || buffer[p] == '\'')){
+				size_t value_end = buffer.find(buffer[p], p + 1);
+				if (value_end == string::npos || value_end > close){
+					value_end = close;
+				}
+				attr_value.assign(buffer, p + 1, value_end - p - 1);
+				p = value_end + 1;
+			}
+			else{
+				size_t value_begin = p;
+				while (p < close && ! isSpace(buffer[p])){
+					++ p;
+				}
+				attr_value.assign(buffer, value_begin, p - value_begin);
+			}
+		}
+		token.self_closing = buffer[close - 1] == '/';
+		if (! token.self_closing && (token.name == "script" || token.name == "style")){
+			raw_text_element = token.name;
+			raw_text_checked = 0;
+		}
+	}
+	pos = close + 1;
+	return true;
+}
+
+bool Tokenizer::readComment(Token &token){
+	const size_t size = buffer.size();
+	if (size - pos < 4 && ! finished){
+		return false;
+	}
+	size_t end;
+	size_t end_length;
+	if (buffer.compare(pos, 4, "<!--") == 0){
+		end = buffer.find("-->", pos + 4);
+		end_length = 3;
+	}
+	else{
+		end = buffer.find('>', pos + 2);
+		end_length = 1;
+	}
+	if (end == string::npos){
+		if (! finished){
+			return false;
+		}
+		end = size;
+		end_length = 0;
+	}
+	token.type = Token::COMMENT;
+	token.text.assign(buffer, pos, end + end_length - pos);
+	pos = end + end_length;
+	return true;
+}
+
+bool Tokenizer::readRawText(Token &token){
+	const size_t size = buffer.size();
+	const size_t name_length = raw_text_element.size();
+	size_t end = pos + raw_text_checked;
+	for (;;){
+		end = buffer.find("</", end);
+		if (end == string::npos || end + 2 + name_length >= size){
+			if (! finished){
+				// Look again from here when more input arrives.
+				// A partial end tag may be cut off at the end of the buffer.
+				raw_text_checked = end == string::npos ? (size - pos > 0 ? size - pos - 1 : 0) : end - pos;
+				return false;
+			}
+			end = size;
+			break;
+		}
+		bool matched = true;
+		for (size_t i = 0; i < name_length; ++ i){
+			if (toLower(buffer[end + 2 + i]) != raw_text_element[i]){
+				matched = false;
+				break;
+			}
+		}
+		char c = buffer[end + 2 + name_length];
+		if (matched && (isSpace(c) || c == '>' || c == '/')){
+			break;
+		}
+		++ end;
+	}
+	raw_text_element.clear();
+	raw_text_checked = 0;
+	if (end == pos){
+		return next(token);
+	}
+	token.type = Token::TEXT;
+	token.text.assign(buffer, pos, end - pos);
+	pos = end;
+	return true;
+}
+
+bool Tokenizer::isVoidElement(const string &name){
+	static const char *names[] = {"area", "base", "br", "col", "embed", "hr", "img", "input", "link", "meta", "param", "source", "wbr"};
+	for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); ++ i){
+		if (name == names[i]){
+			return true;
+		}
+	}
+	return false;
+}
+
+} // namespace html
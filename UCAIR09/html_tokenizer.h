@@ -0,0 +1,88 @@
+#ifndef __html_tokenizer_h__
+#define __html_tokenizer_h__
+
+#include <string>
+#include <utility>
+#include <vector>
+#include <boost/utility.hpp>
+
+namespace html {
+
+/// A piece of HTML: a tag, or text between tags.
+class Token {
+public:
+	enum Type {
+		TEXT,
+		START_TAG,
+		END_TAG,
+		COMMENT ///< also doc types and processing instructions
+	};
+
+	Token();
+
+	/// Empties the token for reuse.
+	void clear();
+
+	/*! \brief Gets the value of an attribute of a start tag.
+	 *  \param name attribute name, in lower case
+	 *  \param[out] value attribute value, with entities left as they are
+	 *  \return false if the tag has no such attribute
+	 */
+	bool getAttr(const std::string &name, std::string &value) const;
+
+	/// Returns the value of an attribute, or an empty string.
+	std::string getAttr(const std::string &name) const;
+
+	/// Returns the value of an attribute, or NULL if the tag has no such attribute.
+	const std::string* findAttr(const std::string &name) const;
+
+	Type type;
+	std::string name; ///< tag name in lower case
+	std::string text; ///< text, with entities left as they are
+	std::vector<std::pair<std::string, std::string> > attrs; ///< attribute names (in lower case) and values
+	bool self_closing; ///< whether a start tag ends with "/>"
+};
+
+/*! \brief Splits HTML into tokens, one pass over the input.
+ *
+ *  Input can be fed in pieces as it arrives; a token is returned once it is complete.
+ *  Broken HTML is tolerated: a '<' that does not start a tag is taken as text.
+ *  The content of script and style elements is returned as a single text token.
+ */
+class Tokenizer: private boost::noncopyable {
+public:
+	Tokenizer();
+
+	/// Appends input.
+	void feed(const char *data, size_t size);
+
+	/// Marks the end of input, so that whatever remains is returned.
+	void finish();
+
+	/*! \brief Takes the next token.
+	 *  \param[out] token next token
+	 *  \return false if more input is needed (or all input has been taken)
+	 */
+	bool next(Token &token);
+
+	/// Returns whether an element has no content and no end tag (e.g. br).
+	static bool isVoidElement(const std::string &name);
+
+private:
+	/// Reads a tag starting at pos; returns false if it is incomplete.
+	bool readTag(Token &token);
+	/// Reads a comment or doc type starting at pos; returns false if it is incomplete.
+	bool readComment(Token &token);
+	/// Reads the content of a script or style element; returns false if it is incomplete.
+	bool readRawText(Token &token);
+
+	std::string buffer;
+	size_t pos; ///< start of input in buffer not yet taken
+	bool finished;
+	std::string raw_text_element; ///< script or style element whose content comes next
+	size_t raw_text_checked; ///< length of raw text after pos already searched for its end tag
+};
+
+} // namespace html
+
+#endif
@@ -0,0 +1,896 @@
+#include "http_client.h"
+#include <cstdlib>
+#include <fstream>
+#include <boost/algorithm/string.hpp>
+#include <boost/array.hpp>
+#include <boost/bind.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/foreach.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/logic/tribool.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include "common_util.h"
+#include "content_encoding.h"
+#include "logger.h"
+
+using namespace std;
+using namespace boost;
+using asio::ip::tcp;
+
+namespace http {
+namespace util {
+
+const string DEFAULT_USER_AGENT = "Mozilla/5.0 (Windows; U; Windows NT 6.0; en-US; rv:1.9.0.10) Gecko/2009042316 Firefox/3.0.10 (.NET CLR 3.5.30729)";
+
+/// Max size of a reply header.
+static const size_t MAX_HEADER_LENGTH = 64 * 1024;
+
+/*! \brief Splits an http URL into what is needed to request it.
+ *  \param[in] url URL
+ *  \param[out] host host name
+ *  \param[out] port port, "80" if not given
+ *  \param[out] target path and query, starting with "/"
+ *  \return false if it is not an http URL
+ */
+static bool splitURL(const string &url, string &host, string &port, string &target){
+	static const string scheme = "http://";
+	if (! istarts_with(url, scheme)){
+		return false;
+	}
+	string::size_type authority_end = url.find_first_of("/?#", scheme.size());
+	string authority = url.substr(scheme.size(), authority_end == string::npos ? string::npos : authority_end - scheme.size());
+	string::size_type pos = authority.rfind('@');
+	if (pos != string::npos){
+		authority.erase(0, pos + 1);
+	}
+	pos = authority.rfind(':');
+	if (pos != string::npos){
+		host = authority.substr(0, pos);
+		port = authority.substr(pos + 1);
+	}
+	else {
+		host = authority;
+		port.clear();
+	}
+	if (port.empty()){
+		port = "80";
+	}
+	if (host.empty()){
+		return false;
+	}
+	target = authority_end == string::npos ? "" : url.substr(authority_end);
+	pos = target.find('#');
+	if (pos != string::npos){
+		target.erase(pos);
+	}
+	if (target.empty() || target[0] != '/'){
+		target.insert(0, "/");
+	}
+	return true;
+}
+
+/// Resolves the location of a redirect, which may be relative, against the URL redirected from.
+static string resolveURL(const string &base, const string &location){
+	string::size_type scheme_end = base.find("://");
+	if (location.find("://") != string::npos || scheme_end == string::npos){
+		return location;
+	}
+	if (starts_with(location, "//")){
+		return base.substr(0, scheme_end + 1) + location;
+	}
+	string::size_type authority_end = base.find_first_of("/?#", scheme_end + 3);
+	string origin = base.substr(0, authority_end);
+	if (starts_with(location, "/")){
+		return origin + location;
+	}
+	string path = authority_end == string::npos ? "" : base.substr(authority_end);
+	path.erase(min(path.find_first_of("?#"), path.size()));
+	if (path.empty()){
+		path = "/";
+	}
+	if (! starts_with(location, "?")){
+		path.erase(path.rfind('/') + 1);
+	}
+	return origin + path + location;
+}
+
+/*! \brief A download in progress.
+ *
+ *  All handlers run through its own strand. A deadline timer closes the socket when the current phase takes too long,
+ *  which makes the pending operation fail.
+ */
+class HTTPFetch: public enable_shared_from_this<HTTPFetch>, private noncopyable {
+public:
+	HTTPFetch(HTTPClient &client, const string &url, const HTTPClient::DataCallback &on_data, const HTTPClient::Callback &callback, int redirects_left);
+
+	/// Starts downloading.
+	void start();
+
+	/// Makes the download fail as soon as possible.
+	void abort();
+
+private:
+	/// Starts downloading the current URL (the original one, or where it was redirected to).
+	void startURL();
+
+	/// Finds the addresses of the host, from the cache if possible.
+	void resolve();
+	void handleResolve(const system::error_code &e, tcp::resolver::iterator itr);
+
+	/// Connects to the next address of the host.
+	void connect();
+	void handleConnect(const system::error_code &e);
+
+	void sendRequest();
+	void handleWrite(const system::error_code &e);
+
+	void read();
+	void handleRead(const system::error_code &e, size_t bytes_transferred);
+
+	/// Parses the reply header if received; returns indeterminate if more data is needed.
+	tribool parseHeader();
+
+	/// Takes in received content; returns indeterminate if more data is needed.
+	tribool parseBody();
+
+	/// Adds a piece of content, passing it on if streaming; returns false if it cannot be decompressed.
+	bool addBody(const char *data, size_t size);
+
+	/// Whether content is passed on as it arrives (once the header is parsed).
+	bool isStreaming() const { return on_data && status >= 200 && status < 300; }
+
+	/// Handles a complete reply.
+	void handleReply();
+
+	/// Gives up a pooled connection that the server has closed in the meantime, and starts over with a new one.
+	void retry();
+
+	void setDeadline(int seconds);
+	void handleDeadline(const system::error_code &e);
+
+	void handleAbort();
+
+	/// Fails the download; the message is overridden if timed out or aborted.
+	void fail(const string &err_msg);
+
+	/// Completes the download, and invokes the callback.
+	void finish(bool succeeded, const string &content, const string &err_msg);
+
+	void closeSocket();
+
+	HTTPClient &client;
+	asio::io_service::strand strand_;
+	tcp::resolver resolver;
+	asio::deadline_timer timer;
+	HTTPClient::DataCallback on_data;
+	HTTPClient::Callback callback;
+
+	string url; ///< URL being downloaded
+	int redirects_left;
+	string host;
+	string port;
+	string host_port; ///< key of pooled connections and cached addresses
+	string target; ///< path and query
+
+	HTTPClient::SocketPtr socket;
+	bool reused; ///< whether the connection came from the pool
+	vector<tcp::endpoint> endpoints; ///< addresses of the host
+	size_t endpoint_index; ///< address being connected to
+	string request_data;
+	array<char, 8 * 1024> buffer;
+	string received; ///< data received and not yet parsed
+
+	bool header_parsed;
+	int status;
+	bool keep_alive;
+	ContentEncoding content_encoding;
+	string location;
+
+	/// How the end of content is known.
+	enum Framing {
+		LENGTH, ///< by Content-Length
+		CHUNKED, ///< by Transfer-Encoding: chunked
+		UNTIL_CLOSE ///< by the server closing the connection
+	} framing;
+	size_t content_length;
+
+	/// Where the parser is in chunked content.
+	enum ChunkState {
+		CHUNK_SIZE,
+		CHUNK_DATA,
+		CHUNK_END, ///< CRLF after chunk data
+		TRAILER
+	} chunk_state;
+	size_t chunk_remaining;
+
+	string body; ///< content, unless streaming
+	size_t body_length; ///< length of content received, before decompression
+	scoped_ptr<Decompressor> decompressor; ///< decompresses content when streaming
+	string decompressed; ///< buffer for decompressed content when streaming
+
+	bool timed_out;
+	bool aborted;
+	bool done;
+};
+
+HTTPFetch::HTTPFetch(HTTPClient &client_, const string &url_, const HTTPClient::DataCallback &on_data_, const HTTPClient::Callback &callback_, int redirects_left_):
+	client(client_),
+	strand_(client_.io_service),
+	resolver(client_.io_service),
+	timer(client_.io_service),
+	on_data(on_data_),
+	callback(callback_),
+	url(url_),
+	redirects_left(redirects_left_),
+	reused(false),
+	endpoint_index(0),
+	header_parsed(false),
+	status(0),
+	keep_alive(false),
+	content_encoding(IDENTITY),
+	framing(UNTIL_CLOSE),
+	content_length(0),
+	chunk_state(CHUNK_SIZE),
+	chunk_remaining(0),
+	body_length(0),
+	timed_out(false),
+	aborted(false),
+	done(false) {
+}
+
+void HTTPFetch::start(){
+	strand_.post(bind(&HTTPFetch::startURL, shared_from_this()));
+}
+
+void HTTPFetch::abort(){
+	strand_.post(bind(&HTTPFetch::handleAbort, shared_from_this()));
+}
+
+void HTTPFetch::startURL(){
+	if (aborted){
+		fail("");
+		return;
+	}
+	ucair::getLogger().info("Downloading " + url);
+
+	if (starts_with(url, "file://")){
+		string path = url.substr(7);
+		ifstream fin(path.c_str());
+		if (! fin){
+			fail("File does not exist: " + path);
+			return;
+		}
+		string content;
+		::util::readFile(fin, content);
+		if (on_data){
+			on_data(content.data(), content.size());
+			content.clear();
+		}
+		finish(true, content, "");
+		return;
+	}
+
+	if (! splitURL(url, host, port, target)){
+		fail("Not HTTP");
+		return;
+	}
+	host_port = host + ":" + port;
+
+	received.clear();
+	body.clear();
+	body_length = 0;
+	decompressor.reset();
+	header_parsed = false;
+
+	socket = client.checkOut(host_port);
+	if (socket){
+		reused = true;
+		sendRequest();
+	}
+	else {
+		reused = false;
+		resolve();
+	}
+}
+
+void HTTPFetch::resolve(){
+	setDeadline(client.options.connect_timeout);
+	if (client.lookUpHost(host_port, endpoints)){
+		endpoint_index = 0;
+		connect();
+		return;
+	}
+	tcp::resolver::query query(host, port);
+	resolver.async_resolve(query,
+			strand_.wrap(bind(&HTTPFetch::handleResolve, shared_from_this(), asio::placeholders::error, asio::placeholders::iterator)));
+}
+
+void HTTPFetch::handleResolve(const system::error_code &e, tcp::resolver::iterator itr){
+	if (e || aborted || timed_out){
+		fail("Failed to resolve " + host);
+		return;
+	}
+	endpoints.clear();
+	for (tcp::resolver::iterator end; itr != end; ++ itr){
+		endpoints.push_back(*itr);
+	}
+	client.cacheHost(host_port, endpoints);
+	endpoint_index = 0;
+	connect();
+}
+
+void HTTPFetch::connect(){
+	if (endpoint_index >= endpoints.size()){
+		// Addresses may have changed.
+		client.cacheHost(host_port, vector<tcp::endpoint>());
+		fail("Failed to connect to " + host_port);
+		return;
+	}
+	socket.reset(new tcp::socket(client.io_service));
+	socket->async_connect(endpoints[endpoint_index],
+			strand_.wrap(bind(&HTTPFetch::handleConnect, shared_from_this(), asio::placeholders::error)));
+}
+
+void HTTPFetch::handleConnect(const system::error_code &e){
+	if (aborted || timed_out){
+		fail("");
+		return;
+	}
+	if (e){
+		// Try the next address.
+		++ endpoint_index;
+		connect();
+		return;
+	}
+	sendRequest();
+}
+
+void HTTPFetch::sendRequest(){
+	request_data = "GET " + target + " HTTP/1.1\r\n";
+	request_data += "Host: " + (port == "80" ? host : host_port) + "\r\n";
+	request_data += "Accept: */*\r\n";
+	request_data += "Accept-Encoding: gzip, deflate\r\n";
+	request_data += client.options.max_idle_connections_per_host > 0 ? "Connection: keep-alive\r\n" : "Connection: close\r\n";
+	request_data += "User-Agent: " + client.options.user_agent + "\r\n";
+	request_data += "\r\n";
+	setDeadline(client.options.read_timeout);
+	asio::async_write(*socket, asio::buffer(request_data),
+			strand_.wrap(bind(&HTTPFetch::handleWrite, shared_from_this(), asio::placeholders::error)));
+}
+
+void HTTPFetch::handleWrite(const system::error_code &e){
+	if (e || aborted || timed_out){
+		if (reused && ! aborted && ! timed_out){
+			retry();
+		}
+		else {
+			fail("Failed to send request to " + host_port);
+		}
+		return;
+	}
+	read();
+}
+
+void HTTPFetch::read(){
+	socket->async_read_some(asio::buffer(buffer),
+			strand_.wrap(bind(&HTTPFetch::handleRead, shared_from_this(), asio::placeholders::error, asio::placeholders::bytes_transferred)));
+}
+
+void HTTPFetch::handleRead(const system::error_code &e, size_t bytes_transferred){
+	if (aborted || timed_out){
+		fail("");
+		return;
+	}
+	if (e){
+		if (e == asio::error::eof && header_parsed && framing == UNTIL_CLOSE){
+			handleReply();
+		}
+		else if (reused && ! header_parsed && received.empty()){
+			retry();
+		}
+		else {
+			fail("Failed to read reply from " + host_port);
+		}
+		return;
+	}
+	received.append(buffer.data(), bytes_transferred);
+	// The deadline applies to each read, so that a slow but steady download is not cut off.
+	setDeadline(client.options.read_timeout);
+
+	if (! header_parsed){
+		tribool result = parseHeader();
+		if (! result){
+			fail("Invalid reply header from " + host_port);
+			return;
+		}
+		if (indeterminate(result)){
+			read();
+			return;
+		}
+		if (framing == LENGTH && content_length > client.options.max_content_length){
+			fail("Content too long from " + url);
+			return;
+		}
+	}
+	tribool result = parseBody();
+	if (! result){
+		fail("Invalid reply content from " + host_port);
+	}
+	else if (body_length > client.options.max_content_length){
+		fail("Content too long from " + url);
+	}
+	else if (result){
+		handleReply();
+	}
+	else {
+		read();
+	}
+}
+
+tribool HTTPFetch::parseHeader(){
+	string::size_type header_end = received.find("\r\n\r\n");
+	if (header_end == string::npos){
+		return received.size() > MAX_HEADER_LENGTH ? tribool(false) : tribool(indeterminate);
+	}
+	string header = received.substr(0, header_end);
+	received.erase(0, header_end + 4);
+
+	vector<string> lines;
+	iter_split(lines, header, first_finder("\r\n"));
+	const string &status_line = lines.front();
+	if (! starts_with(status_line, "HTTP/") || status_line.size() < 12){
+		return false;
+	}
+	status = atoi(status_line.c_str() + 9);
+	if (status < 100){
+		return false;
+	}
+	keep_alive = ! starts_with(status_line, "HTTP/1.0");
+	bool chunked = false;
+	framing = UNTIL_CLOSE;
+	content_length = 0;
+	content_encoding = IDENTITY;
+	location.clear();
+	for (size_t i = 1; i < lines.size(); ++ i){
+		const string &line = lines[i];
+		string::size_type pos = line.find(':');
+		if (pos == string::npos){
+			continue;
+		}
+		string name = line.substr(0, pos);
+		string value = trim_copy(line.substr(pos + 1));
+		if (iequals(name, "Content-Length")){
+			framing = LENGTH;
+			content_length = strtoul(value.c_str(), NULL, 10);
+		}
+		else if (iequals(name, "Transfer-Encoding")){
+			chunked = icontains(value, "chunked");
+		}
+		else if (iequals(name, "Connection")){
+			if (icontains(value, "close")){
+				keep_alive = false;
+			}
+			else if (icontains(value, "keep-alive")){
+				keep_alive = true;
+			}
+		}
+		else if (iequals(name, "Content-Encoding")){
+			if (iequals(value, "gzip") || iequals(value, "x-gzip")){
+				content_encoding = GZIP;
+			}
+			else if (iequals(value, "deflate")){
+				content_encoding = DEFLATE;
+			}
+		}
+		else if (iequals(name, "Location")){
+			location = value;
+		}
+	}
+
+	if (status < 200){
+		// An interim reply (e.g. 100 Continue); the real one follows.
+		return parseHeader();
+	}
+	if (chunked){
+		framing = CHUNKED;
+		chunk_state = CHUNK_SIZE;
+	}
+	if (status == 204 || status == 304){
+		framing = LENGTH;
+		content_length = 0;
+	}
+	if (framing == UNTIL_CLOSE){
+		keep_alive = false;
+	}
+	if (isStreaming() && content_encoding != IDENTITY){
+		decompressor.reset(new Decompressor(content_encoding));
+	}
+	header_parsed = true;
+	return true;
+}
+
+tribool HTTPFetch::parseBody(){
+	if (framing == UNTIL_CLOSE){
+		bool ok = addBody(received.data(), received.size());
+		received.clear();
+		return ok ? tribool(indeterminate) : tribool(false);
+	}
+	if (framing == LENGTH){
+		size_t length = min(received.size(), content_length - body_length);
+		bool ok = addBody(received.data(), length);
+		received.erase(0, length);
+		if (! ok){
+			return false;
+		}
+		return body_length == content_length ? tribool(true) : tribool(indeterminate);
+	}
+	while (true){
+		string::size_type pos;
+		switch (chunk_state){
+		case CHUNK_SIZE:
+			pos = received.find("\r\n");
+			if (pos == string::npos){
+				return received.size() > MAX_HEADER_LENGTH ? tribool(false) : tribool(indeterminate);
+			}
+			else {
+				char *end;
+				chunk_remaining = strtoul(received.c_str(), &end, 16);
+				if (end == received.c_str()){
+					return false;
+				}
+				received.erase(0, pos + 2);
+				chunk_state = chunk_remaining == 0 ? TRAILER : CHUNK_DATA;
+			}
+			break;
+		case CHUNK_DATA:
+			{
+				size_t length = min(received.size(), chunk_remaining);
+				bool ok = addBody(received.data(), length);
+				received.erase(0, length);
+				if (! ok){
+					return false;
+				}
+				chunk_remaining -= length;
+				if (chunk_remaining > 0){
+					return indeterminate;
+				}
+				chunk_state = CHUNK_END;
+			}
+			break;
+		case CHUNK_END:
+			if (received.size() < 2){
+				return indeterminate;
+			}
+			if (received.compare(0, 2, "\r\n") != 0){
+				return false;
+			}
+			received.erase(0, 2);
+			chunk_state = CHUNK_SIZE;
+			break;
+		case TRAILER:
+			// Trailer fields are ignored; an empty line ends them.
+			pos = received.find("\r\n");
+			if (pos == string::npos){
+				return received.size() > MAX_HEADER_LENGTH ? tribool(false) : tribool(indeterminate);
+			}
+			received.erase(0, pos + 2);
+			if (pos == 0){
+				return true;
+			}
+			break;
+		}
+	}
+}
+
+bool HTTPFetch::addBody(const char *data, size_t size){
+	body_length += size;
+	if (! isStreaming()){
+		body.append(data, size);
+		return true;
+	}
+	if (! decompressor){
+		if (size > 0){
+			on_data(data, size);
+		}
+		return true;
+	}
+	decompressed.clear();
+	if (! decompressor->decompress(data, size, decompressed)){
+		return false;
+	}
+	if (! decompressed.empty()){
+		on_data(decompressed.data(), decompressed.size());
+	}
+	return true;
+}
+
+void HTTPFetch::handleReply(){
+	// Anything after the reply means the connection is out of step.
+	if (keep_alive && received.empty()){
+		client.checkIn(host_port, socket);
+	}
+	else {
+		closeSocket();
+	}
+	socket.reset();
+
+	if (status >= 300 && status < 400 && status != 304 && ! location.empty()){
+		if (redirects_left <= 0){
+			fail("Not following redirect from " + url + " to " + location);
+			return;
+		}
+		-- redirects_left;
+		url = resolveURL(url, location);
+		startURL();
+		return;
+	}
+	if (status < 200 || status >= 300){
+		fail("Status " + lexical_cast<string>(status) + " from " + url);
+		return;
+	}
+	string content;
+	if (isStreaming()){
+		if (decompressor && ! decompressor->isFinished()){
+			fail("Truncated " + toString(content_encoding) + " content from " + url);
+			return;
+		}
+	}
+	else if (content_encoding == IDENTITY){
+		content.swap(body);
+	}
+	else if (! decompress(body, content, content_encoding)){
+		fail("Invalid " + toString(content_encoding) + " content from " + url);
+		return;
+	}
+	finish(true, content, "");
+}
+
+void HTTPFetch::retry(){
+	closeSocket();
+	reused = false;
+	received.clear();
+	resolve();
+}
+
+void HTTPFetch::setDeadline(int seconds){
+	timer.expires_from_now(posix_time::seconds(seconds));
+	timer.async_wait(strand_.wrap(bind(&HTTPFetch::handleDeadline, shared_from_this(), asio::placeholders::error)));
+}
+
+void HTTPFetch::handleDeadline(const system::error_code &e){
+	// The deadline may have been moved after this wait completed.
+	if (e == asio::error::operation_aborted || done || timer.expires_at() > asio::deadline_timer::traits_type::now()){
+		return;
+	}
+	timed_out = true;
+	resolver.cancel();
+	closeSocket();
+}
+
+void HTTPFetch::handleAbort(){
+	if (done){
+		return;
+	}
+	aborted = true;
+	resolver.cancel();
+	closeSocket();
+}
+
+void HTTPFetch::fail(const string &err_msg){
+	if (aborted){
+		finish(false, "", "Download aborted: " + url);
+	}
+	else if (timed_out){
+		finish(false, "", "Timed out downloading " + url);
+	}
+	else {
+		finish(false, "", err_msg);
+	}
+}
+
+void HTTPFetch::finish(bool succeeded, const string &content, const string &err_msg){
+	if (done){
+		return;
+	}
+	done = true;
+	system::error_code ignored;
+	timer.cancel(ignored);
+	closeSocket();
+	client.removeFetch(shared_from_this());
+	if (! succeeded){
+		ucair::getLogger().error(err_msg);
+	}
+	callback(succeeded, content, err_msg);
+}
+
+void HTTPFetch::closeSocket(){
+	if (socket){
+		system::error_code ignored;
+		socket->shutdown(tcp::socket::shutdown_both, ignored);
+		socket->close(ignored);
+	}
+}
+
+HTTPClientOptions::HTTPClientOptions():
+	connect_timeout(10),
+	read_timeout(30),
+	max_redirects(5),
+	max_idle_connections_per_host(4),
+	idle_timeout(30),
+	dns_cache_ttl(300),
+	max_content_length(16 * 1024 * 1024),
+	user_agent(DEFAULT_USER_AGENT) {
+}
+
+HTTPClient::HTTPClient(asio::io_service &io_service_, const HTTPClientOptions &options_):
+	io_service(io_service_),
+	options(options_),
+	stopped(false) {
+}
+
+HTTPClient::~HTTPClient(){
+}
+
+void HTTPClient::asyncGet(const string &url, const Callback &callback, bool follow_redirect){
+	asyncGet(url, DataCallback(), callback, follow_redirect);
+}
+
+void HTTPClient::asyncGet(const string &url, const DataCallback &on_data, const Callback &callback, bool follow_redirect){
+	shared_ptr<HTTPFetch> fetch(new HTTPFetch(*this, url, on_data, callback, follow_redirect ? options.max_redirects : 0));
+	bool accepted;
+	{
+		mutex::scoped_lock lock(fetches_mutex);
+		accepted = ! stopped;
+		if (accepted){
+			fetches.insert(fetch);
+		}
+	}
+	if (! accepted){
+		callback(false, "", "Download aborted: " + url);
+		return;
+	}
+	fetch->start();
+}
+
+/// Result of a download waited for by HTTPClient::get.
+class BlockingResult {
+public:
+	BlockingResult(): done(false), succeeded(false) {}
+
+	bool done;
+	bool succeeded;
+	string content;
+	string err_msg;
+	mutex result_mutex;
+	condition_variable result_condition;
+};
+
+static void storeResult(shared_ptr<BlockingResult> result, bool succeeded, const string &content, const string &err_msg){
+	mutex::scoped_lock lock(result->result_mutex);
+	result->succeeded = succeeded;
+	result->content = content;
+	result->err_msg = err_msg;
+	result->done = true;
+	result->result_condition.notify_one();
+}
+
+bool HTTPClient::get(const string &url, string &content, string &err_msg, bool follow_redirect){
+	shared_ptr<BlockingResult> result(new BlockingResult);
+	asyncGet(url, bind(&storeResult, result, _1, _2, _3), follow_redirect);
+	mutex::scoped_lock lock(result->result_mutex);
+	while (! result->done){
+		result->result_condition.wait(lock);
+	}
+	content.swap(result->content);
+	err_msg = result->err_msg;
+	return result->succeeded;
+}
+
+bool HTTPClient::get(const string &url, const DataCallback &on_data, string &err_msg, bool follow_redirect){
+	shared_ptr<BlockingResult> result(new BlockingResult);
+	asyncGet(url, on_data, bind(&storeResult, result, _1, _2, _3), follow_redirect);
+	mutex::scoped_lock lock(result->result_mutex);
+	while (! result->done){
+		result->result_condition.wait(lock);
+	}
+	err_msg = result->err_msg;
+	return result->succeeded;
+}
+
+void HTTPClient::stop(){
+	set<shared_ptr<HTTPFetch> > active_fetches;
+	{
+		mutex::scoped_lock lock(fetches_mutex);
+		stopped = true;
+		active_fetches = fetches;
+	}
+	BOOST_FOREACH(const shared_ptr<HTTPFetch> &fetch, active_fetches){
+		fetch->abort();
+	}
+
+	mutex::scoped_lock lock(idle_connections_mutex);
+	for (map<string, list<IdleConnection> >::iterator itr = idle_connections.begin(); itr != idle_connections.end(); ++ itr){
+		BOOST_FOREACH(IdleConnection &connection, itr->second){
+			system::error_code ignored;
+			connection.socket->close(ignored);
+		}
+	}
+	idle_connections.clear();
+}
+
+HTTPClient::SocketPtr HTTPClient::checkOut(const string &host_port){
+	mutex::scoped_lock lock(idle_connections_mutex);
+	map<string, list<IdleConnection> >::iterator itr = idle_connections.find(host_port);
+	if (itr == idle_connections.end()){
+		return SocketPtr();
+	}
+	list<IdleConnection> &connections = itr->second;
+	posix_time::ptime oldest_usable = posix_time::microsec_clock::universal_time() - posix_time::seconds(options.idle_timeout);
+	while (! connections.empty() && connections.front().since < oldest_usable){
+		system::error_code ignored;
+		connections.front().socket->close(ignored);
+		connections.pop_front();
+	}
+	SocketPtr socket;
+	if (! connections.empty()){
+		socket = connections.back().socket;
+		connections.pop_back();
+	}
+	if (connections.empty()){
+		idle_connections.erase(itr);
+	}
+	return socket;
+}
+
+void HTTPClient::checkIn(const string &host_port, SocketPtr socket){
+	if (options.max_idle_connections_per_host == 0){
+		system::error_code ignored;
+		socket->close(ignored);
+		return;
+	}
+	IdleConnection connection;
+	connection.socket = socket;
+	connection.since = posix_time::microsec_clock::universal_time();
+	mutex::scoped_lock lock(idle_connections_mutex);
+	list<IdleConnection> &connections = idle_connections[host_port];
+	connections.push_back(connection);
+	if (connections.size() > options.max_idle_connections_per_host){
+		system::error_code ignored;
+		connections.front().socket->close(ignored);
+		connections.pop_front();
+	}
+}
+
+bool HTTPClient::lookUpHost(const string &host_port, vector<tcp::endpoint> &endpoints){
+	mutex::scoped_lock lock(dns_cache_mutex);
+	map<string, HostEntry>::iterator itr = dns_cache.find(host_port);
+	if (itr == dns_cache.end()){
+		return false;
+	}
+	if (itr->second.expires < posix_time::microsec_clock::universal_time()){
+		dns_cache.erase(itr);
+		return false;
+	}
+	endpoints = itr->second.endpoints;
+	return true;
+}
+
+void HTTPClient::cacheHost(const string &host_port, const vector<tcp::endpoint> &endpoints){
+	mutex::scoped_lock lock(dns_cache_mutex);
+	if (endpoints.empty() || options.dns_cache_ttl <= 0){
+		dns_cache.erase(host_port);
+		return;
+	}
+	HostEntry &entry = dns_cache[host_port];
+	entry.endpoints = endpoints;
+	entry.expires = posix_time::microsec_clock::universal_time() + posix_time::seconds(options.dns_cache_ttl);
+}
+
+void HTTPClient::removeFetch(const shared_ptr<HTTPFetch> &fetch){
+	mutex::scoped_lock lock(fetches_mutex);
+	fetches.erase(fetch);
+}
+
+} // namespace util
+} // namespace http
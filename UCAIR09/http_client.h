@@ -0,0 +1,141 @@
+#ifndef __http_client_h__
+#define __http_client_h__
+
+#include <list>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include <boost/asio.hpp>
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/utility.hpp>
+
+namespace http {
+namespace util {
+
+/// Tunable parameters of an HTTP client.
+class HTTPClientOptions {
+public:
+	HTTPClientOptions();
+
+	int connect_timeout; ///< seconds allowed for resolving the host name and connecting
+	int read_timeout; ///< seconds allowed for sending the request, and for each read of the response
+	int max_redirects; ///< max number of redirects followed for one download
+	size_t max_idle_connections_per_host; ///< max number of idle connections kept open to one host (0 disables keep-alive)
+	int idle_timeout; ///< seconds an idle connection is kept open
+	int dns_cache_ttl; ///< seconds the addresses of a host name are remembered
+	size_t max_content_length; ///< longer documents fail to download
+	std::string user_agent; ///< value of User-Agent header
+};
+
+class HTTPFetch;
+
+/*! \brief Asynchronous HTTP/1.1 client.
+ *
+ *  Runs on a given io_service (the one of the HTTP server, so that no extra threads are needed).
+ *  Connections are kept alive and reused per host; resolved host names are cached.
+ *  Each phase of a download has a deadline. Replies compressed with gzip or deflate are decompressed,
+ *  and redirects are followed.
+ *  Thread-safe: downloads can be started from any thread.
+ */
+class HTTPClient: private boost::noncopyable {
+public:
+	/*! \brief Callback of a download.
+	 *  \param succeeded true if the document was downloaded
+	 *  \param content document content
+	 *  \param err_msg error message, empty if succeeded
+	 */
+	typedef boost::function<void (bool succeeded, const std::string &content, const std::string &err_msg)> Callback;
+
+	/*! \brief Receives a piece of document content as it arrives (decompressed).
+	 *  \param data content
+	 *  \param size size of content
+	 */
+	typedef boost::function<void (const char *data, size_t size)> DataCallback;
+
+	HTTPClient(boost::asio::io_service &io_service, const HTTPClientOptions &options = HTTPClientOptions());
+	~HTTPClient();
+
+	/*! \brief Starts downloading a document.
+	 *
+	 *  file:// URLs are read from disk.
+	 *  The callback runs in one of the io_service threads, or right away if the client is stopped.
+	 *  \param url URL
+	 *  \param callback invoked once when the download succeeds or fails
+	 *  \param follow_redirect whether to follow redirects
+	 */
+	void asyncGet(const std::string &url, const Callback &callback, bool follow_redirect = true);
+
+	/*! \brief Starts downloading a document, handing over content as it arrives.
+	 *
+	 *  As asyncGet, except that content is passed to on_data piece by piece (in one of the io_service threads)
+	 *  instead of to the callback, whose content is empty. Content of redirects and error replies is not passed on.
+	 *  If the download fails partway, on_data may have received part of the content.
+	 */
+	void asyncGet(const std::string &url, const DataCallback &on_data, const Callback &callback, bool follow_redirect = true);
+
+	/*! \brief Downloads a document, waiting for it.
+	 *
+	 *  Must not be called from a thread running the io_service, which may be needed to complete the download.
+	 */
+	bool get(const std::string &url, std::string &content, std::string &err_msg, bool follow_redirect = true);
+
+	/// Downloads a document, handing over content as it arrives (see asyncGet), and waits for it.
+	bool get(const std::string &url, const DataCallback &on_data, std::string &err_msg, bool follow_redirect = true);
+
+	/// Aborts all downloads and closes idle connections. Later downloads fail right away.
+	void stop();
+
+private:
+	typedef boost::shared_ptr<boost::asio::ip::tcp::socket> SocketPtr;
+
+	/// Takes an idle connection to host:port out of the pool; null if there is none.
+	SocketPtr checkOut(const std::string &host_port);
+	/// Puts a connection to host:port back to the pool for reuse.
+	void checkIn(const std::string &host_port, SocketPtr socket);
+
+	/// Looks up cached addresses of host:port; returns false if not cached.
+	bool lookUpHost(const std::string &host_port, std::vector<boost::asio::ip::tcp::endpoint> &endpoints);
+	/// Caches resolved addresses of host:port; an empty list removes the entry.
+	void cacheHost(const std::string &host_port, const std::vector<boost::asio::ip::tcp::endpoint> &endpoints);
+
+	/// Called by a download when it completes.
+	void removeFetch(const boost::shared_ptr<HTTPFetch> &fetch);
+
+	boost::asio::io_service &io_service;
+	const HTTPClientOptions options;
+
+	/// A connection in the pool.
+	class IdleConnection {
+	public:
+		SocketPtr socket;
+		boost::posix_time::ptime since; ///< when it became idle
+	};
+	/// Idle connections by host:port, least recently used first.
+	std::map<std::string, std::list<IdleConnection> > idle_connections;
+	boost::mutex idle_connections_mutex;
+
+	/// Resolved addresses of a host.
+	class HostEntry {
+	public:
+		std::vector<boost::asio::ip::tcp::endpoint> endpoints;
+		boost::posix_time::ptime expires;
+	};
+	/// Resolved addresses by host:port.
+	std::map<std::string, HostEntry> dns_cache;
+	boost::mutex dns_cache_mutex;
+
+	/// Downloads in progress, so that they can be aborted by stop.
+	std::set<boost::shared_ptr<HTTPFetch> > fetches;
+	bool stopped;
+	boost::mutex fetches_mutex;
+
+friend class HTTPFetch;
+};
+
+} // namespace util
+} // namespace http
+
+#endif
@@ -2,20 +2,37 @@
 #define __http_download_h__
 
 #include <string>
+#include <boost/function.hpp>
 
 namespace http {
 namespace util {
 
-/*! \brief Downloads a document from a given URL.
+class HTTPClient;
+
+/*! \brief Downloads a document from a given URL, waiting for it.
  *
- *  Only implements an HTTP/1.0 client.
+ *  Goes through the client set by setDownloadClient, so that connections are reused.
+ *  If there is none, the download runs on its own io_service in the calling thread.
+ *  Must not be called from a thread running the io_service of the client.
  *  \param[in] url URL
  *  \param[out] content document content
  *  \param[out] error_msg error message, empty if no error
- *  \param[in] follow_redirect whether to follow redirect (just once)
+ *  \param[in] follow_redirect whether to follow redirects
  *  \return true if succeeded
  */
-bool downloadPage(const std::string &url, std::string &content, std::string &err_msg, bool allow_redirect = true);
+bool downloadPage(const std::string &url, std::string &content, std::string &err_msg, bool follow_redirect = true);
+
+/*! \brief Downloads a document from a given URL, handing over content as it arrives, and waits for it.
+ *
+ *  As above, except that the content (decompressed) is passed to on_data piece by piece,
+ *  in the thread running the download; a failed download may have passed part of it.
+ */
+bool downloadPage(const std::string &url, const boost::function<void (const char *data, size_t size)> &on_data, std::string &err_msg, bool follow_redirect = true);
+
+/*! \brief Sets the client used by downloadPage.
+ *  \param client a client whose io_service is running, or NULL
+ */
+void setDownloadClient(HTTPClient *client);
 
 } // namespace util
 } // namespace http
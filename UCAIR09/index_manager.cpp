@@ -1,33 +1,48 @@
 #include "index_manager.h"
 #include <iostream>
+#include <boost/filesystem.hpp>
 #include "config.h"
 #include "logger.h"
 #include "ucair_util.h"
 
 using namespace std;
 using namespace boost;
+namespace fs = boost::filesystem;
 
 namespace ucair {
 
 bool IndexManager::initialize(){
 	string col_stats_file_name = util::getParam<string>(Main::instance().getConfig(), "col_stats_file");
-	if (! indexing::loadColProbs(col_stats_file_name, term_dict, *(indexing::ValueMap::from(col_probs)), default_col_prob)) {
+	string compiled_file_name = util::getParam<string>(Main::instance().getConfig(), "compiled_col_stats_file");
+	if (! compiled_file_name.empty() && fs::exists(compiled_file_name)) {
+		// Compiled stats are checked against the text file they were compiled from, if it is there, rather than by modification time,
+		// which a checkout or copy does not keep.
+		string source_file_name = fs::exists(col_stats_file_name) ? col_stats_file_name : string();
+		if (indexing::loadCompiledColProbs(compiled_file_name, source_file_name, term_dict, col_probs)) {
+			return true;
+		}
+		getLogger().info("Not using compiled collection stats from " + compiled_file_name + "; loading the text file");
+	}
+	if (! indexing::loadColProbs(col_stats_file_name, term_dict, col_probs)) {
 		getLogger().error("Failed to load collection stats");
 		return false;
 	}
 	return true;
 }
 
-shared_ptr<indexing::SimpleIndex> IndexManager::newIndex(){
-	return shared_ptr<indexing::SimpleIndex>(new indexing::SimpleIndex(term_dict));
+bool IndexManager::compileColStats(){
+	string col_stats_file_name = util::getParam<string>(Main::instance().getConfig(), "col_stats_file");
+	string compiled_file_name = util::getParam<string>(Main::instance().getConfig(), "compiled_col_stats_file");
+	if (! indexing::compileColProbs(col_stats_file_name, compiled_file_name)) {
+		getLogger().error("Failed to compile collection stats to " + compiled_file_name);
+		return false;
+	}
+	getLogger().info("Compiled collection stats to " + compiled_file_name);
+	return true;
 }
 
-double IndexManager::getColProb(int term_id) const {
-	unordered_map<int, double>::const_iterator itr = col_probs.find(term_id);
-	if (itr != col_probs.end()){
-		return itr->second;
-	}
-	return default_col_prob;
+shared_ptr<indexing::SimpleIndex> IndexManager::newIndex(){
+	return shared_ptr<indexing::SimpleIndex>(new indexing::SimpleIndex(term_dict));
 }
 
 } // namespace ucair
@@ -3,7 +3,6 @@
 
 #include <string>
 #include <boost/smart_ptr.hpp>
-#include <boost/unordered_map.hpp>
 #include "component.h"
 #include "index_util.h"
 #include "main.h"
@@ -15,8 +14,12 @@ namespace ucair {
 class IndexManager: public Component {
 public:
 
+	/// Loads collection stats, from the compiled file if it is up to date, or else from the text file.
 	bool initialize();
 
+	/// Compiles the collection stats text file into the compiled file, for faster startup.
+	bool compileColStats();
+
 	/// Creates an empty index.
 	boost::shared_ptr<indexing::SimpleIndex> newIndex();
 
@@ -24,20 +27,19 @@ public:
 	indexing::NameDict& getTermDict() { return term_dict; }
 
 	/// Returns collection probability if a term is found, or a default value otherwise.
-	double getColProb(int term_id) const;
+	double getColProb(int term_id) const { return col_probs.get(term_id); }
 
-	/// Returns a dictionary which stores term probabilities in a background collection.
-	const boost::unordered_map<int, double>& getColProbs() const { return col_probs; }
+	/// Returns term probabilities in a background collection; loaded once, and not changed after.
+	const indexing::ColProbs& getColProbs() const { return col_probs; }
 
 	/// Returns the default probability for a term not found in a background collection.
-	double getDefaultColProb() const { return default_col_prob; }
+	double getDefaultColProb() const { return col_probs.getDefault(); }
 
 private:
 
 	indexing::NameDict term_dict;
 
-	boost::unordered_map<int, double> col_probs;
-	double default_col_prob;
+	indexing::ColProbs col_probs;
 };
 
 DECLARE_GET_COMPONENT(IndexManager);
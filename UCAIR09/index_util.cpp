@@ -1,11 +1,14 @@
 #include "index_util.h"
+#include <algorithm>
 #include <cassert>
+#include <cstring>
 #include <fstream>
 #include <iostream>
 #include <boost/algorithm/string.hpp>
 #include <boost/foreach.hpp>
 #include <boost/lexical_cast.hpp>
 #include <boost/tuple/tuple.hpp>
+#include <zlib.h>
 #include "common_util.h"
 #include "logger.h"
 #include "porter.h"
@@ -15,39 +18,173 @@ using namespace boost;
 
 namespace indexing {
 
-int NameDict::getId(const string &name, bool insert_if_not_found){
-	NameIndex& name_index = name_map.get<1>();
-	NameIndex::iterator itr = name_index.find(name);
-	if (itr == name_index.end()){
-		if (insert_if_not_found){
-			itr = name_index.insert(itr, name);
+namespace {
+
+/// Capacity of the hash table when the first name is added.
+const size_t MIN_SLOT_COUNT = 1024;
+
+/// Starts a file written by compileColProbs; the last char is the version of the format.
+const char COMPILED_COL_PROBS_MAGIC[8] = {'U', 'C', 'A', 'I', 'R', 'C', 'P', '2'};
+
+/*! \brief Computes the size and CRC-32 of a file, which tell whether a compiled file was compiled from it.
+ *  Unlike modification times, they survive copies and checkouts.
+ */
+bool fingerprintFile(const string &file_name, long long &size, long long &checksum){
+	ifstream fin(file_name.c_str(), ios::binary);
+	if (! fin){
+		ucair::getLogger().error("Failed to open " + file_name);
+		return false;
+	}
+	uLong crc = crc32(0, Z_NULL, 0);
+	size = 0;
+	char buffer[64 * 1024];
+	while (fin.read(buffer, sizeof(buffer)) || fin.gcount() > 0){
+		crc = crc32(crc, reinterpret_cast<const Bytef*>(buffer), static_cast<uInt>(fin.gcount()));
+		size += fin.gcount();
+	}
+	checksum = crc;
+	return fin.eof();
+}
+
+template <class T>
+void writeValue(ostream &out, const T &value){
+	out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <class T>
+bool readValue(istream &in, T &value){
+	return in.read(reinterpret_cast<char*>(&value), sizeof(T)).good();
+}
+
+template <class T>
+void writeArray(ostream &out, const vector<T> &v){
+	if (! v.empty()){
+		out.write(reinterpret_cast<const char*>(&v[0]), v.size() * sizeof(T));
+	}
+}
+
+template <class T>
+bool readArray(istream &in, vector<T> &v, size_t size){
+	v.resize(size);
+	return v.empty() || in.read(reinterpret_cast<char*>(&v[0]), size * sizeof(T)).good();
+}
+
+} // anonymous namespace
+
+unsigned int NameDict::hash(const char *name, size_t length){
+	unsigned int h = 2166136261u;
+	for (size_t i = 0; i < length; ++ i){
+		h ^= (unsigned char) name[i];
+		h *= 16777619u;
+	}
+	return h;
+}
+
+int NameDict::getId(const char *name, size_t length, bool insert_if_not_found){
+	unsigned int name_hash = hash(name, length);
+	const char *arena_begin = arena.empty() ? NULL : &arena[0];
+	if (! slots.empty()){
+		size_t mask = slots.size() - 1;
+		for (size_t i = name_hash & mask; slots[i] != 0; i = (i + 1) & mask){
+			const Entry &entry = entries[slots[i] - 1];
+			if (entry.hash == name_hash && entry.length == length && memcmp(arena_begin + entry.offset, name, length) == 0){
+				return slots[i];
+			}
 		}
-		else{
-			return -1;
+	}
+	if (! insert_if_not_found){
+		return -1;
+	}
+	if (arena_begin != NULL && name >= arena_begin && name < arena_begin + arena.size()){
+		// Part of a stored name: copy it, as the arena may move when it grows.
+		return getId(string(name, length), true);
+	}
+
+	// Keep the table at most half full, so that probe sequences stay short.
+	if ((entries.size() + 1) * 2 > slots.size()){
+		rehash(max(slots.size() * 2, MIN_SLOT_COUNT));
+	}
+	Entry entry;
+	entry.offset = (unsigned int) arena.size();
+	entry.length = (unsigned int) length;
+	entry.hash = name_hash;
+	arena.insert(arena.end(), name, name + length);
+	entries.push_back(entry);
+	int id = (int) entries.size();
+	size_t mask = slots.size() - 1;
+	size_t i = name_hash & mask;
+	while (slots[i] != 0){
+		i = (i + 1) & mask;
+	}
+	slots[i] = id;
+	return id;
+}
+
+void NameDict::rehash(size_t capacity){
+	slots.assign(capacity, 0);
+	size_t mask = capacity - 1;
+	for (size_t id = 1; id <= entries.size(); ++ id){
+		size_t i = entries[id - 1].hash & mask;
+		while (slots[i] != 0){
+			i = (i + 1) & mask;
 		}
+		slots[i] = (int) id;
 	}
-	// Project the string hashmap's iterator to the random access array's iterator.
-	NameMap::iterator itr0 = name_map.project<0>(itr);
-	// The array element's index is the iterator's difference with the start.
-	// Id is index plus one (so that it begins at 1 rather than 0).
-	return itr0 - name_map.begin() + 1;
 }
 
-string NameDict::getName(int id){
+NameRef NameDict::getName(int id) const{
 	assert(id > 0 && id <= size());
-	return name_map[id - 1];
+	const Entry &entry = entries[id - 1];
+	return NameRef(arena.empty() ? "" : &arena[0] + entry.offset, entry.length);
+}
+
+void NameDict::clear(){
+	// Swapped out rather than cleared, to give the memory back.
+	vector<char>().swap(arena);
+	vector<Entry>().swap(entries);
+	vector<int>().swap(slots);
+}
+
+bool NameDict::write(ostream &out) const{
+	writeValue(out, (unsigned int) entries.size());
+	writeValue(out, (unsigned int) arena.size());
+	writeValue(out, (unsigned int) slots.size());
+	writeArray(out, arena);
+	writeArray(out, entries);
+	writeArray(out, slots);
+	return out.good();
+}
+
+bool NameDict::read(istream &in){
+	clear();
+	unsigned int entry_count, arena_size, slot_count;
+	if (! readValue(in, entry_count) || ! readValue(in, arena_size) || ! readValue(in, slot_count)){
+		return false;
+	}
+	// The table must be a power of two in size, and at most half full.
+	bool ok = (slot_count & (slot_count - 1)) == 0 && (size_t) entry_count * 2 <= slot_count
+		&& readArray(in, arena, arena_size) && readArray(in, entries, entry_count) && readArray(in, slots, slot_count);
+	for (size_t i = 0; ok && i < entries.size(); ++ i){
+		ok = entries[i].offset <= arena_size && entries[i].length <= arena_size - entries[i].offset;
+	}
+	for (size_t i = 0; ok && i < slots.size(); ++ i){
+		ok = slots[i] >= 0 && slots[i] <= (int) entry_count;
+	}
+	if (! ok){
+		clear();
+	}
+	return ok;
 }
 
 void countTerms(NameDict &term_dict, const string &text, map<int, double> &term_counts, bool stem_term, bool update_term_dict){
+	vector<string> terms;
+	extractTerms(text, terms, stem_term);
+	countTerms(term_dict, terms, term_counts, update_term_dict);
+}
+
+void countTerms(NameDict &term_dict, const vector<string> &terms, map<int, double> &term_counts, bool update_term_dict){
 	term_counts.clear();
-	vector<string> terms = util::tokenizeWithPunctuation(text);
-	BOOST_FOREACH(string &term, terms){
-		if (! util::isASCIIPrintable(term)) {
-			continue;
-		}
-		if (stem_term) {
-			term = stem(term);
-		}
+	BOOST_FOREACH(const string &term, terms){
 		int term_id = term_dict.getId(term, update_term_dict);
 		if (term_id > 0) {
 			map<int, double>::iterator itr;
@@ -57,8 +194,27 @@ void countTerms(NameDict &term_dict, const string &text, map<int, double> &term_
 	}
 }
 
-bool loadColProbs(const std::string &file_name, NameDict &term_dict, ValueMap &col_probs, double &default_col_prob){
-	col_probs.clear();
+void extractTerms(const string &text, vector<string> &terms, bool stem_term){
+	terms.clear();
+	vector<string> tokens = util::tokenizeWithPunctuation(text);
+	BOOST_FOREACH(const string &token, tokens){
+		if (! util::isASCIIPrintable(token)) {
+			continue;
+		}
+		terms.push_back(stem_term ? stem(token) : token);
+	}
+}
+
+void ColProbs::set(int term_id, double prob){
+	assert(term_id > 0);
+	if (term_id >= (int) probs.size()){
+		probs.resize(term_id + 1, default_prob);
+	}
+	probs[term_id] = prob;
+}
+
+bool loadColProbs(const string &file_name, NameDict &term_dict, ColProbs &col_probs){
+	col_probs.clear(0.0);
 	ifstream fin(file_name.c_str());
 	if (! fin){
 		ucair::getLogger().error("Failed to open " + file_name);
@@ -76,18 +232,17 @@ bool loadColProbs(const std::string &file_name, NameDict &term_dict, ValueMap &c
 		trim_right(line);
 		int unique_term_count = lexical_cast<int>(line.substr(0, pos));
 		long long total_term_count = lexical_cast<long long>(line.substr(pos + 1));
-		default_col_prob = 1.0 / (total_term_count + unique_term_count);
+		col_probs.clear(1.0 / (total_term_count + unique_term_count));
 		while (getline(fin, line)){
 			size_t pos = line.find('\t');
 			if (pos == string::npos){
 				return false;
 			}
 			trim_right(line);
-			string term = line.substr(0, pos);
 			long long term_count = lexical_cast<long long>(line.substr(pos + 1));
-			int term_id = term_dict.getId(term, true);
+			int term_id = term_dict.getId(line.data(), pos, true);
 			double col_prob = (term_count + 1.0) / (total_term_count + unique_term_count);
-			col_probs.set(term_id, col_prob, false);
+			col_probs.set(term_id, col_prob);
 		}
 	}
 	catch (bad_lexical_cast &){
@@ -96,4 +251,70 @@ bool loadColProbs(const std::string &file_name, NameDict &term_dict, ValueMap &c
 	return true;
 }
 
+bool compileColProbs(const string &file_name, const string &compiled_file_name){
+	NameDict term_dict;
+	ColProbs col_probs;
+	if (! loadColProbs(file_name, term_dict, col_probs)){
+		return false;
+	}
+	vector<double> probs(term_dict.size());
+	for (int term_id = 1; term_id <= term_dict.size(); ++ term_id){
+		probs[term_id - 1] = col_probs.get(term_id);
+	}
+	long long size, checksum;
+	if (! fingerprintFile(file_name, size, checksum)){
+		return false;
+	}
+
+	ofstream fout(compiled_file_name.c_str(), ios::binary);
+	if (! fout){
+		ucair::getLogger().error("Failed to open " + compiled_file_name);
+		return false;
+	}
+	fout.write(COMPILED_COL_PROBS_MAGIC, sizeof(COMPILED_COL_PROBS_MAGIC));
+	writeValue(fout, size);
+	writeValue(fout, checksum);
+	writeValue(fout, col_probs.getDefault());
+	term_dict.write(fout);
+	writeArray(fout, probs);
+	return fout.good();
+}
+
+bool loadCompiledColProbs(const string &compiled_file_name, const string &file_name, NameDict &term_dict, ColProbs &col_probs){
+	assert(term_dict.size() == 0);
+	col_probs.clear(0.0);
+	ifstream fin(compiled_file_name.c_str(), ios::binary);
+	if (! fin){
+		ucair::getLogger().error("Failed to open " + compiled_file_name);
+		return false;
+	}
+	char magic[sizeof(COMPILED_COL_PROBS_MAGIC)];
+	if (! fin.read(magic, sizeof(magic)) || ! equal(magic, magic + sizeof(magic), COMPILED_COL_PROBS_MAGIC)){
+		ucair::getLogger().info(compiled_file_name + " is not in the current format");
+		return false;
+	}
+	long long compiled_size, compiled_checksum;
+	if (! readValue(fin, compiled_size) || ! readValue(fin, compiled_checksum)){
+		return false;
+	}
+	if (! file_name.empty()){
+		long long size, checksum;
+		if (! fingerprintFile(file_name, size, checksum) || size != compiled_size || checksum != compiled_checksum){
+			ucair::getLogger().info(compiled_file_name + " was not compiled from the current " + file_name);
+			return false;
+		}
+	}
+	double default_col_prob;
+	vector<double> probs;
+	if (! readValue(fin, default_col_prob) || ! term_dict.read(fin) || ! readArray(fin, probs, term_dict.size())){
+		term_dict.clear();
+		return false;
+	}
+	// Term ids start at 1.
+	probs.insert(probs.begin(), default_col_prob);
+	col_probs.clear(default_col_prob);
+	col_probs.swap(probs);
+	return true;
+}
+
 } // namespace indexing
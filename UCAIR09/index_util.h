@@ -1,60 +1,126 @@
 #ifndef __index_util_h__
 #define __index_util_h__
 
+#include <iosfwd>
 #include <map>
 #include <string>
 #include <vector>
-#include <boost/multi_index_container.hpp>
-#include <boost/multi_index/hashed_index.hpp>
-#include <boost/multi_index/identity.hpp>
-#include <boost/multi_index/random_access_index.hpp>
 #include "value_map.h"
 
 namespace indexing {
 
+/*! \brief A name stored in a NameDict, referring to the dict's storage rather than copying it.
+ *
+ *  Valid until a name is added to the dict, or the dict is cleared; convert it to a std::string to keep it longer.
+ */
+class NameRef{
+public:
+	NameRef(const char *data, size_t length): name_data(data), name_length(length) {}
+
+	const char* data() const { return name_data; }
+	size_t size() const { return name_length; }
+
+	std::string str() const { return std::string(name_data, name_length); }
+	operator std::string() const { return str(); }
+
+private:
+	const char *name_data;
+	size_t name_length;
+};
+
 /*! \brief A dictionary between integer ids and string names
  *
  *  Ids are assigned automatically, from the range [1 .. number_of_names]
+ *
+ *  Names are interned: the bytes of all names are kept end to end in one arena, and each id is an entry of
+ *  (offset, length, hash) into it. Lookup is by an open addressing hash table of ids with linear probing,
+ *  which compares stored hashes before bytes, so names need not be std::strings to be looked up.
  */
 class NameDict{
 public:
-
 	/*! \brief Find a string's corresponding id.
 	 *  \param name string to look up
 	 *  \param insert_if_not_found create a mapping if the string is not in dict
 	 *  \return corresponding id, -1 if not found and insert_if_not_found is false
 	 */
-	int getId(const std::string &name, bool insert_if_not_found = false);
+	int getId(const std::string &name, bool insert_if_not_found = false) { return getId(name.data(), name.size(), insert_if_not_found); }
+
+	/// Same as above, for a name given as a range of chars.
+	/// (No default for insert_if_not_found, so that getId("name", true) does not take true for a length.)
+	int getId(const char *name, size_t length, bool insert_if_not_found);
 
 	/// Whether an id exists.
 	bool hasId(int id) const { return id > 0 && id <= size(); }
 
 	/*! \brief Find an id's corresponding string. Id must be in valid range.
 	 *  \param id id to look up
-	 *  \return corresponding string
+	 *  \return corresponding string, in the dict's storage
 	 */
-	std::string getName(int id);
+	NameRef getName(int id) const;
 
 	/// Returns the number of names.
-	int size() const { return (int) name_map.size(); }
+	int size() const { return (int) entries.size(); }
 
 	/// Clear all mappings.
-	void clear() { name_map.clear(); }
+	void clear();
+
+	/*! \brief Writes the dict in a binary form, which read() loads without parsing or hashing.
+	 *
+	 *  The form depends on the byte order of the machine writing it.
+	 */
+	bool write(std::ostream &out) const;
+
+	/// Replaces the dict with one written by write(); returns false, leaving the dict empty, if the data is bad.
+	bool read(std::istream &in);
 
 private:
+	/// Where a name is in the arena.
+	struct Entry{
+		unsigned int offset;
+		unsigned int length;
+		unsigned int hash;
+	};
+
+	/// FNV-1a hash of a name.
+	static unsigned int hash(const char *name, size_t length);
+
+	/// Sets the hash table to a capacity (a power of two), and puts all ids in it again.
+	void rehash(size_t capacity);
+
+	std::vector<char> arena; ///< bytes of all names, end to end
+	std::vector<Entry> entries; ///< entry of id i at [i - 1]
+	std::vector<int> slots; ///< open addressing hash table of ids; 0 for empty
+};
+
+/*! \brief Term probabilities in a background collection, as a dense array by term id.
+ *
+ *  Terms not in the collection, including those added to the term dict later, get a default probability.
+ */
+class ColProbs{
+public:
+	ColProbs(): default_prob(0.0) {}
 
-	/// A container allowing array-like random access and string hashmap lookup.
-	typedef boost::multi_index::multi_index_container<
-		std::string,
-		boost::multi_index::indexed_by<
-			boost::multi_index::random_access<>, // random access array
-			boost::multi_index::hashed_non_unique<boost::multi_index::identity<std::string> > // string hash map
-		>
-	> NameMap;
+	/// Returns the probability of a term, or the default probability if the term is not in the collection.
+	double get(int term_id) const { return term_id > 0 && term_id < (int) probs.size() ? probs[term_id] : default_prob; }
 
-	typedef NameMap::nth_index<1>::type NameIndex;
+	/// Returns the probability for a term not in the collection.
+	double getDefault() const { return default_prob; }
 
-	NameMap name_map;
+	/// Returns the largest term id in the collection.
+	int maxTermId() const { return probs.empty() ? 0 : (int) probs.size() - 1; }
+
+	/// Clears all probabilities, and sets the default probability.
+	void clear(double default_prob_) { std::vector<double>().swap(probs); default_prob = default_prob_; }
+
+	/// Sets the probability of a term.
+	void set(int term_id, double prob);
+
+	/// Exchanges the probabilities, by term id (0 is unused), with those in a vector.
+	void swap(std::vector<double> &probs_) { probs.swap(probs_); }
+
+private:
+	std::vector<double> probs; ///< by term id; default_prob where a term is not in the collection
+	double default_prob;
 };
 
 /*! \brief Counts the frequency of different terms in a piece of text.
@@ -67,6 +133,23 @@ private:
  */
 void countTerms(NameDict &term_dict, const std::string &text, std::map<int, double> &term_counts, bool stem_term = true, bool update_term_dict = true);
 
+/*! \brief Counts the frequency of different terms, already extracted by extractTerms.
+ *  \param[in] term_dict dictionary to transform string to id
+ *  \param[in] terms terms
+ *  \param[out] term_counts mapping from term id to term frequency
+ *  \param[in] update_term_dict whether to append to term dict if new terms are found. if false, new terms are ignored.
+ */
+void countTerms(NameDict &term_dict, const std::vector<std::string> &terms, std::map<int, double> &term_counts, bool update_term_dict = true);
+
+/*! \brief Splits a piece of text into terms, the way countTerms does, without touching a term dict.
+ *
+ *  Needs no index, so it can be done ahead of indexing, in any thread.
+ *  \param[in] text input text
+ *  \param[out] terms terms, in order
+ *  \param[in] stem_term whether to stem terms
+ */
+void extractTerms(const std::string &text, std::vector<std::string> &terms, bool stem_term = true);
+
 /*! \brief Loads term counts from a file and computes term probabilities.
  *
  *  The file should contain term counts in a background collection.
@@ -77,10 +160,29 @@ void countTerms(NameDict &term_dict, const std::string &text, std::map<int, doub
  *
  *  \param[in] file_name filename
  *  \param[in,out] term_dict dictionary to transform string to id
- *  \param[out] term_probs term probabilities
- *  \param[out] default_col_prob default probability for terms not occurring in collection
+ *  \param[out] col_probs term probabilities, and the default probability for terms not occurring in collection
+ */
+bool loadColProbs(const std::string &file_name, NameDict &term_dict, ColProbs &col_probs);
+
+/*! \brief Compiles a file of term counts (see loadColProbs) into a binary file, which loadCompiledColProbs reads without parsing.
+ *
+ *  The binary file holds the size and CRC-32 of the file of term counts, the term dict (see NameDict::write)
+ *  and the term probabilities, as an array by term id.
+ *  \param[in] file_name file of term counts
+ *  \param[in] compiled_file_name binary file to write
+ */
+bool compileColProbs(const std::string &file_name, const std::string &compiled_file_name);
+
+/*! \brief Loads term probabilities from a file written by compileColProbs.
+ *
+ *  Term ids are those of the compiled term dict, so term_dict must be empty.
+ *  \param[in] compiled_file_name binary file
+ *  \param[in] file_name file of term counts the binary file must have been compiled from, checked by size and CRC-32;
+ *  empty not to check
+ *  \param[in,out] term_dict dictionary to transform string to id
+ *  \param[out] col_probs term probabilities, and the default probability for terms not occurring in collection
  */
-bool loadColProbs(const std::string &file_name, NameDict &term_dict, ValueMap &term_probs, double &default_col_prob);
+bool loadCompiledColProbs(const std::string &compiled_file_name, const std::string &file_name, NameDict &term_dict, ColProbs &col_probs);
 
 } // namespace indexing
 
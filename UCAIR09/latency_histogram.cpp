@@ -0,0 +1,108 @@
+#include "latency_histogram.h"
+#include <cmath>
+
+using namespace std;
+using namespace boost;
+
+namespace util {
+
+namespace {
+
+/// log2 of LatencyHistogram::SUB_BUCKET_COUNT.
+const int SUB_BUCKET_BITS = 4;
+
+/// Values from 2^MAX_MAGNITUDE microseconds (about 12 days) on go into the last bucket.
+const int MAX_MAGNITUDE = 40;
+
+/*! Values below SUB_BUCKET_COUNT have one bucket each; each power of two above, up to MAX_MAGNITUDE, has SUB_BUCKET_COUNT buckets;
+ *  one more bucket takes values from 2^MAX_MAGNITUDE on.
+ */
+const int BUCKET_COUNT = LatencyHistogram::SUB_BUCKET_COUNT * (MAX_MAGNITUDE - SUB_BUCKET_BITS + 1) + 1;
+
+} // anonymous namespace
+
+LatencyHistogram::Snapshot::Snapshot():
+	count(0),
+	sum(0),
+	max(0),
+	bucket_counts(BUCKET_COUNT, 0)
+{
+}
+
+long long LatencyHistogram::Snapshot::getPercentile(double percentile) const {
+	if (count == 0){
+		return 0;
+	}
+	long long rank = static_cast<long long>(ceil(percentile / 100.0 * count));
+	if (rank < 1){
+		rank = 1;
+	}
+	long long seen = 0;
+	for (int bucket = 0; bucket < BUCKET_COUNT; ++ bucket){
+		seen += bucket_counts[bucket];
+		if (seen >= rank){
+			if (bucket == BUCKET_COUNT - 1){
+				// The last bucket has no upper bound.
+				return max;
+			}
+			long long upper_bound = getBucketUpperBound(bucket);
+			return upper_bound < max ? upper_bound : max;
+		}
+	}
+	return max;
+}
+
+LatencyHistogram::LatencyHistogram(){
+}
+
+void LatencyHistogram::record(long long microseconds){
+	if (microseconds < 0){
+		// The clock has been set back.
+		microseconds = 0;
+	}
+	int bucket = getBucket(microseconds);
+	mutex::scoped_lock lock(counts_mutex);
+	++ counts.count;
+	counts.sum += microseconds;
+	if (microseconds > counts.max){
+		counts.max = microseconds;
+	}
+	++ counts.bucket_counts[bucket];
+}
+
+void LatencyHistogram::recordSince(const posix_time::ptime &start){
+	record((posix_time::microsec_clock::universal_time() - start).total_microseconds());
+}
+
+LatencyHistogram::Snapshot LatencyHistogram::getSnapshot() const {
+	mutex::scoped_lock lock(counts_mutex);
+	return counts;
+}
+
+int LatencyHistogram::getBucket(long long value){
+	if (value < SUB_BUCKET_COUNT){
+		return static_cast<int>(value);
+	}
+	int magnitude = SUB_BUCKET_BITS;
+	while (magnitude < MAX_MAGNITUDE && (value >> (magnitude + 1)) != 0){
+		++ magnitude;
+	}
+	if (magnitude == MAX_MAGNITUDE){
+		return BUCKET_COUNT - 1;
+	}
+	// The top SUB_BUCKET_BITS + 1 bits, the highest of which is always 1, select the bucket within the magnitude.
+	int sub_bucket = static_cast<int>(value >> (magnitude - SUB_BUCKET_BITS)) - SUB_BUCKET_COUNT;
+	return SUB_BUCKET_COUNT * (magnitude - SUB_BUCKET_BITS + 1) + sub_bucket;
+}
+
+long long LatencyHistogram::getBucketUpperBound(int bucket){
+	if (bucket < SUB_BUCKET_COUNT){
+		return bucket;
+	}
+	int magnitude = bucket / SUB_BUCKET_COUNT - 1 + SUB_BUCKET_BITS;
+	int sub_bucket = bucket % SUB_BUCKET_COUNT;
+	int shift = magnitude - SUB_BUCKET_BITS;
+	return (static_cast<long long>(SUB_BUCKET_COUNT + sub_bucket + 1) << shift) - 1;
+}
+
+} // namespace util
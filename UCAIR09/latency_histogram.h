@@ -0,0 +1,63 @@
+#ifndef __latency_histogram_h__
+#define __latency_histogram_h__
+
+#include <vector>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/utility.hpp>
+
+namespace util {
+
+/*! \brief Histogram of latencies, with log-linear buckets as in HdrHistogram.
+ *
+ *  Each power-of-two range of microseconds is split into SUB_BUCKET_COUNT equal buckets,
+ *  so a percentile read back is within 1/SUB_BUCKET_COUNT of the value actually recorded.
+ *  Recording takes constant time and memory, whatever the range of values.
+ *  Thread-safe: the lock is held only for a few increments.
+ */
+class LatencyHistogram: private boost::noncopyable {
+public:
+	LatencyHistogram();
+
+	/// Records a latency in microseconds.
+	void record(long long microseconds);
+
+	/// Records the time elapsed since start.
+	void recordSince(const boost::posix_time::ptime &start);
+
+	/// Copy of the counts at some point in time.
+	class Snapshot {
+	public:
+		Snapshot();
+
+		/*! \brief Returns the latency at a given percentile, in microseconds.
+		 *  \param percentile between 0 and 100
+		 *  \return upper bound of the bucket the percentile falls in (but no more than max); 0 if nothing is recorded
+		 */
+		long long getPercentile(double percentile) const;
+
+		long long count; ///< number of values recorded
+		long long sum; ///< sum of values recorded
+		long long max; ///< max value recorded
+		std::vector<long long> bucket_counts;
+	};
+
+	/// Returns a copy of the counts.
+	Snapshot getSnapshot() const;
+
+	/// Number of buckets each power of two is split into.
+	static const int SUB_BUCKET_COUNT = 16;
+
+private:
+	/// Returns the bucket of a value.
+	static int getBucket(long long value);
+	/// Returns the largest value that goes into a bucket.
+	static long long getBucketUpperBound(int bucket);
+
+	Snapshot counts;
+	mutable boost::mutex counts_mutex;
+};
+
+} // namespace util
+
+#endif
@@ -32,6 +32,7 @@ bool Logger::finalize() {
 void Logger::log(const string &level, const string &message) {
 	posix_time::ptime now = posix_time::microsec_clock::local_time();
 	string line = str(format("%s %-5s %s") % util::timeToString(now, "%Y-%m-%d %H:%M:%S") % to_upper_copy(level) % message);
+	mutex::scoped_lock lock(log_mutex);
 	cerr << line << endl;
 	if (fout) {
 		fout << line << endl;
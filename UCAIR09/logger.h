@@ -3,6 +3,7 @@
 
 #include <fstream>
 #include <string>
+#include <boost/thread/mutex.hpp>
 #include "component.h"
 #include "main.h"
 
@@ -11,6 +12,7 @@ namespace ucair {
 /*! \brief Logs information to file.
  *
  *  I could have used log4cxx, but it's too complex.
+ *  Can be used from worker threads as well as the application strand.
  */
 class Logger : public Component {
 public:
@@ -25,6 +27,7 @@ public:
 private:
 	void log(const std::string &level, const std::string &message);
 	std::fstream fout;
+	boost::mutex log_mutex;
 };
 
 DECLARE_GET_COMPONENT(Logger);
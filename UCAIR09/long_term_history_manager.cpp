@@ -25,11 +25,16 @@ bool LongTermHistoryManager::initialize() {
 	return true;
 }
 
-bool LongTermHistoryManager::initializeUser(User &user) {
-	filesystem::path path = getUserManager().getProfileDir(user.getUserId());
+string LongTermHistoryManager::getDatabasePath(const string &user_id) {
+	filesystem::path path = getUserManager().getProfileDir(user_id);
 	path /= "long_term.db";
+	return path.string();
+}
+
+bool LongTermHistoryManager::initializeUser(User &user) {
+	string path = getDatabasePath(user.getUserId());
 	bool database_exists = filesystem::exists(path);
-	connections.insert(make_pair(user.getUserId(), shared_ptr<sqlite::Connection>(new sqlite::Connection(path.string()))));
+	connections.insert(make_pair(user.getUserId(), shared_ptr<sqlite::Connection>(new sqlite::Connection(path))));
 	if (! database_exists){
 		if (! createDatabase(user.getUserId())) {
 			return false;
@@ -147,18 +152,96 @@ void LongTermHistoryManager::addUserSaveTask(const string &user_id) {
 	user_save_tasks.insert(make_pair(user_id, UserSaveTask(user_id)));
 }
 
-const Search* LongTermHistoryManager::getSearch(const string &search_id, bool load_results) {
+bool LongTermHistoryManager::isSearchSaved(const string &search_id) const {
+	return search_save_tasks.find(search_id) == search_save_tasks.end();
+}
+
+void LongTermHistoryManager::addEvictedSearch(const string &user_id, const Search &search) {
+	assert(isSearchSaved(search.getSearchId()));
+	map<string, SearchLoadTask>::iterator itr;
+	tie(itr, tuples::ignore) = evicted_search_load_tasks.insert(make_pair(search.getSearchId(), SearchLoadTask(user_id, search.getSearchId())));
+	Search &evicted_search = itr->second.search;
+	evicted_search.setSearchId(search.getSearchId());
+	evicted_search.query = search.query;
+	evicted_search.setSearchEngineId(search.getSearchEngineId());
+	evicted_search.setTotalResultCount(search.getTotalResultCount());
+}
+
+SearchLoadTask* LongTermHistoryManager::findSearchLoadTask(const string &search_id) {
 	map<std::string, SearchLoadTask>::iterator itr = search_load_tasks.find(search_id);
-	if (itr == search_load_tasks.end()){
+	if (itr != search_load_tasks.end()){
+		return &itr->second;
+	}
+	itr = evicted_search_load_tasks.find(search_id);
+	if (itr != evicted_search_load_tasks.end()){
+		return &itr->second;
+	}
+	return NULL;
+}
+
+const Search* LongTermHistoryManager::getSearch(const string &search_id, bool load_results) {
+	SearchLoadTask *p = findSearchLoadTask(search_id);
+	if (! p){
 		return NULL;
 	}
-	SearchLoadTask &search_load_task = itr->second;
+	SearchLoadTask &search_load_task = *p;
 	if (load_results) {
 		search_load_task.loadResults(getConnection(search_load_task.user_id));
 	}
 	return &search_load_task.search;
 }
 
+void LongTermHistoryManager::asyncLoadResults(const vector<string> &search_ids, const function<void ()> &callback) {
+	shared_ptr<LoadedResultsList> loaded_results_list(new LoadedResultsList);
+	BOOST_FOREACH(const string &search_id, search_ids) {
+		const SearchLoadTask *search_load_task = findSearchLoadTask(search_id);
+		if (! search_load_task || search_load_task->isResultsLoaded()) {
+			continue;
+		}
+		loaded_results_list->push_back(LoadedResults());
+		loaded_results_list->back().db_path = getDatabasePath(search_load_task->user_id);
+		loaded_results_list->back().search_id = search_id;
+		loaded_results_list->back().ok = false;
+	}
+	if (loaded_results_list->empty()) {
+		callback();
+		return;
+	}
+	Main::instance().postBlocking(bind(&LongTermHistoryManager::readResults, loaded_results_list),
+			bind(&LongTermHistoryManager::onResultsRead, this, loaded_results_list, callback));
+}
+
+void LongTermHistoryManager::readResults(const shared_ptr<LoadedResultsList> &loaded_results_list) {
+	// The connections used by the application strand are not to be shared.
+	map<string, shared_ptr<sqlite::Connection> > read_connections;
+	BOOST_FOREACH(LoadedResults &loaded_results, *loaded_results_list) {
+		try {
+			shared_ptr<sqlite::Connection> &conn = read_connections[loaded_results.db_path];
+			if (! conn) {
+				conn.reset(new sqlite::Connection(loaded_results.db_path));
+				// Wait for history being saved at the same time.
+				conn->setBusyTimeOut(5000);
+			}
+			loaded_results.ok = SearchLoadTask::readResults(*conn, loaded_results.search_id, loaded_results.results);
+		}
+		catch (sqlite::Error &e) {
+			if (const string* error_info = boost::get_error_info<sqlite::ErrorInfo>(e)){
+				getLogger().error(*error_info);
+			}
+		}
+	}
+}
+
+void LongTermHistoryManager::onResultsRead(const shared_ptr<LoadedResultsList> &loaded_results_list, const function<void ()> &callback) {
+	BOOST_FOREACH(const LoadedResults &loaded_results, *loaded_results_list) {
+		SearchLoadTask *search_load_task = findSearchLoadTask(loaded_results.search_id);
+		if (loaded_results.ok && search_load_task) {
+			search_load_task->addResults(loaded_results.results);
+		}
+	}
+	callback();
+}
+
 UserSearchRecord* LongTermHistoryManager::getSearchRecord(const string &search_id) {
 	map<std::string, SearchLoadTask>::iterator itr = search_load_tasks.find(search_id);
 	if (itr == search_load_tasks.end()){
@@ -208,6 +291,8 @@ void LongTermHistoryManager::buildIndex(const string &user_id) {
 		const SearchLoadTask &search_load_task = p.second;
 		user->long_term_search_index->addDoc(search_load_task.search_id, *indexing::ValueMap::from(search_load_task.model));
 	}
+	// Long-term searches are only added here, so the index can be compacted.
+	user->long_term_search_index->freeze();
 }
 
 void LongTermHistoryManager::loadSearches(sqlite::Connection &conn, const string &user_id) {
@@ -548,6 +633,20 @@ void SearchLoadTask::loadResults(sqlite::Connection &conn) {
 		return;
 	}
 
+	if (readResults(conn, search_id, search.results)) {
+		results_loaded = true;
+	}
+}
+
+void SearchLoadTask::addResults(const map<int, SearchResult> &results) {
+	if (results_loaded) {
+		return;
+	}
+	search.results.insert(results.begin(), results.end());
+	results_loaded = true;
+}
+
+bool SearchLoadTask::readResults(sqlite::Connection &conn, const string &search_id, map<int, SearchResult> &results) {
 	getLogger().info("Loading results for search " + search_id);
 
 	try {
@@ -555,22 +654,22 @@ void SearchLoadTask::loadResults(sqlite::Connection &conn) {
 		stmt->bind(1, search_id);
 		while (stmt->step()) {
 			SearchResult result;
-			result.search_id = search.getSearchId();
+			result.search_id = search_id;
 			result.original_rank = stmt->getInt(0);
 			result.doc_id = buildDocName(result.search_id, result.original_rank);
 			result.title = stmt->getString(1);
 			result.summary = stmt->getString(2);
 			result.url = stmt->getString(3);
-			search.results.insert(make_pair(result.original_rank, result));
+			results.insert(make_pair(result.original_rank, result));
 		}
 	}
 	catch (sqlite::Error &e) {
 		if (const string* error_info = boost::get_error_info<sqlite::ErrorInfo>(e)){
 			getLogger().error(*error_info);
 		}
-		return;
+		return false;
 	}
-	results_loaded = true;
+	return true;
 }
 
 } // namespace ucair
@@ -4,6 +4,8 @@
 #include <map>
 #include <set>
 #include <string>
+#include <vector>
+#include <boost/function.hpp>
 #include <boost/smart_ptr.hpp>
 #include "component.h"
 #include "main.h"
@@ -63,6 +65,12 @@ public:
 	std::string search_id;
 
 	void loadResults(sqlite::Connection &conn);
+	/// Takes results read elsewhere (see LongTermHistoryManager::asyncLoadResults), unless they are loaded already.
+	void addResults(const std::map<int, SearchResult> &results);
+	bool isResultsLoaded() const { return results_loaded; }
+
+	/// Reads the results of a search from the database.
+	static bool readResults(sqlite::Connection &conn, const std::string &search_id, std::map<int, SearchResult> &results);
 
 private:
 	bool results_loaded;
@@ -82,6 +90,15 @@ public:
 	void addSearchSaveTask(const std::string &user_id, const std::string &search_id);
 	/// Adds a save task for a user.
 	void addUserSaveTask(const std::string &user_id);
+	/// Whether everything to be saved for a search has been saved (i.e. its save task has finished).
+	bool isSearchSaved(const std::string &search_id) const;
+
+	/*! \brief Takes over a (short-term) search that SearchProxy drops from memory.
+	 *
+	 *  The search must have been saved. Afterwards it is served by getSearch like long-term searches,
+	 *  with the results that were saved (the top ones and the viewed ones) loaded on demand.
+	 */
+	void addEvictedSearch(const std::string &user_id, const Search &search);
 
 	/// Returns the database connection for a user.
 	sqlite::Connection& getConnection(const std::string &user_id);
@@ -93,6 +110,12 @@ public:
 	 *  \return search, NULL if not found in long-term history
 	 */
 	const Search* getSearch(const std::string &search_id, bool load_results = true);
+	/*! \brief Loads search results from long-term history on a worker thread, so that getSearch need not block on the database.
+	 *
+	 *  \param search_ids searches whose results are needed (those not in long-term history or loaded already are skipped)
+	 *  \param callback invoked in the application strand once the results are loaded
+	 */
+	void asyncLoadResults(const std::vector<std::string> &search_ids, const boost::function<void ()> &callback);
 	/// Returns a user search record (NULL if not found).
 	UserSearchRecord* getSearchRecord(const std::string &search_id);
 	/// Returns a search model (NULL if not found).
@@ -128,10 +151,31 @@ private:
 	/// Called when UCAIR server is idel.
 	void onIdle();
 
+	/// Search results read by asyncLoadResults.
+	struct LoadedResults {
+		std::string db_path; ///< user database
+		std::string search_id;
+		std::map<int, SearchResult> results;
+		bool ok; ///< whether reading succeeded
+	};
+	typedef std::vector<LoadedResults> LoadedResultsList;
+	/// Reads results for asyncLoadResults on a worker thread, with connections of its own.
+	static void readResults(const boost::shared_ptr<LoadedResultsList> &loaded_results_list);
+	/// Hands the results read by asyncLoadResults to their searches, and invokes its callback.
+	void onResultsRead(const boost::shared_ptr<LoadedResultsList> &loaded_results_list, const boost::function<void ()> &callback);
+
+	/// Returns the database file of a user.
+	static std::string getDatabasePath(const std::string &user_id);
+
+	/// Returns the load task of a long-term or evicted search (NULL if not found).
+	SearchLoadTask* findSearchLoadTask(const std::string &search_id);
+
 	/// map from user id to user db connection
 	std::map<std::string, boost::shared_ptr<sqlite::Connection> > connections;
 	/// map from search id to search save task
 	std::map<std::string, SearchLoadTask> search_load_tasks;
+	/// map from search id to load task of a search evicted from SearchProxy (kept apart, as it is not part of long-term history)
+	std::map<std::string, SearchLoadTask> evicted_search_load_tasks;
 	/// map from search id to search save task
 	std::map<std::string, SearchSaveTask> search_save_tasks;
 	/// map from user id to user save task
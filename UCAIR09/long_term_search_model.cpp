@@ -58,24 +58,31 @@ SearchModel LongTermSearchModelGen::getModel(const UserSearchRecord &search_reco
 	}
 
 	if (! session_scope) { // Not limited to session scope
-		vector<pair<string, double> > search_scores = user->searchInHistory(*indexing::ValueMap::from(pseudo_feedback_model));
-		typedef pair<string, double> P1;
-		BOOST_FOREACH(const P1 &p, search_scores) {
-			const string &search_id = p.first;
-			if (session.find(search_id) != session.end()) {
-				continue; // already covered
-			}
-			const UserSearchRecord* past_search_record = user->getSearchRecord(search_id);
-			assert(past_search_record);
-			if (past_search_record->getClickedResults().empty()) {
-				continue;
-			}
-			map<int, double> past_search_model = user->getIndexedSearchModel(search_id);
-			double cos_sim = getCosSim(past_search_model, pseudo_feedback_model);
-			if (cos_sim >= min_cos_sim) {
-				neighbor_search_ids.push_back(search_id);
-				if ((int) neighbor_search_ids.size() >= max_neighbors) {
-					break;
+		// Many past searches are skipped below, so ask for a few times as many as needed, and twice as many again while they run out.
+		bool done = false;
+		size_t next_hit = 0;
+		for (int hit_count = max(max_neighbors, 1) * 4; ! done; hit_count *= 2) {
+			vector<pair<string, double> > search_scores = user->searchInHistory(*indexing::ValueMap::from(pseudo_feedback_model), hit_count);
+			done = (int) search_scores.size() < hit_count;
+			// The top hits start with those already looked at.
+			for (; next_hit < search_scores.size(); ++ next_hit) {
+				const string &search_id = search_scores[next_hit].first;
+				if (session.find(search_id) != session.end()) {
+					continue; // already covered
+				}
+				const UserSearchRecord* past_search_record = user->getSearchRecord(search_id);
+				assert(past_search_record);
+				if (past_search_record->getClickedResults().empty()) {
+					continue;
+				}
+				map<int, double> past_search_model = user->getIndexedSearchModel(search_id);
+				double cos_sim = getCosSim(past_search_model, pseudo_feedback_model);
+				if (cos_sim >= min_cos_sim) {
+					neighbor_search_ids.push_back(search_id);
+					if ((int) neighbor_search_ids.size() >= max_neighbors) {
+						done = true;
+						break;
+					}
 				}
 			}
 		}
@@ -112,8 +119,9 @@ SearchModel LongTermSearchModelGen::getModel(const UserSearchRecord &search_reco
 		}
 
 		vector<double> &background_component = components[1];
+		const indexing::ColProbs &col_probs = getIndexManager().getColProbs();
 		for (int i = 0; i < (int) term_ids.size(); ++ i) {
-			background_component[i] = getIndexManager().getColProb(term_ids[i]);
+			background_component[i] = col_probs.get(term_ids[i]);
 		}
 
 		int k = 2;
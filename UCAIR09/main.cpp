@@ -2,11 +2,13 @@
 #include <cstdlib>
 #include <fstream>
 #include <iostream>
+#include <boost/bind.hpp>
 #include <boost/foreach.hpp>
 #include <boost/program_options.hpp>
 #include "common_util.h"
 #include "component.h"
 #include "config.h"
+#include "index_manager.h"
 #include "log_importer.h"
 #include "logger.h"
 #include "sqlitepp.h"
@@ -24,7 +26,7 @@ extern void addAllComponents();
 
 Main* Main::_instance = NULL;
 
-Main::Main(int _argc, char *_argv[]): argc(_argc), argv(_argv), started(false) {
+Main::Main(int _argc, char *_argv[]): app_strand(io_service), argc(_argc), argv(_argv), started(false) {
 	_instance = this;
 	sqlite::initialize();
 }
@@ -43,6 +45,12 @@ void Main::start(){
 		exit(1);
 	}
 
+	int worker_thread_count = util::getParam<int>(config, "worker_threads");
+	worker_work.reset(new asio::io_service::work(worker_io_service));
+	for (int i = 0; i < worker_thread_count; ++ i){
+		worker_threads.create_thread(bind(&asio::io_service::run, &worker_io_service));
+	}
+
 	list<Component*> initialized_components;
 	BOOST_FOREACH(Component *component, components){
 		if (! component->initialize()){
@@ -71,13 +79,16 @@ void Main::start(){
 		else if (start_mode == "log_importer") {
 			getComponent<LogImporter>().run();
 		}
+		else if (start_mode == "compile_col_stats") {
+			getIndexManager().compileColStats();
+		}
 		stop();
 	}
 }
 
 void Main::interrupt(){
 	if (start_mode == "ucair_server") {
-		io_service.post(bind(&Main::stop, this));
+		app_strand.post(bind(&Main::stop, this));
 	}
 }
 
@@ -90,6 +101,10 @@ void Main::stop() {
 		getUCAIRServer().stop();
 	}
 
+	// Let blocking work finish before the components it may use (e.g. Logger) are gone.
+	worker_work.reset();
+	worker_threads.join_all();
+
 	vector<string> all_user_ids = getUserManager().getAllUserIds();
 	BOOST_FOREACH(const string &user_id, all_user_ids) {
 		getUserManager().finalizeUser(user_id);
@@ -104,6 +119,23 @@ void Main::stop() {
 	started = false;
 }
 
+void Main::postBlocking(const function<void ()> &work, const function<void ()> &continuation){
+	worker_io_service.post(bind(&Main::runBlocking, this, work, continuation));
+}
+
+void Main::runBlocking(const function<void ()> &work, const function<void ()> &continuation){
+	work();
+	if (! continuation.empty()){
+		app_strand.post(bind(&Main::continueBlocking, this, continuation));
+	}
+}
+
+void Main::continueBlocking(const function<void ()> &continuation){
+	if (started){
+		continuation();
+	}
+}
+
 bool Main::getOptions(int argc, char *argv[]){
 	try{
 		po::options_description all_options;
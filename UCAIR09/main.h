@@ -7,7 +7,9 @@
 #include <string>
 #include <boost/asio.hpp>
 #include <boost/foreach.hpp>
+#include <boost/function.hpp>
 #include <boost/smart_ptr.hpp>
+#include <boost/thread.hpp>
 #include <boost/utility.hpp>
 
 namespace ucair{
@@ -34,6 +36,21 @@ public:
 	/// HTTP server needs this.
 	boost::asio::io_service io_service;
 
+	/*! \brief Serializes application code (request handlers, timers).
+	 *
+	 *  The HTTP server may run io_service on several threads, but components are not thread-safe.
+	 *  Anything that touches components must be posted through this strand.
+	 */
+	boost::asio::io_service::strand app_strand;
+
+	/*! \brief Runs blocking work (such as a download) on a worker thread, then a continuation in the application strand.
+	 *
+	 *  This way application code can wait for slow operations without holding up the application strand.
+	 *  The work must not touch components, other than thread-safe ones such as Logger; it hands its results to the continuation.
+	 *  The continuation is dropped if the system stops in the meantime. It may be empty, if the work is all there is.
+	 */
+	void postBlocking(const boost::function<void ()> &work, const boost::function<void ()> &continuation);
+
 	/*! \brief Adds a component.
 	 *  The component will be able to readconfig options, get initialized and finalized.
      */
@@ -63,6 +80,11 @@ private:
 
 	bool getOptions(int argc, char *argv[]);
 
+	/// Runs on a worker thread for postBlocking.
+	void runBlocking(const boost::function<void ()> &work, const boost::function<void ()> &continuation);
+	/// Runs in the application strand for postBlocking.
+	void continueBlocking(const boost::function<void ()> &continuation);
+
 	std::list<Component*> components;
 	static Main* _instance;
 	int argc;
@@ -72,6 +94,10 @@ private:
 
 	std::string start_mode;
 	volatile bool started;
+
+	boost::asio::io_service worker_io_service; ///< runs work posted by postBlocking
+	boost::scoped_ptr<boost::asio::io_service::work> worker_work; ///< keeps worker threads running until stop
+	boost::thread_group worker_threads;
 };
 
 /// Use this to declare a global component getter. For example, DECLARE_GET_COMPONENT(SearchProxy) declares getSearchProxy()
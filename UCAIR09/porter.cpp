@@ -321,17 +321,24 @@ int _stem(char * p, int i, int j)
 } // anonymous namespace
 
 #include "porter.h" 
+#include <boost/thread/mutex.hpp>
 using namespace std;
 
 namespace indexing {
 
+/// The stemmer works on globals; search pages are stemmed in several threads as they download.
+static boost::mutex stem_mutex;
+
 string stem(const string &original){
 	char *buffer = new char[original.length() + 1];
 	strcpy(buffer, original.c_str());
 	for (int i = 0; i < (int)original.length(); ++ i){
 		buffer[i] = tolower(buffer[i]);
 	}
-	buffer[_stem(buffer, 0, original.length() - 1) + 1] = '\0';
+	{
+		boost::mutex::scoped_lock lock(stem_mutex);
+		buffer[_stem(buffer, 0, original.length() - 1) + 1] = '\0';
+	}
 	string stemmed = buffer;
 	delete[] buffer;
 	return stemmed;
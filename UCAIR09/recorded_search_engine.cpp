@@ -0,0 +1,226 @@
+#include "recorded_search_engine.h"
+#include <fstream>
+#include <boost/filesystem.hpp>
+#include <boost/format.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/random/uniform_real.hpp>
+#include <boost/random/variate_generator.hpp>
+#include <boost/thread.hpp>
+#include <zlib.h>
+#include "common_util.h"
+#include "index_util.h"
+#include "logger.h"
+#include "url_encoding.h"
+#include "xml_dom.h"
+
+using namespace std;
+using namespace boost;
+namespace fs = boost::filesystem;
+using xml::dom::Node;
+
+namespace {
+
+/// Result fields saved in a recording, by element name.
+const struct {
+	const char *name;
+	string ucair::Document::*field;
+} result_fields[] = {
+	{"title", &ucair::Document::title},
+	{"formatted_title", &ucair::Document::formatted_title},
+	{"summary", &ucair::Document::summary},
+	{"formatted_summary", &ucair::Document::formatted_summary},
+	{"url", &ucair::Document::url},
+	{"click_url", &ucair::Document::click_url},
+	{"display_url", &ucair::Document::display_url},
+	{"formatted_display_url", &ucair::Document::formatted_display_url},
+	{"cache_url", &ucair::Document::cache_url},
+	{"mime_type", &ucair::Document::mime_type}
+};
+
+/// Max length of the query part of a file name; longer queries are cut, and told apart by a checksum of the whole query.
+const size_t MAX_FILE_NAME_QUERY_LENGTH = 100;
+
+template <class T>
+bool getAttr(const Node &node, const string &name, T &value){
+	string s;
+	if (! node.getAttr(name, s)){
+		return false;
+	}
+	try{
+		value = lexical_cast<T>(s);
+	}
+	catch (bad_lexical_cast &){
+		return false;
+	}
+	return true;
+}
+
+} // anonymous namespace
+
+namespace ucair {
+
+RecordedSearchEngine::RecordedSearchEngine(const shared_ptr<SearchEngine> &base_search_engine_, Mode mode_, const string &dir_, int latency_, double failure_rate_):
+		base_search_engine(base_search_engine_),
+		mode(mode_),
+		dir(dir_),
+		latency(latency_),
+		failure_rate(failure_rate_),
+		random(static_cast<unsigned int>(time(NULL))) {
+	if (mode == RECORD && ! fs::exists(fs::path(dir))) {
+		try {
+			fs::create_directories(fs::path(dir));
+		}
+		catch (fs::filesystem_error &e) {
+			getLogger().error("Cannot create directory for recorded search pages " + dir + ": " + e.what());
+		}
+	}
+}
+
+string RecordedSearchEngine::getSearchEngineId() const {
+	return base_search_engine->getSearchEngineId();
+}
+
+string RecordedSearchEngine::getSearchEngineName() const {
+	return base_search_engine->getSearchEngineName();
+}
+
+int RecordedSearchEngine::maxAllowedResultCount() const {
+	return base_search_engine->maxAllowedResultCount();
+}
+
+bool RecordedSearchEngine::parseMode(const string &name, Mode &mode) {
+	if (name == "record") {
+		mode = RECORD;
+	}
+	else if (name == "replay") {
+		mode = REPLAY;
+	}
+	else {
+		return false;
+	}
+	return true;
+}
+
+bool RecordedSearchEngine::fetchResults(Search &search, int &start_pos, int &result_count) {
+	if (mode == REPLAY) {
+		if (latency > 0) {
+			this_thread::sleep(posix_time::milliseconds(latency));
+		}
+		if (failure_rate > 0.0) {
+			mutex::scoped_lock lock(random_mutex);
+			variate_generator<mt19937&, uniform_real<> > draw(random, uniform_real<>(0.0, 1.0));
+			if (draw() < failure_rate) {
+				getLogger().error("Injected failure replaying results for query ( " + search.query.text + " )");
+				return false;
+			}
+		}
+		return replay(search, start_pos, result_count);
+	}
+
+	int asked_start_pos = start_pos;
+	int asked_result_count = result_count;
+	if (! base_search_engine->fetchResults(search, start_pos, result_count)) {
+		return false;
+	}
+	record(search, asked_start_pos, asked_result_count, start_pos, result_count);
+	return true;
+}
+
+string RecordedSearchEngine::getFilePath(const string &query, int start_pos, int result_count) const {
+	string encoded_query;
+	http::util::urlEncode(query, encoded_query);
+	if (encoded_query.size() > MAX_FILE_NAME_QUERY_LENGTH) {
+		unsigned long checksum = crc32(0, reinterpret_cast<const Bytef*>(query.data()), static_cast<uInt>(query.size()));
+		encoded_query.resize(MAX_FILE_NAME_QUERY_LENGTH);
+		encoded_query += str(format("~%08x") % checksum);
+	}
+	string file_name = str(format("%1%_%2%_%3%_%4%.xml") % getSearchEngineId() % encoded_query % start_pos % result_count);
+	return (fs::path(dir) / file_name).string();
+}
+
+bool RecordedSearchEngine::record(const Search &search, int start_pos, int result_count, int fetched_start_pos, int fetched_result_count) {
+	Node root = Node::newXML();
+	root.setSelfDestroy();
+	Node node_search = Node::newElement(root, "search");
+	node_search.setAttr("query", search.query.text);
+	node_search.setAttr("start_pos", lexical_cast<string>(fetched_start_pos));
+	node_search.setAttr("result_count", lexical_cast<string>(fetched_result_count));
+	node_search.setAttr("total_result_count", lexical_cast<string>(search.getTotalResultCount()));
+	node_search.setAttr("spell_suggestion", search.query.spell_suggestion);
+	for (map<int, SearchResult>::const_iterator itr = search.results.begin(); itr != search.results.end(); ++ itr) {
+		Node node_result = Node::newElement(node_search, "result");
+		node_result.setAttr("rank", lexical_cast<string>(itr->first));
+		for (size_t i = 0; i < sizeof(result_fields) / sizeof(result_fields[0]); ++ i) {
+			const string &value = itr->second.*result_fields[i].field;
+			if (! value.empty()) {
+				Node node_field = Node::newElement(node_result, result_fields[i].name);
+				Node::newText(node_field, value);
+			}
+		}
+	}
+
+	string file_path = getFilePath(search.query.text, start_pos, result_count);
+	mutex::scoped_lock lock(record_mutex);
+	ofstream fout(file_path.c_str(), ios::binary);
+	if (! fout) {
+		getLogger().error("Cannot record search page to " + file_path);
+		return false;
+	}
+	fout << root.toString();
+	return true;
+}
+
+bool RecordedSearchEngine::replay(Search &search, int &start_pos, int &result_count) {
+	string file_path = getFilePath(search.query.text, start_pos, result_count);
+	string content;
+	{
+		ifstream fin(file_path.c_str(), ios::binary);
+		if (! fin) {
+			getLogger().error("No recorded results for query ( " + search.query.text + " ) at " + file_path);
+			return false;
+		}
+		util::readFile(fin, content);
+	}
+
+	Node root(content);
+	if (! root) {
+		getLogger().error("Bad recording " + file_path);
+		return false;
+	}
+	root.setSelfDestroy();
+	Node node_search = root.findElement(root, "search", "", "", Node::DESCEND);
+	string query;
+	if (! node_search || ! node_search.getAttr("query", query) || query != search.query.text) {
+		getLogger().error("No recorded results for query ( " + search.query.text + " ) at " + file_path);
+		return false;
+	}
+	long long total_result_count = 0;
+	if (! getAttr(node_search, "start_pos", start_pos) || ! getAttr(node_search, "result_count", result_count)
+			|| ! getAttr(node_search, "total_result_count", total_result_count)) {
+		getLogger().error("Bad recording " + file_path);
+		return false;
+	}
+	search.setTotalResultCount(total_result_count);
+	node_search.getAttr("spell_suggestion", search.query.spell_suggestion);
+
+	Node node_result = node_search.findElement(node_search, "result", "", "", Node::DESCEND_FIRST);
+	while (node_result) {
+		int rank;
+		if (getAttr(node_result, "rank", rank)) {
+			SearchResult result(search.getSearchId(), rank);
+			for (size_t i = 0; i < sizeof(result_fields) / sizeof(result_fields[0]); ++ i) {
+				Node n = node_result.findElement(node_result, result_fields[i].name, "", "", Node::DESCEND_FIRST);
+				if (n) {
+					result.*result_fields[i].field = n.getInnerText();
+				}
+			}
+			// As a live search engine does while the page downloads (see SearchPageReader).
+			indexing::extractTerms(result.title + " " + result.summary, result.stemmed_terms);
+			search.results[rank] = result;
+		}
+		node_result = node_search.findElement(node_result, "result", "", "", Node::NO_DESCEND);
+	}
+	return true;
+}
+
+} // namespace ucair
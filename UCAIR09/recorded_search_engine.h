@@ -0,0 +1,73 @@
+#ifndef __recorded_search_engine_h__
+#define __recorded_search_engine_h__
+
+#include <string>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/smart_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include "search_engine.h"
+
+namespace ucair {
+
+/*! \brief Serves result pages recorded from a base search engine, so that searches run without network.
+ *
+ *  In record mode, pages are fetched from the base search engine and saved to a directory as they pass through.
+ *  In replay mode, pages are served from the directory only, with a given latency and failure rate added,
+ *  to benchmark or regression test everything from fetching to rendering.
+ *  A page is recorded under the query, start pos and result count asked for, in a file such as bing_some+query_1_10.xml.
+ *  A long query is cut short in the file name, followed by a checksum of the whole query.
+ *  The search engine takes the id and name of the base search engine, to stand in for it.
+ */
+class RecordedSearchEngine: public SearchEngine {
+public:
+	enum Mode {
+		RECORD,
+		REPLAY
+	};
+
+	/*! \brief Constructor.
+	 *  \param base_search_engine search engine to record pages from
+	 *  \param mode record or replay
+	 *  \param dir directory of recorded pages; created in record mode if it does not exist
+	 *  \param latency time taken to replay a page, in milliseconds
+	 *  \param failure_rate fraction of pages that fail to replay, picked at random
+	 */
+	RecordedSearchEngine(const boost::shared_ptr<SearchEngine> &base_search_engine, Mode mode, const std::string &dir, int latency = 0, double failure_rate = 0.0);
+
+	std::string getSearchEngineId() const;
+	std::string getSearchEngineName() const;
+
+	/*! \brief Retrieves results for a query, from the base search engine or from a recording.
+	 *
+	 *  In replay mode, fails if the page has not been recorded.
+	 */
+	bool fetchResults(Search &search, int &start_pos, int &result_count);
+	int maxAllowedResultCount() const;
+
+	/// Parses a mode from its name ("record" or "replay"); returns false if the name is not known.
+	static bool parseMode(const std::string &name, Mode &mode);
+
+private:
+	/// Returns the file a page is recorded in.
+	std::string getFilePath(const std::string &query, int start_pos, int result_count) const;
+
+	/// Saves a page fetched from the base search engine.
+	bool record(const Search &search, int start_pos, int result_count, int fetched_start_pos, int fetched_result_count);
+
+	/// Loads a recorded page.
+	bool replay(Search &search, int &start_pos, int &result_count);
+
+	boost::shared_ptr<SearchEngine> base_search_engine;
+	Mode mode;
+	std::string dir;
+	int latency;
+	double failure_rate;
+
+	boost::mt19937 random;
+	boost::mutex random_mutex;
+	boost::mutex record_mutex;
+};
+
+}
+
+#endif
@@ -1,4 +1,5 @@
 #include "reply.h"
+#include <cassert>
 #include <boost/format.hpp>
 #include <boost/lexical_cast.hpp>
 
@@ -59,12 +60,34 @@ ostream& operator<< (ostream &out, const Reply &reply){
 	return out;
 }
 
-Reply::Reply(): status(reply_status::ok) {
+Reply::Reply(): status(reply_status::ok), streaming(false) {
+}
+
+void Reply::reset() {
+	status = reply_status::ok;
+	headers.clear();
+	content.clear();
+	shared_content.reset();
+	status_line.clear();
+	streaming = false;
+	chunk_size_line.clear();
+}
+
+bool Reply::flush() {
+	if (flush_handler.empty()){
+		return false;
+	}
+	return flush_handler();
+}
+
+boost::function<void ()> Reply::defer() {
+	assert(! defer_handler.empty());
+	return defer_handler();
 }
 
 void Reply::setStatusLine() {
 	string status_str = reply_status::toString(status);
-	status_line = str(format("HTTP/1.0 %1% %2%") % status % status_str);
+	status_line = str(format("HTTP/1.1 %1% %2%") % status % status_str);
 }
 
 void Reply::setStockReply() {
@@ -82,16 +105,51 @@ void Reply::setStockReply() {
  *
  *  If status is not OK and reply content is missing, a stock reply is provided.
  *
- *  Content length is automatically calculated.
+ *  Content length is automatically calculated. 204 and 304 replies never carry a body,
+ *  which matters on a persistent connection where the client relies on message framing.
  */
 vector<asio::const_buffer> Reply::toBuffers(){
+	vector<asio::const_buffer> buffers;
+	if (streaming){
+		contentToChunk(buffers);
+		buffers.push_back(asio::buffer("0\r\n\r\n", 5)); // last chunk
+		return buffers;
+	}
+
 	setStatusLine();
-	if (status != reply_status::ok && content.empty()){
-		setStockReply();
+	if (status == reply_status::no_content || status == reply_status::not_modified){
+		content.clear();
+		shared_content.reset();
+	}
+	else{
+		if (status != reply_status::ok && content.empty() && ! shared_content){
+			setStockReply();
+		}
+		headers.insert(make_pair("Content-Length", lexical_cast<string>(shared_content ? shared_content->size() : content.size())));
 	}
-	headers.insert(make_pair("Content-Length", lexical_cast<string>(content.size())));
+	const string &body = shared_content ? *shared_content : content;
+
+	headerToBuffers(buffers);
+	buffers.push_back(asio::buffer(body));
+	return buffers;
+}
 
+/*! Same as toBuffers, the reply must remain unchanged until the write operation has completed.
+ *  The caller clears content afterwards.
+ */
+vector<asio::const_buffer> Reply::chunkToBuffers(){
 	vector<asio::const_buffer> buffers;
+	if (! streaming){
+		setStatusLine();
+		headers.insert(make_pair("Transfer-Encoding", "chunked"));
+		headerToBuffers(buffers);
+		streaming = true;
+	}
+	contentToChunk(buffers);
+	return buffers;
+}
+
+void Reply::headerToBuffers(vector<asio::const_buffer> &buffers){
 	buffers.push_back(asio::buffer(status_line));
 	buffers.push_back(asio::buffer("\r\n", 2));
 	for (multimap<string, string>::const_iterator itr = headers.begin(); itr != headers.end(); ++ itr){
@@ -101,8 +159,17 @@ vector<asio::const_buffer> Reply::toBuffers(){
 		buffers.push_back(asio::buffer("\r\n", 2));
 	}
 	buffers.push_back(asio::buffer("\r\n", 2));
+}
+
+void Reply::contentToChunk(vector<asio::const_buffer> &buffers){
+	// An empty chunk would mark the end of the reply.
+	if (content.empty()){
+		return;
+	}
+	chunk_size_line = str(format("%x\r\n") % content.size());
+	buffers.push_back(asio::buffer(chunk_size_line));
 	buffers.push_back(asio::buffer(content));
-	return buffers;
+	buffers.push_back(asio::buffer("\r\n", 2));
 }
 
 } // namespace server
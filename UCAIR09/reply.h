@@ -6,6 +6,8 @@
 #include <string>
 #include <vector>
 #include <boost/asio.hpp>
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
 
 namespace http {
 namespace server {
@@ -33,21 +35,62 @@ namespace reply_status {
 	std::string toString(int status);
 };
 
-/// HTTP response message.
+/*! \brief HTTP response message.
+ *
+ *  Normally the whole reply is sent after the request handler returns.
+ *  A handler can also call flush() to send what it has produced so far, in which case
+ *  the reply is sent with chunked transfer encoding.
+ *  A handler that has to wait for something can call defer(), and have the reply sent later.
+ */
 class Reply {
 public:
 
 	Reply();
 
+	/// Clears all fields, so the object can be reused for the next reply on a persistent connection.
+	void reset();
+
 	int status; ///< status code
 
 	std::multimap<std::string, std::string> headers; ///< map from header field name to field value
 
 	std::string content; ///< response body
 
-	/// Converts the reply into a vector of buffers.
+	/// If set, sent as response body instead of content, so that cached data need not be copied. Not used for flush.
+	boost::shared_ptr<const std::string> shared_content;
+
+	/// Converts the reply into a vector of buffers (the remaining part of it, if flushed before).
 	std::vector<boost::asio::const_buffer> toBuffers();
 
+	/*! \brief Sends status line, headers and content produced so far, and clears content.
+	 *
+	 *  After this, status and headers can no longer be changed.
+	 *  The chunk is written in the background; if that fails, the connection is closed once the reply is complete.
+	 *  \return false if the client does not support chunked replies (content is kept then)
+	 */
+	bool flush();
+
+	/// Whether part of the reply has already been sent.
+	bool isStreaming() const { return streaming; }
+
+	/*! \brief Converts content into buffers for a chunk, preceded by the status line and headers on the first call.
+	 *  Used by the connection to implement flush.
+	 */
+	std::vector<boost::asio::const_buffer> chunkToBuffers();
+
+	/*! \brief Keeps the reply from being sent when the request handler returns.
+	 *
+	 *  The reply must not be touched by anyone else until the returned function is called (from any thread),
+	 *  which sends it. The function also keeps the connection alive.
+	 */
+	boost::function<void ()> defer();
+
+	/// Set by the connection until the reply is complete, if the client supports chunked replies.
+	boost::function<bool ()> flush_handler;
+
+	/// Set by the connection while the request handler runs.
+	boost::function<boost::function<void ()> ()> defer_handler;
+
 	/// Prints reply header.
 	friend std::ostream& operator << (std::ostream &out, const Reply &rep);
 
@@ -59,7 +102,15 @@ private:
 	/// Sets reply content from a stock template.
 	void setStockReply();
 
+	/// Appends status line and headers to buffers.
+	void headerToBuffers(std::vector<boost::asio::const_buffer> &buffers);
+
+	/// Appends content as a chunk to buffers.
+	void contentToChunk(std::vector<boost::asio::const_buffer> &buffers);
+
 	std::string status_line; ///< status line
+	bool streaming; ///< whether status line and headers have been sent
+	std::string chunk_size_line; ///< size line of the chunk being sent
 };
 
 } // namespace server
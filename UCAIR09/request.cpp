@@ -8,6 +8,15 @@ namespace server {
 Request::Request(): http_version_major(0), http_version_minor(0) {
 }
 
+void Request::reset(){
+	method.clear();
+	url.clear();
+	http_version_major = 0;
+	http_version_minor = 0;
+	headers.clear();
+	content.clear();
+}
+
 ostream& operator<< (ostream &out, const Request &request){
 	out << request.method << " " << request.url << " HTTP/" << request.http_version_major << "." << request.http_version_minor << endl;
 	for (multimap<string, string>::const_iterator itr = request.headers.begin(); itr != request.headers.end(); ++ itr){
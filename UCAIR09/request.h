@@ -13,6 +13,9 @@ class Request {
 public:
 	Request();
 
+	/// Clears all fields, so the object can be reused for the next request on a persistent connection.
+	void reset();
+
 	std::string method; ///< GET / POST / HEAD
 	std::string url; ///< request URI
 	int http_version_major; ///< HTTP major version
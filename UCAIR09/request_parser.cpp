@@ -1,8 +1,7 @@
 #include "request_parser.h"
-#include <sstream>
-#include <boost/lexical_cast.hpp>
+#include <cstring>
+#include <boost/algorithm/string.hpp>
 #include "request.h"
-#include "url_components.h"
 
 using namespace std;
 using namespace boost;
@@ -10,290 +9,299 @@ using namespace boost;
 namespace http {
 namespace server {
 
-RequestParser::RequestParser(size_t max_content_length_):
-	state(method_start),
-	remaining_content_length(0),
-	max_content_length(max_content_length_)
-{
+namespace {
+
+/// Lookup table of characters allowed in a token (request method, header field name).
+class TokenChars {
+public:
+	TokenChars(){
+		static const char *tspecials = "()<>@,;:\\\"/[]?={} \t";
+		for (int c = 0; c < 256; ++ c){
+			table[c] = c > 31 && c < 127 && strchr(tspecials, c) == NULL;
+		}
+	}
+	bool operator() (char c) const {
+		return table[(unsigned char) c];
+	}
+private:
+	bool table[256];
+};
+
+const TokenChars isTokenChar;
+
+/// Checks if a byte is an HTTP control character.
+inline bool isCtrl(char c){
+	return (unsigned char) c <= 31 || c == 127;
 }
 
-void RequestParser::reset(){
-	state = method_start;
+inline bool isDigit(char c){
+	return c >= '0' && c <= '9';
 }
 
-tribool RequestParser::consume(Request& request, char input){
-	switch (state){
-	case method_start:
-		if (!isChar(input) || isCtrl(input) || isTspecial(input)){
-			return false;
-		}
-		else{
-			state = method;
-			request.method.push_back(input);
-			return indeterminate;
-		}
-	case method:
-		if (input == ' '){
-			state = uri;
-			return indeterminate;
-		}
-		else if (!isChar(input) || isCtrl(input) || isTspecial(input)){
-			return false;
-		}
-		else{
-			request.method.push_back(input);
-			return indeterminate;
-		}
-	case uri_start:
-		if (isCtrl(input)){
-			return false;
-		}
-		else{
-			state = uri;
-			request.url.push_back(input);
-			return indeterminate;
-		}
-	case uri:
-		if (input == ' '){
-			state = http_version_h;
-			return indeterminate;
-		}
-		else if (isCtrl(input)){
-			return false;
-		}
-		else{
-			request.url.push_back(input);
-			return indeterminate;
-		}
-	case http_version_h:
-		if (input == 'H'){
-			state = http_version_t_1;
-			return indeterminate;
-		}
-		else{
-			return false;
-		}
-	case http_version_t_1:
-		if (input == 'T'){
-			state = http_version_t_2;
-			return indeterminate;
-		}
-		else{
-			return false;
-		}
-	case http_version_t_2:
-		if (input == 'T'){
-			state = http_version_p;
-			return indeterminate;
-		}
-		else{
-			return false;
-		}
-	case http_version_p:
-		if (input == 'P'){
-			state = http_version_slash;
-			return indeterminate;
-		}
-		else{
-			return false;
-		}
-	case http_version_slash:
-		if (input == '/'){
-			request.http_version_major = 0;
-			request.http_version_minor = 0;
-			state = http_version_major_start;
-			return indeterminate;
-		}
-		else{
+/// Checks that [begin, end) is a non-empty token.
+bool isToken(const char *begin, const char *end){
+	if (begin == end){
+		return false;
+	}
+	for (; begin != end; ++ begin){
+		if (! isTokenChar(*begin)){
 			return false;
 		}
-	case http_version_major_start:
-		if (isDigit(input)){
-			request.http_version_major = request.http_version_major * 10 + input - '0';
-			state = http_version_major;
-			return indeterminate;
-		}
-		else{
+	}
+	return true;
+}
+
+/// Checks that [begin, end) contains no control characters other than horizontal tab.
+bool isText(const char *begin, const char *end){
+	for (; begin != end; ++ begin){
+		if (isCtrl(*begin) && *begin != '\t'){
 			return false;
 		}
-	case http_version_major:
-		if (input == '.'){
-			state = http_version_minor_start;
-			return indeterminate;
-		}
-		else if (isDigit(input)){
-			request.http_version_major = request.http_version_major * 10 + input - '0';
-			return indeterminate;
-		}
-		else{
+	}
+	return true;
+}
+
+/// Parses a non-negative decimal number, returning false on bad format or overflow.
+bool parseNumber(const char *begin, const char *end, size_t &value){
+	if (begin == end){
+		return false;
+	}
+	value = 0;
+	for (; begin != end; ++ begin){
+		if (! isDigit(*begin)){
 			return false;
 		}
-	case http_version_minor_start:
-		if (isDigit(input)){
-			request.http_version_minor = request.http_version_minor * 10 + input - '0';
-			state = http_version_minor;
-			return indeterminate;
-		}
-		else{
+		size_t next = value * 10 + (*begin - '0');
+		if (next / 10 != value){
 			return false;
 		}
-	case http_version_minor:
-		if (input == '\r'){
-			state = expecting_newline_1;
-			return indeterminate;
-		}
-		else if (isDigit(input)){
-			request.http_version_minor = request.http_version_minor * 10 + input - '0';
-			return indeterminate;
+		value = next;
+	}
+	return true;
+}
+
+/// A header field line, pointing into the receive buffer.
+struct HeaderField {
+	const char *name; ///< NULL for a continuation line of the previous field
+	const char *name_end;
+	const char *value;
+	const char *value_end;
+};
+
+} // anonymous namespace
+
+RequestParser::RequestParser(size_t max_content_length_):
+	state(headers),
+	scanned_length(0),
+	remaining_content_length(0),
+	remaining_discard_length(0),
+	max_content_length(max_content_length_)
+{
+}
+
+void RequestParser::reset(){
+	state = headers;
+	scanned_length = 0;
+	remaining_content_length = 0;
+	remaining_discard_length = 0;
+}
+
+boost::tuple<tribool, const char*> RequestParser::parse(Request& req, const char *begin, const char *end){
+	if (state == entity_body){
+		return parseBody(req, begin, end);
+	}
+
+	if (scanned_length == 0){
+		// Tolerate empty lines before the request line, which some clients send after a POST body.
+		while (begin != end && (*begin == '\r' || *begin == '\n')){
+			++ begin;
 		}
-		else{
+	}
+
+	// Look for the empty line ending the header block. Every '\n' found is checked against the two bytes before it,
+	// so scanning can resume where the previous call stopped.
+	const char *pos = begin + scanned_length;
+	const char *header_end = NULL;
+	while (pos != end){
+		const char *newline = static_cast<const char*>(memchr(pos, '\n', end - pos));
+		if (newline == NULL){
+			break;
+		}
+		if (newline - begin >= 2 && newline[-1] == '\r' && newline[-2] == '\n'){
+			header_end = newline + 1;
+			break;
+		}
+		pos = newline + 1;
+	}
+	if (header_end == NULL){
+		scanned_length = end - begin;
+		tribool result = indeterminate;
+		return boost::make_tuple(result, begin);
+	}
+	scanned_length = 0;
+
+	// The block passed in excludes the CRLF of the final empty line.
+	if (! parseHeaders(req, begin, header_end - 2)){
+		tribool result = false;
+		return boost::make_tuple(result, header_end);
+	}
+	if (remaining_content_length == 0 && remaining_discard_length == 0){
+		tribool result = true;
+		return boost::make_tuple(result, header_end);
+	}
+	state = entity_body;
+	req.content.reserve(remaining_content_length);
+	return parseBody(req, header_end, end);
+}
+
+bool RequestParser::parseHeaders(Request& req, const char *begin, const char *end){
+	const char *line_end = static_cast<const char*>(memchr(begin, '\n', end - begin));
+	if (line_end == NULL || line_end == begin || line_end[-1] != '\r' || ! parseRequestLine(req, begin, line_end - 1)){
+		return false;
+	}
+
+	// First validate all fields, keeping them as pointers into the buffer.
+	HeaderField fields[MAX_HEADER_COUNT];
+	int field_count = 0;
+	const char *content_length = NULL;
+	const char *content_length_end = NULL;
+	for (const char *line = line_end + 1; line != end; line = line_end + 1){
+		line_end = static_cast<const char*>(memchr(line, '\n', end - line));
+		if (line_end == NULL || line_end == line || line_end[-1] != '\r'){
 			return false;
 		}
-	case expecting_newline_1:
-		if (input == '\n'){
-			state = header_line_start;
-			return indeterminate;
-		}
-		else{
+		if (field_count == MAX_HEADER_COUNT){
 			return false;
 		}
-	case header_line_start:
-		cur_header_name = cur_header_value = "";
-		if (input == '\r'){
-			state = expecting_newline_3;
-			return indeterminate;
-		}
-		else if (!request.headers.empty() && (input == ' ' || input == '\t')){
-			state = header_lws;
-			return indeterminate;
-		}
-		else if (!isChar(input) || isCtrl(input) || isTspecial(input)){
-			return false;
+		HeaderField &field = fields[field_count];
+		const char *p = line;
+		const char *q = line_end - 1;
+		if (*p == ' ' || *p == '\t'){
+			// Continuation of the previous field's value.
+			if (field_count == 0){
+				return false;
+			}
+			field.name = field.name_end = NULL;
 		}
 		else{
-			state = header_name;
-			cur_header_name.push_back(input);
-			return indeterminate;
-		}
-	case header_lws:
-		if (input == '\r'){
-			request.headers.insert(make_pair(cur_header_name, cur_header_value));
-			cur_header_name = cur_header_value = "";
-			state = expecting_newline_2;
-			return indeterminate;
-		}
-		else if (input == ' ' || input == '\t'){
-			return indeterminate;
-		}
-		else if (isCtrl(input)){
-			return false;
+			const char *colon = static_cast<const char*>(memchr(p, ':', q - p));
+			if (colon == NULL || ! isToken(p, colon)){
+				return false;
+			}
+			field.name = p;
+			field.name_end = colon;
+			p = colon + 1;
 		}
-		else{
-			state = header_value;
-			cur_header_value.push_back(input);
-			return indeterminate;
+		while (p != q && (*p == ' ' || *p == '\t')){
+			++ p;
 		}
-	case header_name:
-		if (input == ':'){
-			state = space_before_header_value;
-			return indeterminate;
+		while (q != p && (q[-1] == ' ' || q[-1] == '\t')){
+			-- q;
 		}
-		else if (!isChar(input) || isCtrl(input) || isTspecial(input)){
+		if (! isText(p, q)){
 			return false;
 		}
-		else{
-			cur_header_name.push_back(input);
-			return indeterminate;
-		}
-	case space_before_header_value:
-		if (input == ' '){
-			state = header_value;
-			return indeterminate;
-		}
-		else{
-			return false;
+		field.value = p;
+		field.value_end = q;
+
+		if (field.name != NULL && field.name_end - field.name == 14 && iequals(make_iterator_range(field.name, field.name_end), "Content-Length")){
+			// Conflicting lengths would make the message framing ambiguous.
+			if (content_length != NULL && ! equals(make_iterator_range(content_length, content_length_end), make_iterator_range(p, q))){
+				return false;
+			}
+			content_length = p;
+			content_length_end = q;
 		}
-	case header_value:
-		if (input == '\r'){
-			if (cur_header_name == "Content-Length"){
-				try{
-					remaining_content_length = lexical_cast<size_t>(cur_header_value); 
-				}
-				catch (bad_lexical_cast){
-					cur_header_value = "0";
-				}
-				if (remaining_content_length > max_content_length){
-					remaining_content_length = max_content_length;
+		++ field_count;
+	}
+
+	size_t length = 0;
+	if (content_length != NULL && ! parseNumber(content_length, content_length_end, length)){
+		return false;
+	}
+	remaining_content_length = min(length, max_content_length);
+	remaining_discard_length = length - remaining_content_length;
+
+	// Now copy them into the request.
+	multimap<string, string>::iterator last = req.headers.end();
+	for (int i = 0; i < field_count; ++ i){
+		const HeaderField &field = fields[i];
+		if (field.name == NULL){
+			if (field.value != field.value_end){
+				if (! last->second.empty()){
+					last->second += ' ';
 				}
+				last->second.append(field.value, field.value_end);
 			}
-			request.headers.insert(make_pair(cur_header_name, cur_header_value));
-			cur_header_name = cur_header_value = "";
-			state = expecting_newline_2;
-			return indeterminate;
-		}
-		else if (isCtrl(input)){
-			return false;
-		}
-		else{
-			cur_header_value.push_back(input);
-			return indeterminate;
-		}
-	case expecting_newline_2:
-		if (input == '\n'){
-			state = header_line_start;
-			return indeterminate;
 		}
 		else{
-			return false;
-		}
-	case expecting_newline_3:
-		if (input == '\n'){
-			if (remaining_content_length == 0){
-				return true;
-			}
-			else{
-				state = entity_body;
-				return indeterminate;
-			}
+			last = req.headers.insert(make_pair(string(field.name, field.name_end), string(field.value, field.value_end)));
 		}
-		else{
+	}
+	return true;
+}
+
+bool RequestParser::parseRequestLine(Request& req, const char *begin, const char *end){
+	const char *method_end = static_cast<const char*>(memchr(begin, ' ', end - begin));
+	if (method_end == NULL || ! isToken(begin, method_end)){
+		return false;
+	}
+	const char *url = method_end + 1;
+	const char *url_end = static_cast<const char*>(memchr(url, ' ', end - url));
+	if (url_end == NULL || url_end == url){
+		return false;
+	}
+	for (const char *p = url; p != url_end; ++ p){
+		if (isCtrl(*p)){
 			return false;
 		}
-	case entity_body:
-		request.content.push_back(input);
-		if (-- remaining_content_length <= 0){
-			return true;
-		}
-		else{
-			return indeterminate; 
-		}
-	default:
+	}
+
+	const char *p = url_end + 1;
+	if (end - p < 8 || memcmp(p, "HTTP/", 5) != 0){
+		return false;
+	}
+	p += 5;
+	int major = 0, minor = 0;
+	if (! isDigit(*p)){
+		return false;
+	}
+	while (p != end && isDigit(*p)){
+		major = major * 10 + (*p ++ - '0');
+	}
+	if (p == end || *p ++ != '.' || p == end || ! isDigit(*p)){
+		return false;
+	}
+	while (p != end && isDigit(*p)){
+		minor = minor * 10 + (*p ++ - '0');
+	}
+	if (p != end){
 		return false;
 	}
-}
 
-bool RequestParser::isChar(int c){
-	return c >= 0 && c <= 127;
+	req.method.assign(begin, method_end);
+	req.url.assign(url, url_end);
+	req.http_version_major = major;
+	req.http_version_minor = minor;
+	return true;
 }
 
-bool RequestParser::isCtrl(int c){
-	return c >= 0 && c <= 31 || c == 127;
-}
+boost::tuple<tribool, const char*> RequestParser::parseBody(Request& req, const char *begin, const char *end){
+	size_t n = min(static_cast<size_t>(end - begin), remaining_content_length);
+	req.content.append(begin, n);
+	begin += n;
+	remaining_content_length -= n;
 
-bool RequestParser::isTspecial(int c){
-	switch (c){
-	case '(': case ')': case '<': case '>': case '@':
-	case ',': case ';': case ':': case '\\': case '"':
-	case '/': case '[': case ']': case '?': case '=':
-	case '{': case '}': case ' ': case '\t':
-		return true;
-	default:
-		return false;
-	}
-}
+	// Content beyond max_content_length is dropped, but still has to be read so that it is not taken for the next request.
+	n = min(static_cast<size_t>(end - begin), remaining_discard_length);
+	begin += n;
+	remaining_discard_length -= n;
 
-bool RequestParser::isDigit(int c){
-	return c >= '0' && c <= '9';
+	tribool result = indeterminate;
+	if (remaining_content_length == 0 && remaining_discard_length == 0){
+		result = true;
+	}
+	return boost::make_tuple(result, begin);
 }
 
 } // namespace server
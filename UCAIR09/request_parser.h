@@ -10,11 +10,18 @@ namespace server {
 
 class Request;
 
-/// Parser for incoming requests.
+/*! \brief Parser for incoming requests.
+ *
+ *  The header block is located by scanning the receive buffer with memchr for line ends,
+ *  and is parsed only once it is complete. Until then nothing is consumed, so the caller must keep
+ *  the unconsumed bytes and pass them in again (with more data appended) on the next call.
+ *  Request line and header fields are kept as pointers into the buffer while parsing and are copied into
+ *  the Request in one go at the end, instead of character by character.
+ */
 class RequestParser {
 public:
 	/*! \brief Constructor
-	 *  \param max_content_length exceeding part will be truncated
+	 *  \param max_content_length exceeding part will be read and discarded
 	 */
 	RequestParser(size_t max_content_length);
 
@@ -26,64 +33,36 @@ public:
 	 *  \param begin input begin pos
 	 *  \param end input end pos
 	 *  \return tribool: true when a complete request has been parsed, false if the data is invalid, indeterminate when more data is required.
-	 *          InputIterator: indicates how much of the input has been consumed.
+	 *          const char*: indicates how much of the input has been consumed.
+	 *          While the header block is incomplete, nothing is consumed.
 	 */
-	template <typename InputIterator>
-	boost::tuple<boost::tribool, InputIterator> parse(Request& req, InputIterator begin, InputIterator end){
-		while (begin != end){
-			boost::tribool result = consume(req, *begin++);
-			if (result || !result)
-				return boost::make_tuple(result, begin);
-		}
-		boost::tribool result = boost::indeterminate;
-		return boost::make_tuple(result, begin);
-	}
+	boost::tuple<boost::tribool, const char*> parse(Request& req, const char *begin, const char *end);
 
-private:
-	/// Handles the next character of input.
-	boost::tribool consume(Request& req, char input);
+	/// Whether the header has been parsed and the body is being read.
+	bool isReadingBody() const { return state == entity_body; }
 
-	/// Checks if a byte is an HTTP character.
-	static bool isChar(int c);
+	/// Max number of header fields accepted in a request.
+	static const int MAX_HEADER_COUNT = 64;
 
-	/// Checks if a byte is an HTTP control character.
-	static bool isCtrl(int c);
+private:
+	/// Parses a complete header block (request line and header fields, excluding the final empty line).
+	bool parseHeaders(Request& req, const char *begin, const char *end);
 
-	/// Checks if a byte is defined as an HTTP tspecial character.
-	static bool isTspecial(int c);
+	/// Parses the request line.
+	bool parseRequestLine(Request& req, const char *begin, const char *end);
 
-	/// Checks if a byte is a digit.
-	static bool isDigit(int c);
+	/// Consumes request body.
+	boost::tuple<boost::tribool, const char*> parseBody(Request& req, const char *begin, const char *end);
 
 	/// Current parser state
 	enum State {
-		method_start,
-		method,
-		uri_start,
-		uri,
-		http_version_h,
-		http_version_t_1,
-		http_version_t_2,
-		http_version_p,
-		http_version_slash,
-		http_version_major_start,
-		http_version_major,
-		http_version_minor_start,
-		http_version_minor,
-		expecting_newline_1,
-		header_line_start,
-		header_lws,
-		header_name,
-		space_before_header_value,
-		header_value,
-		expecting_newline_2,
-		expecting_newline_3,
+		headers,
 		entity_body
 	} state;
 
-	std::string cur_header_name; ///< current header field name
-	std::string cur_header_value; ///< current header field value
+	size_t scanned_length; ///< length of the pending header bytes already known not to contain the end of header block
 	size_t remaining_content_length; ///< unconsumed request content length
+	size_t remaining_discard_length; ///< request content exceeding max_content_length that is still to be skipped
 	size_t max_content_length; ///< max allowed request content length
 };
 
@@ -139,7 +139,7 @@ void RerankingResultListView::makeRanking(User &user, const Search &search, vect
 	}
 
 	vector<pair<int, double> > scores;
-	indexing::SimpleKLRetriever retriever(*indexing::ValueMap::from(getIndexManager().getColProbs()), getIndexManager().getDefaultColProb(), dir_prior);
+	indexing::SimpleKLRetriever retriever(getIndexManager().getColProbs(), dir_prior);
 	assert(search_record->getIndex());
 	retriever.retrieve(*search_record->getIndex(), *indexing::ValueMap::from(model.probs), scores);
 
@@ -89,6 +89,14 @@ void ResultListView::renderResult(TemplateData &t_result, UserSearchRecord &sear
 	else{
 		t_result.set("display_url", result.formatted_display_url, false);
 	}
+	string sources;
+	for (vector<pair<string, int> >::const_iterator itr = result.source_ranks.begin(); itr != result.source_ranks.end(); ++ itr){
+		if (! sources.empty()){
+			sources += ", ";
+		}
+		sources += itr->first + " #" + lexical_cast<string>(itr->second);
+	}
+	t_result.set("sources", sources);
 	string rating = search_record.getResultRating(result.original_rank);
 	t_result.set("rating", rating);
 }
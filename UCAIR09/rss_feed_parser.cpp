@@ -15,11 +15,12 @@ namespace ucair {
 RSSFeedParser::RSSFeedParser(const string &doc_producer_id, const string &url_) : DocProducer(doc_producer_id), url(url_) {
 }
 
-bool RSSFeedParser::produceDoc(DocStream &doc_stream) {
-	string source, err_msg;
-	if (! http::util::downloadPage(url, source, err_msg)) {
-		return false;
-	}
+bool RSSFeedParser::download(string &source) const {
+	string err_msg;
+	return http::util::downloadPage(url, source, err_msg);
+}
+
+bool RSSFeedParser::produceDoc(DocStream &doc_stream, const string &source) {
 	return parseRSSFeed(source, doc_stream);
 }
 
@@ -10,7 +10,8 @@ class RSSFeedParser : public DocProducer {
 public:
 	RSSFeedParser(const std::string &doc_producer_id, const std::string &url);
 
-	bool produceDoc(DocStream &doc_stream);
+	bool download(std::string &source) const;
+	bool produceDoc(DocStream &doc_stream, const std::string &source);
 
 private:
 	bool parseRSSFeed(const std::string &source, DocStream &doc_stream);
@@ -64,6 +64,23 @@ original_rank(original_rank_) {
 	doc_id = buildDocName(search_id, original_rank);
 }
 
+size_t SearchResult::estimateSize() const {
+	size_t size = stemmed_terms.capacity() * sizeof(string);
+	for (vector<string>::const_iterator itr = stemmed_terms.begin(); itr != stemmed_terms.end(); ++ itr){
+		size += itr->size();
+	}
+	size += source_ranks.capacity() * sizeof(pair<string, int>);
+	for (vector<pair<string, int> >::const_iterator itr = source_ranks.begin(); itr != source_ranks.end(); ++ itr){
+		size += itr->first.size();
+	}
+	return size + sizeof(SearchResult) + search_id.size() + doc_id.size()
+		+ title.size() + formatted_title.size()
+		+ url.size() + display_url.size() + formatted_display_url.size()
+		+ click_url.size() + cache_url.size()
+		+ summary.size() + formatted_summary.size()
+		+ source.size() + mime_type.size();
+}
+
 Search::Search(): total_result_count(0) {}
 
 bool Search::hasResults(int start_pos, int result_count) const {
@@ -87,6 +104,17 @@ const SearchResult* Search::getResult(int start_pos) const {
 	return &itr->second;
 }
 
+size_t Search::estimateSize() const {
+	size_t size = sizeof(Search) + query.text.size() + search_id.size() + search_engine_id.size() + fallback_search_engine_id.size();
+	for (map<int, SearchResult>::const_iterator itr = results.begin(); itr != results.end(); ++ itr){
+		size += itr->second.estimateSize();
+	}
+	for (map<string, int>::const_iterator itr = source_depths.begin(); itr != source_depths.end(); ++ itr){
+		size += sizeof(*itr) + itr->first.size();
+	}
+	return size;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 
 ExternalSearchEngine::ExternalSearchEngine(const string &id_, const string &name_, const string &search_link_queryless_, const string &search_link_query_prefix_) :
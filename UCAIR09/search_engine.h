@@ -33,8 +33,14 @@ public:
 	SearchResult();
 	SearchResult(const std::string &search_id, int original_rank);
 
+	/// Returns a rough estimate of the memory taken by the result, in bytes.
+	size_t estimateSize() const;
+
 	std::string search_id;
 	int original_rank;
+
+	/// Search engines the result came from, with the rank each gave it; set by federated search, otherwise empty.
+	std::vector<std::pair<std::string, int> > source_ranks;
 };
 
 /// A search instance with query and results.
@@ -55,9 +61,16 @@ public:
 	 */
 	const SearchResult* getResult(int start_pos) const;
 
+	/// Returns a rough estimate of the memory taken by the search and its results, in bytes.
+	size_t estimateSize() const;
+
     std::string getSearchEngineId() const { return search_engine_id; }
     void setSearchEngineId(const std::string &search_engine_id_) { search_engine_id = search_engine_id_; }
 
+    /// Id of the search engine that stood in for the one asked while it was down (see SearchEngineBreaker); empty if none did.
+    std::string getFallbackSearchEngineId() const { return fallback_search_engine_id; }
+    void setFallbackSearchEngineId(const std::string &fallback_search_engine_id_) { fallback_search_engine_id = fallback_search_engine_id_; }
+
     std::string getSearchId() const { return search_id; }
     void setSearchId(const std::string &search_id_) { search_id = search_id_; }
 
@@ -69,9 +82,15 @@ public:
     /// map from rank/pos to result
     std::map<int, SearchResult> results;
 
+    /*! \brief Rank of the last result taken from each search engine whose results were merged into these (see FederatedSearchEngine),
+     *  by search engine id; empty if the results came from one search engine. Each is asked for more results from the rank after.
+     */
+    std::map<std::string, int> source_depths;
+
 private:
     long long total_result_count; ///< search engine estimate of number of results
 	std::string search_engine_id; ///< search engine identifier
+	std::string fallback_search_engine_id; ///< search engine that gave the results in place of search_engine_id
 	std::string search_id; ///< search id
 };
 
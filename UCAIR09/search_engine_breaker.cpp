@@ -0,0 +1,153 @@
+#include "search_engine_breaker.h"
+#include <boost/format.hpp>
+#include "logger.h"
+
+using namespace std;
+using namespace boost;
+
+namespace ucair {
+
+SearchEngineBreaker::Options::Options():
+		ewma_weight(0.2),
+		max_error_rate(0.5),
+		max_latency(5000),
+		min_requests(5),
+		open_time(30) {
+}
+
+SearchEngineBreaker::Health::Health():
+		state(CLOSED),
+		error_rate(0.0),
+		latency(0.0),
+		request_count(0),
+		failure_count(0),
+		fast_failure_count(0),
+		fallback_count(0) {
+}
+
+SearchEngineBreaker::SearchEngineBreaker(const shared_ptr<SearchEngine> &base_search_engine_, const Options &options_):
+		base_search_engine(base_search_engine_),
+		options(options_),
+		requests_since_closed(0),
+		probing(false) {
+}
+
+string SearchEngineBreaker::getSearchEngineId() const {
+	return base_search_engine->getSearchEngineId();
+}
+
+string SearchEngineBreaker::getSearchEngineName() const {
+	return base_search_engine->getSearchEngineName();
+}
+
+int SearchEngineBreaker::maxAllowedResultCount() const {
+	return base_search_engine->maxAllowedResultCount();
+}
+
+SearchEngineBreaker::Health SearchEngineBreaker::getHealth() const {
+	mutex::scoped_lock lock(health_mutex);
+	return health;
+}
+
+string SearchEngineBreaker::toString(State state) {
+	switch (state) {
+	case CLOSED:
+		return "closed";
+	case OPEN:
+		return "open";
+	case HALF_OPEN:
+		return "half open";
+	}
+	return "";
+}
+
+bool SearchEngineBreaker::fetchResults(Search &search, int &start_pos, int &result_count) {
+	bool probe = false;
+	if (! admit(probe)) {
+		return fetchFallback(search, start_pos, result_count);
+	}
+	int asked_start_pos = start_pos;
+	int asked_result_count = result_count;
+	posix_time::ptime start_time = posix_time::microsec_clock::universal_time();
+	bool ok = base_search_engine->fetchResults(search, start_pos, result_count);
+	record(ok, probe, (double) (posix_time::microsec_clock::universal_time() - start_time).total_milliseconds());
+	if (ok) {
+		return true;
+	}
+	start_pos = asked_start_pos;
+	result_count = asked_result_count;
+	search.results.clear();
+	return fetchFallback(search, start_pos, result_count);
+}
+
+bool SearchEngineBreaker::admit(bool &probe) {
+	mutex::scoped_lock lock(health_mutex);
+	if (health.state == OPEN && posix_time::second_clock::universal_time() >= open_until) {
+		health.state = HALF_OPEN;
+		getLogger().info("Probing search engine " + getSearchEngineId());
+	}
+	if (health.state == CLOSED || (health.state == HALF_OPEN && ! probing)) {
+		if (health.state == HALF_OPEN) {
+			probing = true;
+			probe = true;
+		}
+		++ health.request_count;
+		return true;
+	}
+	++ health.fast_failure_count;
+	return false;
+}
+
+void SearchEngineBreaker::record(bool ok, bool probe, double latency) {
+	mutex::scoped_lock lock(health_mutex);
+	if (! ok) {
+		++ health.failure_count;
+	}
+	if (probe) {
+		probing = false;
+		if (ok) {
+			health.state = CLOSED;
+			health.error_rate = 0.0;
+			health.latency = latency;
+			requests_since_closed = 0;
+			getLogger().info("Search engine " + getSearchEngineId() + " is back; circuit breaker closed");
+			return;
+		}
+	}
+	else {
+		if (requests_since_closed == 0) {
+			health.error_rate = ok ? 0.0 : 1.0;
+			health.latency = latency;
+		}
+		else {
+			health.error_rate += options.ewma_weight * ((ok ? 0.0 : 1.0) - health.error_rate);
+			health.latency += options.ewma_weight * (latency - health.latency);
+		}
+		++ requests_since_closed;
+		if (health.state != CLOSED || requests_since_closed < options.min_requests
+				|| (health.error_rate <= options.max_error_rate && health.latency <= options.max_latency)) {
+			return;
+		}
+	}
+	health.state = OPEN;
+	open_until = posix_time::second_clock::universal_time() + posix_time::seconds(options.open_time);
+	requests_since_closed = 0;
+	getLogger().error(str(format("Circuit breaker of search engine %1% opened for %2% seconds (error rate %3$.2f, latency %4$.0f ms)")
+			% getSearchEngineId() % options.open_time % health.error_rate % health.latency));
+}
+
+bool SearchEngineBreaker::fetchFallback(Search &search, int &start_pos, int &result_count) {
+	if (! fallback) {
+		return false;
+	}
+	if (! fallback->fetchResults(search, start_pos, result_count)) {
+		return false;
+	}
+	// The results must not pass for those of the base search engine, e.g. in the result cache.
+	search.setFallbackSearchEngineId(fallback->getSearchEngineId());
+	mutex::scoped_lock lock(health_mutex);
+	++ health.fallback_count;
+	return true;
+}
+
+}
@@ -0,0 +1,103 @@
+#ifndef __search_engine_breaker_h__
+#define __search_engine_breaker_h__
+
+#include <string>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/smart_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include "search_engine.h"
+
+namespace ucair {
+
+/*! \brief Guards a base search engine with a circuit breaker, so that searches fail fast, or go to a fallback, while it is down.
+ *
+ *  The error rate and latency of the base search engine are tracked as exponentially weighted moving averages.
+ *  When either goes over its limit, the breaker opens: requests are not sent to the base search engine for a while,
+ *  but to the fallback search engine if there is one, or else fail at once. After that the breaker is half open:
+ *  one request is let through as a probe, and the breaker closes if it succeeds, or opens again if it fails.
+ *  While closed, a request that fails is retried on the fallback search engine.
+ *  The search engine takes the id and name of the base search engine, to stand in for it. Thread-safe.
+ */
+class SearchEngineBreaker: public SearchEngine {
+public:
+	enum State {
+		CLOSED, ///< requests go to the base search engine
+		OPEN, ///< requests fail fast, or go to the fallback
+		HALF_OPEN ///< a probe request goes to the base search engine
+	};
+
+	class Options {
+	public:
+		Options();
+
+		double ewma_weight; ///< weight of the latest request in the moving averages
+		double max_error_rate; ///< the breaker opens when the error rate goes over this
+		int max_latency; ///< the breaker opens when the latency goes over this, in milliseconds
+		int min_requests; ///< requests made since the breaker closed before it can open
+		int open_time; ///< seconds the breaker stays open before a probe
+	};
+
+	/// Health of the base search engine.
+	class Health {
+	public:
+		Health();
+
+		State state;
+		double error_rate; ///< moving average of failures (1) and successes (0)
+		double latency; ///< moving average of latency in milliseconds
+		long long request_count; ///< requests sent to the base search engine
+		long long failure_count; ///< requests to the base search engine that failed
+		long long fast_failure_count; ///< requests not sent to the base search engine as the breaker was open
+		long long fallback_count; ///< requests served by the fallback search engine
+	};
+
+	/*! \brief Constructor.
+	 *  \param base_search_engine search engine to guard
+	 *  \param options when the breaker opens and closes
+	 */
+	SearchEngineBreaker(const boost::shared_ptr<SearchEngine> &base_search_engine, const Options &options = Options());
+
+	/// Sets the search engine used while the base search engine is down; NULL for none.
+	void setFallback(const boost::shared_ptr<SearchEngine> &fallback_search_engine) { fallback = fallback_search_engine; }
+
+	std::string getSearchEngineId() const;
+	std::string getSearchEngineName() const;
+
+	/*! \brief Retrieves results for a query from the base search engine, or the fallback while the base search engine is down.
+	 *  \return false if neither gave results, or if the breaker is open and there is no fallback
+	 */
+	bool fetchResults(Search &search, int &start_pos, int &result_count);
+	int maxAllowedResultCount() const;
+
+	/// Returns the current health of the base search engine.
+	Health getHealth() const;
+
+	/// Returns the name of a state, e.g. "half open".
+	static std::string toString(State state);
+
+private:
+	/*! \brief Decides whether a request goes to the base search engine, moving from open to half open when it is time to probe.
+	 *  \param[out] probe set to true if the request is the probe
+	 */
+	bool admit(bool &probe);
+
+	/// Records the outcome of a request to the base search engine, opening or closing the breaker as needed.
+	void record(bool ok, bool probe, double latency);
+
+	/// Retrieves results from the fallback search engine, if any, and marks the search as served by it.
+	bool fetchFallback(Search &search, int &start_pos, int &result_count);
+
+	boost::shared_ptr<SearchEngine> base_search_engine;
+	boost::shared_ptr<SearchEngine> fallback;
+	Options options;
+
+	mutable boost::mutex health_mutex;
+	Health health;
+	int requests_since_closed;
+	bool probing; ///< whether a probe is in flight
+	boost::posix_time::ptime open_until;
+};
+
+}
+
+#endif
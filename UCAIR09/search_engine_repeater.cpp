@@ -1,12 +1,19 @@
 #include "search_engine_repeater.h"
+#include <algorithm>
+#include <vector>
+#include <boost/bind.hpp>
+#include <boost/foreach.hpp>
+#include <boost/thread.hpp>
+#include "main.h"
 
 using namespace std;
 using namespace boost;
 
 namespace ucair {
 
-SearchEngineRepeater::SearchEngineRepeater(const shared_ptr<SearchEngine> &base_search_engine_):
-		base_search_engine(base_search_engine_) {
+SearchEngineRepeater::SearchEngineRepeater(const shared_ptr<SearchEngine> &base_search_engine_, int max_concurrent_fetches_):
+		base_search_engine(base_search_engine_),
+		max_concurrent_fetches(max_concurrent_fetches_ > 0 ? max_concurrent_fetches_ : 1) {
 }
 
 string SearchEngineRepeater::getSearchEngineId() const {
@@ -19,25 +26,95 @@ string SearchEngineRepeater::getSearchEngineName() const {
 
 bool SearchEngineRepeater::fetchResults(Search &search, int &start_pos, int &result_count) {
 	int end_pos = start_pos + result_count - 1;
-	int s = start_pos;
-	int r = result_count;
-	bool first_fetch = true;
-	while (true) {
-		bool ok = base_search_engine->fetchResults(search, s, r);
-		if (! ok) {
-			return false;
+	int page_size = max(base_search_engine->maxAllowedResultCount(), 1);
+	int first_start_pos = 0; // start pos of the first page that arrived; 0 if none yet
+	int covered_end_pos = start_pos - 1; // results up to here have arrived without a gap
+	bool all_ok = true;
+	// Usually one round does. The base search engine may move a page to fit its own paging though,
+	// in which case what is still missing is fetched in another round.
+	while (all_ok && covered_end_pos < end_pos) {
+		shared_ptr<PageFetches> fetches(new PageFetches);
+		fetches->base_search_engine = base_search_engine;
+		vector<PageFetch> &pages = fetches->pages;
+		for (int s = covered_end_pos + 1; s <= end_pos; s += page_size) {
+			pages.push_back(PageFetch());
+			PageFetch &page = pages.back();
+			page.search.query = search.query;
+			page.search.setSearchId(search.getSearchId());
+			page.search.setSearchEngineId(search.getSearchEngineId());
+			page.start_pos = s;
+			page.result_count = min(page_size, end_pos - s + 1);
+			page.ok = false;
+		}
+
+		fetches->next_page = 0;
+		fetches->unfinished_count = pages.size();
+
+		// This thread fetches pages too, so the round completes even if no worker thread is free to help.
+		int helper_count = min(static_cast<int>(pages.size()), max_concurrent_fetches) - 1;
+		for (int i = 0; i < helper_count; ++ i) {
+			Main::instance().postBlocking(bind(&SearchEngineRepeater::fetchPages, fetches), function<void ()>());
 		}
-		if (first_fetch) {
-			start_pos = s;
-			first_fetch = false;
+		fetchPages(fetches);
+		{
+			// Pages taken by helpers are being fetched already.
+			mutex::scoped_lock lock(fetches->pages_mutex);
+			while (fetches->unfinished_count > 0) {
+				fetches->page_fetched.wait(lock);
+			}
 		}
-		s += r;
-		if (s > end_pos) {
-			result_count = s - start_pos;
+
+		// Merge pages in rank order.
+		int last_covered_end_pos = covered_end_pos;
+		BOOST_FOREACH(const PageFetch &page, pages) {
+			// A page served by a fallback of the base search engine (see SearchEngineBreaker) is not mixed with pages served by the base.
+			if (! page.ok || (first_start_pos != 0 && page.search.getFallbackSearchEngineId() != search.getFallbackSearchEngineId())) {
+				all_ok = false;
+				continue;
+			}
+			if (first_start_pos == 0) {
+				first_start_pos = page.start_pos;
+				covered_end_pos = page.start_pos - 1;
+				search.setTotalResultCount(page.search.getTotalResultCount());
+				search.setFallbackSearchEngineId(page.search.getFallbackSearchEngineId());
+			}
+			for (map<int, SearchResult>::const_iterator itr = page.search.results.begin(); itr != page.search.results.end(); ++ itr) {
+				search.results[itr->first] = itr->second;
+			}
+			// A page that failed leaves a gap.
+			if (page.start_pos <= covered_end_pos + 1) {
+				covered_end_pos = max(covered_end_pos, page.start_pos + page.result_count - 1);
+			}
+		}
+		if (covered_end_pos <= last_covered_end_pos) {
 			break;
 		}
 	}
+	if (first_start_pos == 0) {
+		return false;
+	}
+	start_pos = first_start_pos;
+	result_count = max(covered_end_pos - start_pos + 1, 0);
 	return true;
 }
 
+void SearchEngineRepeater::fetchPages(const shared_ptr<PageFetches> &fetches) {
+	while (true) {
+		PageFetch *page = NULL;
+		{
+			mutex::scoped_lock lock(fetches->pages_mutex);
+			if (fetches->next_page >= fetches->pages.size()) {
+				return;
+			}
+			page = &fetches->pages[fetches->next_page ++];
+		}
+		page->ok = fetches->base_search_engine->fetchResults(page->search, page->start_pos, page->result_count);
+		{
+			mutex::scoped_lock lock(fetches->pages_mutex);
+			-- fetches->unfinished_count;
+		}
+		fetches->page_fetched.notify_all();
+	}
+}
+
 }
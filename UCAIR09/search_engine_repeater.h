@@ -2,23 +2,68 @@
 #define __search_engine_repeater_h__
 
 #include <string>
+#include <vector>
 #include <boost/smart_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
 #include "search_engine.h"
 
 namespace ucair {
 
-/// Allows one to send repeated requests to a base search engine, thus to circumvent the max allowed result limit.
+/*! \brief Allows one to send repeated requests to a base search engine, thus to circumvent the max allowed result limit.
+ *
+ *  The pages needed are requested from the base search engine at the same time, on worker threads (see Main::postBlocking),
+ *  so that fetching several pages takes about as long as fetching one.
+ */
 class SearchEngineRepeater: public SearchEngine {
 public:
-	SearchEngineRepeater(const boost::shared_ptr<SearchEngine> &base_search_engine);
+	/*! \brief Constructor.
+	 *  \param base_search_engine search engine to send requests to
+	 *  \param max_concurrent_fetches max number of pages being fetched from the base search engine at a time for one search
+	 */
+	SearchEngineRepeater(const boost::shared_ptr<SearchEngine> &base_search_engine, int max_concurrent_fetches = 4);
 
 	std::string getSearchEngineId() const;
 	std::string getSearchEngineName() const;
+
+	/*! \brief Retrieves results for a query, fetching pages concurrently.
+	 *
+	 *  If some pages fail, the results that did arrive are kept; start_pos and result_count then cover
+	 *  the results that arrived without a gap from the first page.
+	 *  \return true if at least one page arrived
+	 */
 	bool fetchResults(Search &search, int &start_pos, int &result_count);
 	int maxAllowedResultCount() const { return 100; }
 
 private:
+	/// A page requested from the base search engine.
+	class PageFetch {
+	public:
+		Search search; ///< receives results of the page only
+		int start_pos;
+		int result_count;
+		bool ok;
+	};
+
+	/// Pages of one round, shared by the threads fetching them.
+	class PageFetches {
+	public:
+		boost::shared_ptr<SearchEngine> base_search_engine;
+		std::vector<PageFetch> pages; ///< must not be resized while pages are fetched
+		size_t next_page; ///< first page not taken by a thread yet
+		size_t unfinished_count; ///< number of pages not fetched yet
+		boost::mutex pages_mutex;
+		boost::condition_variable page_fetched;
+	};
+
+	/*! \brief Takes pages that no thread has taken yet and fetches them, until none is left.
+	 *  Run by the thread calling fetchResults and by helpers posted to worker threads. A helper that starts late finds nothing to do.
+	 */
+	static void fetchPages(const boost::shared_ptr<PageFetches> &fetches);
+
 	boost::shared_ptr<SearchEngine> base_search_engine;
+
+	int max_concurrent_fetches;
 };
 
 }
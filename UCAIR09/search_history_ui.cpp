@@ -9,6 +9,7 @@
 #include "index_manager.h"
 #include "index_util.h"
 #include "logger.h"
+#include "long_term_history_manager.h"
 #include "template_engine.h"
 #include "ucair_server.h"
 #include "ucair_util.h"
@@ -21,6 +22,9 @@ using namespace templating;
 
 namespace ucair {
 
+/// Number of searches shown on a page.
+static const int SEARCH_COUNT = 10;
+
 string SearchHistoryMenuItem::getName(const Request &request) const {
 	return "Search history";
 }
@@ -52,18 +56,16 @@ bool SearchHistoryMenuItem::isActive(const Request &request) const {
 }
 
 bool SearchHistoryUI::initialize(){
-	getUCAIRServer().registerHandler(RequestHandler::CGI_HTML, "/history_search", bind(&SearchHistoryUI::displaySearchHistory, this, _1, _2));
+	getUCAIRServer().registerAsyncHandler(RequestHandler::CGI_HTML, "/history_search", bind(&SearchHistoryUI::displaySearchHistory, this, _1, _2, _3));
 	getSearchMenu().addMenuItem(shared_ptr<SearchHistoryMenuItem>(new SearchHistoryMenuItem));
 	return true;
 }
 
-void SearchHistoryUI::displaySearchHistory(Request &request, Reply &reply) {
+void SearchHistoryUI::displaySearchHistory(Request &request, Reply &reply, const RequestHandler::Completion &completion) {
 	User *user = getUserManager().getUser(request, true);
 	assert(user);
 
 	string query = request.getFormData("query");
-	string encoded_query;
-	http::util::urlEncode(query, encoded_query);
 
 	int start_pos = 1;
 	try {
@@ -78,7 +80,7 @@ void SearchHistoryUI::displaySearchHistory(Request &request, Reply &reply) {
 	catch (bad_lexical_cast &){
 	}
 
-	int search_count = 10;
+	int search_count = SEARCH_COUNT;
 	int total_search_count = 0;
 	vector<string> search_ids_in_page;
 
@@ -113,6 +115,25 @@ void SearchHistoryUI::displaySearchHistory(Request &request, Reply &reply) {
 		}
 	}
 
+	// Results of searches from long-term history are read from the database without holding up the server.
+	getLongTermHistoryManager().asyncLoadResults(search_ids_in_page,
+			bind(&SearchHistoryUI::onResultsLoaded, this, ref(request), ref(reply), start_pos, total_search_count, search_ids_in_page, completion));
+}
+
+void SearchHistoryUI::onResultsLoaded(Request &request, Reply &reply, int start_pos, int total_search_count, const vector<string> &search_ids_in_page,
+		const RequestHandler::Completion &completion) {
+	completion.resume(bind(&SearchHistoryUI::renderSearchHistory, this, ref(request), ref(reply), start_pos, total_search_count, search_ids_in_page));
+}
+
+void SearchHistoryUI::renderSearchHistory(Request &request, Reply &reply, int start_pos, int total_search_count, const vector<string> &search_ids_in_page) {
+	User *user = getUserManager().getUser(request, true);
+	assert(user);
+
+	string query = request.getFormData("query");
+	string encoded_query;
+	http::util::urlEncode(query, encoded_query);
+	int search_count = SEARCH_COUNT;
+
 	try {
 		TemplateData t_main;
 		t_main.set("user_id", user->getUserId())
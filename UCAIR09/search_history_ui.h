@@ -6,12 +6,10 @@
 #include <vector>
 #include "component.h"
 #include "search_menu.h"
+#include "ucair_server.h"
 
 namespace ucair {
 
-class Request;
-class Reply;
-
 /// Search menu item that links to this search history page.
 class SearchHistoryMenuItem: public SearchMenuItem {
 public:
@@ -27,9 +25,14 @@ public:
 	bool initialize();
 
 	/// Page handler to list searches from the history.
-	void displaySearchHistory(Request &request, Reply &reply);
+	void displaySearchHistory(Request &request, Reply &reply, const RequestHandler::Completion &completion);
 
 private:
+	/// Called in the application strand once results of the searches to list are loaded.
+	void onResultsLoaded(Request &request, Reply &reply, int start_pos, int total_search_count, const std::vector<std::string> &search_ids_in_page,
+			const RequestHandler::Completion &completion);
+	/// Renders the search history page.
+	void renderSearchHistory(Request &request, Reply &reply, int start_pos, int total_search_count, const std::vector<std::string> &search_ids_in_page);
 
 	std::map<std::string, std::vector<std::string> > cached_searches;
 };
@@ -88,17 +88,13 @@ void WeightedClickModelGen::countTermsWeighted(const UserSearchRecord &search_re
 				string doc_name = buildDocName(search_record.getSearchId(), result_pos);
 				int doc_id = index->getDocDict().getId(doc_name);
 				if (doc_id > 0) {
-					const vector<pair<int, float> >* term_list = index->getTermList(doc_id);
-					if (term_list) {
-						typedef pair<int, float> P2;
-						BOOST_FOREACH(const P2 &p2, *term_list) {
-							int term_id = p2.first;
-							double term_weight = p2.second * (clicked ? clicked_result_term_weight : unclicked_result_term_weight);
-							if (term_weight > 0.0) {
-								map<int, double>::iterator itr;
-								tie(itr, tuples::ignore) = term_counts.insert(make_pair(term_id, 0.0));
-								itr->second += term_weight;
-							}
+					for (indexing::PostingList::Iterator term_itr = index->getTermList(doc_id).iterator(); term_itr.ok(); term_itr.next()) {
+						int term_id = term_itr.id();
+						double term_weight = term_itr.weight() * (clicked ? clicked_result_term_weight : unclicked_result_term_weight);
+						if (term_weight > 0.0) {
+							map<int, double>::iterator itr;
+							tie(itr, tuples::ignore) = term_counts.insert(make_pair(term_id, 0.0));
+							itr->second += term_weight;
 						}
 					}
 				}
@@ -144,10 +140,11 @@ SearchModel MixtureModelGen::getModel(const UserSearchRecord &search_record, con
 
 	map<int, double> term_counts;
 	countTermsWeighted(search_record, search, term_counts);
+	const indexing::ColProbs &col_probs = getIndexManager().getColProbs();
 	vector<tuple<double, double, double> > values;
 	for (map<int, double>::const_iterator itr = term_counts.begin(); itr != term_counts.end(); ++ itr) {
 		double f = itr->second;
-		double p = getIndexManager().getColProb(itr->first);
+		double p = col_probs.get(itr->first);
 		values.push_back(make_tuple(f, p, 0.0));
 	}
 	estimateMixture(values, bg_coeff);
@@ -201,17 +198,13 @@ SearchModel RelevanceFeedbackModelGen::getModel(const UserSearchRecord &search_r
 				string doc_name = buildDocName(search_record.getSearchId(), result_pos);
 				int doc_id = index->getDocDict().getId(doc_name);
 				if (doc_id > 0) {
-					const vector<pair<int, float> >* term_list = index->getTermList(doc_id);
-					if (term_list) {
-						typedef pair<int, float> P2;
-						BOOST_FOREACH(const P2 &p2, *term_list) {
-							int term_id = p2.first;
-							double term_weight = p2.second;
-							if (term_weight > 0.0) {
-								map<int, double>::iterator itr;
-								tie(itr, tuples::ignore) = term_counts.insert(make_pair(term_id, 0.0));
-								itr->second += term_weight;
-							}
+					for (indexing::PostingList::Iterator term_itr = index->getTermList(doc_id).iterator(); term_itr.ok(); term_itr.next()) {
+						int term_id = term_itr.id();
+						double term_weight = term_itr.weight();
+						if (term_weight > 0.0) {
+							map<int, double>::iterator itr;
+							tie(itr, tuples::ignore) = term_counts.insert(make_pair(term_id, 0.0));
+							itr->second += term_weight;
 						}
 					}
 				}
@@ -219,10 +212,11 @@ SearchModel RelevanceFeedbackModelGen::getModel(const UserSearchRecord &search_r
 		}
 	}
 
+	const indexing::ColProbs &col_probs = getIndexManager().getColProbs();
 	vector<tuple<double, double, double> > values;
 	for (map<int, double>::const_iterator itr = term_counts.begin(); itr != term_counts.end(); ++ itr) {
 		double f = itr->second;
-		double p = getIndexManager().getColProb(itr->first);
+		double p = col_probs.get(itr->first);
 		values.push_back(make_tuple(f, p, 0.0));
 	}
 	estimateMixture(values, bg_coeff);
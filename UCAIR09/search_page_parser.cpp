@@ -0,0 +1,324 @@
+#include "search_page_parser.h"
+#include <cctype>
+#include <boost/algorithm/string.hpp>
+#include <boost/bind.hpp>
+#include "index_util.h"
+#include "ucair_util.h"
+#include "xml_util.h"
+
+using namespace std;
+using namespace boost;
+using html::Token;
+
+namespace {
+
+/// Removes <strong> tags, and unescapes entities.
+string toPlainText(const string &formatted){
+	if (formatted.find('<') == string::npos){
+		return xml::util::unquote(formatted);
+	}
+	string s = erase_all_copy(formatted, "<strong>");
+	erase_all(s, "</strong>");
+	return xml::util::unquote(s);
+}
+
+bool isBold(const string &tag_name){
+	return tag_name == "b" || tag_name == "strong";
+}
+
+} // anonymous namespace
+
+namespace ucair {
+
+PageSelector::PageSelector(){
+}
+
+PageSelector::PageSelector(const string &tag_name_, const string &attr_name_, const string &attr_value_):
+	tag_name(tag_name_),
+	attr_name(attr_name_),
+	attr_value(attr_value_)
+{
+}
+
+PageSelector PageSelector::text(const string &phrase){
+	PageSelector selector;
+	selector.phrase = phrase;
+	return selector;
+}
+
+bool PageSelector::matches(const Token &token) const {
+	if (! phrase.empty()){
+		return token.type == Token::TEXT && token.text.find(phrase) != string::npos;
+	}
+	if (token.type != Token::START_TAG || token.name != tag_name){
+		return false;
+	}
+	if (attr_name.empty()){
+		return true;
+	}
+	const string *p = token.findAttr(attr_name);
+	if (! p){
+		return false;
+	}
+	const string &value = *p;
+	if (attr_value.empty()){
+		return true;
+	}
+	if (attr_name != "class"){
+		return value == attr_value;
+	}
+	// One of the space separated classes.
+	for (size_t pos = value.find(attr_value); pos != string::npos; pos = value.find(attr_value, pos + 1)){
+		size_t end = pos + attr_value.size();
+		if ((pos == 0 || isspace(value[pos - 1])) && (end == value.size() || isspace(value[end]))){
+			return true;
+		}
+	}
+	return false;
+}
+
+SearchPageParser::Capture::Capture():
+	depth(0),
+	done(false)
+{
+}
+
+void SearchPageParser::Capture::start(const Token &token){
+	depth = 1;
+	done = false;
+	tag_name = token.name;
+	formatted.clear();
+	link.clear();
+	if (token.name == "a"){
+		token.getAttr("href", link);
+	}
+	if (token.self_closing || html::Tokenizer::isVoidElement(token.name)){
+		depth = 0;
+		done = true;
+	}
+}
+
+bool SearchPageParser::Capture::add(const Token &token){
+	switch (token.type){
+	case Token::TEXT:
+		formatted += token.text;
+		break;
+	case Token::START_TAG:
+		if (token.name == tag_name && ! token.self_closing){
+			++ depth;
+		}
+		if (isBold(token.name)){
+			formatted += "<strong>";
+		}
+		else if (token.name == "a" && link.empty()){
+			token.getAttr("href", link);
+		}
+		break;
+	case Token::END_TAG:
+		if (token.name == tag_name && -- depth == 0){
+			done = true;
+			return true;
+		}
+		if (isBold(token.name)){
+			formatted += "</strong>";
+		}
+		break;
+	default:
+		break;
+	}
+	return false;
+}
+
+SearchPageParser::SearchPageParser(const SearchPageLayout &layout_, const ResultCallback &callback_):
+	layout(layout_),
+	callback(callback_),
+	in_raw_text(false)
+{
+	for (map<string, SearchPageLayout::Field>::const_iterator itr = layout.fields.begin(); itr != layout.fields.end(); ++ itr){
+		field_rules.push_back(make_pair(&itr->second, itr->first));
+		anchored.push_back(itr->second.anchor.empty());
+	}
+	field_captures.resize(field_rules.size());
+}
+
+void SearchPageParser::feed(const char *data, size_t size){
+	tokenizer.feed(data, size);
+	while (tokenizer.next(token)){
+		process(token);
+	}
+}
+
+void SearchPageParser::finish(){
+	tokenizer.finish();
+	while (tokenizer.next(token)){
+		process(token);
+	}
+	if (result.depth > 0){
+		// The page is cut off.
+		endResult();
+	}
+}
+
+bool SearchPageParser::getField(const string &name, string &value) const {
+	map<string, string>::const_iterator itr = field_values.find(name);
+	if (itr == field_values.end()){
+		return false;
+	}
+	value = itr->second;
+	return true;
+}
+
+vector<long long> SearchPageParser::parseNumbers(const string &text){
+	vector<long long> numbers;
+	long long number = 0;
+	bool in_number = false;
+	for (size_t i = 0; i < text.size(); ++ i){
+		char c = text[i];
+		if (c >= '0' && c <= '9'){
+			number = number * 10 + (c - '0');
+			in_number = true;
+		}
+		else if (c == ',' && in_number && i + 1 < text.size() && isdigit(text[i + 1])){
+			// Thousands separator
+		}
+		else if (in_number){
+			numbers.push_back(number);
+			number = 0;
+			in_number = false;
+		}
+	}
+	if (in_number){
+		numbers.push_back(number);
+	}
+	return numbers;
+}
+
+void SearchPageParser::process(const Token &token){
+	// Skip the content of scripts and style sheets.
+	bool raw_text = in_raw_text;
+	in_raw_text = false;
+	if (raw_text && token.type == Token::TEXT){
+		return;
+	}
+	if (token.type == Token::START_TAG && ! token.self_closing && (token.name == "script" || token.name == "style")){
+		in_raw_text = true;
+		return;
+	}
+	if (token.type == Token::COMMENT){
+		return;
+	}
+
+	for (size_t i = 0; i < field_rules.size(); ++ i){
+		Capture &capture = field_captures[i];
+		const SearchPageLayout::Field &field = *field_rules[i].first;
+		if (capture.done){
+			continue;
+		}
+		if (capture.depth > 0){
+			if (capture.add(token)){
+				field_values[field_rules[i].second] = toPlainText(capture.formatted);
+			}
+		}
+		else if (! anchored[i]){
+			anchored[i] = field.anchor.matches(token);
+		}
+		else if (field.element.matches(token)){
+			capture.start(token);
+			if (capture.done){
+				field_values[field_rules[i].second] = "";
+			}
+		}
+	}
+
+	if (result.depth == 0){
+		if (layout.result.matches(token)){
+			result.start(token);
+		}
+		return;
+	}
+	if (layout.result.matches(token)){
+		// The previous result has not been closed.
+		endResult();
+		result.start(token);
+		return;
+	}
+	Capture* parts[] = {&title, &summary, &display_url, &mime_type};
+	const PageSelector* selectors[] = {&layout.title, &layout.summary, &layout.display_url, &layout.mime_type};
+	for (size_t i = 0; i < sizeof(parts) / sizeof(parts[0]); ++ i){
+		if (parts[i]->depth > 0){
+			parts[i]->add(token);
+		}
+		else if (! parts[i]->done && ! selectors[i]->empty() && selectors[i]->matches(token)){
+			parts[i]->start(token);
+		}
+	}
+	// Only the depth matters for the result element itself.
+	if (token.type != Token::TEXT && result.add(token)){
+		endResult();
+	}
+}
+
+void SearchPageParser::endResult(){
+	SearchResult search_result;
+	search_result.url = xml::util::unquote(title.link);
+	search_result.click_url = search_result.url;
+	search_result.formatted_title = title.formatted;
+	search_result.title = toPlainText(title.formatted);
+	search_result.formatted_summary = summary.formatted;
+	search_result.summary = toPlainText(summary.formatted);
+	search_result.display_url = toPlainText(display_url.formatted);
+	search_result.mime_type = toPlainText(mime_type.formatted);
+
+	Capture* captures[] = {&result, &title, &summary, &display_url, &mime_type};
+	for (size_t i = 0; i < sizeof(captures) / sizeof(captures[0]); ++ i){
+		*captures[i] = Capture();
+	}
+	callback(*this, search_result);
+}
+
+SearchPageReader::SearchPageReader(Search &search_, const SearchPageLayout &layout):
+	search(search_),
+	next_pos(-1),
+	result_count(0),
+	parser(layout, bind(&SearchPageReader::addResult, this, _1, _2))
+{
+}
+
+void SearchPageReader::finish(){
+	parser.finish();
+	string text;
+	if (parser.getField("total_count", text)){
+		vector<long long> numbers = SearchPageParser::parseNumbers(text);
+		if (! numbers.empty()){
+			search.setTotalResultCount(numbers.back());
+		}
+	}
+	if (parser.getField("spell_suggestion", text)){
+		search.query.spell_suggestion = text;
+	}
+}
+
+void SearchPageReader::addResult(const SearchPageParser &parser, SearchResult &result){
+	if (result.url.empty() || result.title.empty()){
+		return;
+	}
+	if (next_pos < 0){
+		next_pos = 0;
+		string text;
+		if (parser.getField("start_pos", text)){
+			vector<long long> numbers = SearchPageParser::parseNumbers(text);
+			if (! numbers.empty()){
+				next_pos = static_cast<int>(numbers.front());
+			}
+		}
+	}
+	result.search_id = search.getSearchId();
+	result.original_rank = next_pos ++;
+	result.doc_id = buildDocName(result.search_id, result.original_rank);
+	// Stem now, while the rest of the page downloads, rather than when the result is indexed.
+	indexing::extractTerms(result.title + " " + result.summary, result.stemmed_terms);
+	search.results[result.original_rank] = result;
+	++ result_count;
+}
+
+} // namespace ucair
@@ -0,0 +1,165 @@
+#ifndef __search_page_parser_h__
+#define __search_page_parser_h__
+
+#include <map>
+#include <string>
+#include <vector>
+#include <boost/function.hpp>
+#include <boost/utility.hpp>
+#include "html_tokenizer.h"
+#include "search_engine.h"
+
+namespace ucair {
+
+/// Selects elements, or text, on a search page.
+class PageSelector {
+public:
+	PageSelector();
+
+	/*! \brief Selects elements by tag name, and optionally by attribute.
+	 *  \param tag_name tag name in lower case
+	 *  \param attr_name attribute the element must have, if not empty
+	 *  \param attr_value value the attribute must have, if not empty (for class, one of the classes)
+	 */
+	PageSelector(const std::string &tag_name, const std::string &attr_name = "", const std::string &attr_value = "");
+
+	/// Selects text containing a phrase.
+	static PageSelector text(const std::string &phrase);
+
+	/// Whether a token is selected.
+	bool matches(const html::Token &token) const;
+
+	bool empty() const { return tag_name.empty() && phrase.empty(); }
+
+	std::string tag_name;
+	std::string attr_name;
+	std::string attr_value;
+	std::string phrase;
+};
+
+/// Where results and other information are on the search pages of a search engine.
+class SearchPageLayout {
+public:
+	PageSelector result; ///< element holding a result
+	PageSelector title; ///< element in a result holding its title; the result url is its link, or the first link in it
+	PageSelector summary; ///< element in a result holding its summary
+	PageSelector display_url; ///< element in a result holding its display url
+	PageSelector mime_type; ///< element in a result holding its file type, e.g. "[PDF]"
+
+	/// Text on a page, outside results.
+	class Field {
+	public:
+		PageSelector anchor; ///< if not empty, the element is looked for only after this
+		PageSelector element; ///< element holding the text
+	};
+	/// Fields by name.
+	std::map<std::string, Field> fields;
+};
+
+/*! \brief Extracts search results from the HTML of a search page, in a single pass.
+ *
+ *  Input can be fed in pieces as it is downloaded. Each result is handed to a callback as soon as its element ends.
+ *  In result titles and summaries, <b> and <strong> become <strong> and other tags are removed;
+ *  plain text versions have no tags and entities unescaped.
+ */
+class SearchPageParser: private boost::noncopyable {
+public:
+	/*! \brief Receives a result.
+	 *
+	 *  Url, click url, titles, summaries, display url and mime type are set; others are left to the callback.
+	 *  Fields that appear before the result on the page can be read from the parser.
+	 */
+	typedef boost::function<void (const SearchPageParser &parser, SearchResult &result)> ResultCallback;
+
+	SearchPageParser(const SearchPageLayout &layout, const ResultCallback &callback);
+
+	/// Parses more of the page.
+	void feed(const char *data, size_t size);
+
+	/// Parses the rest of the page, after all of it has been fed.
+	void finish();
+
+	/*! \brief Gets the text of a field, as plain text.
+	 *  \return false if the field has not been found (yet)
+	 */
+	bool getField(const std::string &name, std::string &value) const;
+
+	/// Returns the numbers in a text, e.g. 1, 10 and 1234 for "1-10 of 1,234 results".
+	static std::vector<long long> parseNumbers(const std::string &text);
+
+private:
+	/// Content of an element being extracted.
+	class Capture {
+	public:
+		Capture();
+		/// Starts with the start tag of the element.
+		void start(const html::Token &token);
+		/// Adds a token in the element; returns true when the element ends.
+		bool add(const html::Token &token);
+
+		int depth; ///< number of open elements with the same tag name; 0 if not capturing
+		bool done;
+		std::string tag_name;
+		std::string formatted; ///< content with only <strong> tags
+		std::string link; ///< first link in the element
+	};
+
+	/// Handles a token.
+	void process(const html::Token &token);
+	/// Hands the current result to the callback.
+	void endResult();
+
+	const SearchPageLayout &layout;
+	ResultCallback callback;
+
+	html::Tokenizer tokenizer;
+	html::Token token;
+	bool in_raw_text; ///< whether the next text token is the content of a script or style element
+
+	std::vector<std::pair<const SearchPageLayout::Field*, std::string> > field_rules; ///< fields of the layout, with their names
+	std::vector<bool> anchored; ///< whether the anchor of each field rule has been seen
+	std::vector<Capture> field_captures;
+	std::map<std::string, std::string> field_values;
+
+	Capture result;
+	Capture title;
+	Capture summary;
+	Capture display_url;
+	Capture mime_type;
+};
+
+/*! \brief Reads results on a search page into a search.
+ *
+ *  Results are ranked in the order they appear, starting from the first number in field "start_pos" (0 if absent);
+ *  those without a url or title are skipped. The total result count is taken from the last number in field "total_count",
+ *  and the spell suggestion from field "spell_suggestion". Terms of each result are stemmed as it is added, ready for indexing.
+ */
+class SearchPageReader: private boost::noncopyable {
+public:
+	/*! \param search search that receives results; if it already has results from other pages, they are kept
+	 *  \param layout layout of the page
+	 */
+	SearchPageReader(Search &search, const SearchPageLayout &layout);
+
+	/// Reads more of the page; results that are complete are added right away.
+	void feed(const char *data, size_t size) { parser.feed(data, size); }
+
+	/// Reads the rest of the page, and sets the total result count and spell suggestion.
+	void finish();
+
+	/// Returns the number of results added so far.
+	int getResultCount() const { return result_count; }
+
+private:
+	/// Receives results from the parser.
+	void addResult(const SearchPageParser &parser, SearchResult &result);
+
+	Search &search;
+	int next_pos; ///< rank of the next result; -1 until the first result
+	int result_count;
+	SearchPageParser parser;
+};
+
+} // namespace ucair
+
+#endif
@@ -1,7 +1,9 @@
 #include "search_proxy.h"
 #include <cassert>
 #include <iostream>
+#include <boost/algorithm/string.hpp>
 #include <boost/bind.hpp>
+#include <boost/filesystem.hpp>
 #include <boost/foreach.hpp>
 #include <boost/format.hpp>
 #include <boost/thread.hpp>
@@ -9,10 +11,16 @@
 #include "bing_wrapper.h"
 #include "common_util.h"
 #include "config.h"
+#include "federated_search_engine.h"
 #include "logger.h"
+#include "long_term_history_manager.h"
+#include "recorded_search_engine.h"
+#include "search_engine_breaker.h"
 #include "search_engine_repeater.h"
+#include "ucair_server.h"
 #include "ucair_util.h"
 #include "user.h"
+#include "user_manager.h"
 #include "yahoo_boss_api.h"
 
 using namespace std;
@@ -39,22 +47,125 @@ list<SearchEngine*> SearchProxy::getAllSearchEngines() const {
 
 bool SearchProxy::initialize(){
 	//shared_ptr<SearchEngine> yahoo(new YahooBossAPI);
-	//shared_ptr<SearchEngine> aol(new AOLWrapper);
+	shared_ptr<SearchEngine> aol(new AOLWrapper);
+	aol = makeRecorded(aol);
 	//shared_ptr<SearchEngine> aolr(new SearchEngineRepeater(aol));
 	shared_ptr<SearchEngine> bing(new BingWrapper);
-	shared_ptr<SearchEngine> bingr(new SearchEngineRepeater(bing));
+	bing = makeRecorded(bing);
+
+	// Circuit breakers, which send searches to the fallback search engine while a search engine is down.
+	SearchEngineBreaker::Options breaker_options;
+	breaker_options.ewma_weight = util::getParam<double>(Main::instance().getConfig(), "breaker_ewma_weight");
+	breaker_options.max_error_rate = util::getParam<double>(Main::instance().getConfig(), "breaker_max_error_rate");
+	breaker_options.max_latency = util::getParam<int>(Main::instance().getConfig(), "breaker_max_latency");
+	breaker_options.min_requests = util::getParam<int>(Main::instance().getConfig(), "breaker_min_requests");
+	breaker_options.open_time = util::getParam<int>(Main::instance().getConfig(), "breaker_open_time");
+	shared_ptr<SearchEngineBreaker> bing_breaker(new SearchEngineBreaker(bing, breaker_options));
+	shared_ptr<SearchEngineBreaker> aol_breaker(new SearchEngineBreaker(aol, breaker_options));
+	breakers.push_back(bing_breaker);
+	breakers.push_back(aol_breaker);
+	string fallback_id = util::getParam<string>(Main::instance().getConfig(), "breaker_fallback_search_engine");
+	BOOST_FOREACH(const shared_ptr<SearchEngineBreaker> &fallback, breakers){
+		if (fallback->getSearchEngineId() != fallback_id){
+			continue;
+		}
+		BOOST_FOREACH(const shared_ptr<SearchEngineBreaker> &breaker, breakers){
+			if (breaker != fallback){
+				breaker->setFallback(fallback);
+			}
+		}
+	}
+
+	int max_concurrent_fetches = util::getParam<int>(Main::instance().getConfig(), "repeater_max_concurrent_fetches");
+	shared_ptr<SearchEngine> bingr(new SearchEngineRepeater(bing_breaker, max_concurrent_fetches));
 	//search_engines.push_back(yahoo);
 	//search_engines.push_back(aol);
 	//search_engines.push_back(aolr);
 	// Add more search engines here.
-	search_engines.push_back(bing);
+	search_engines.push_back(bing_breaker);
 	search_engines.push_back(bingr);
+
+	// Federated search over the search engines listed in config, which need not be offered on their own.
+	// It drops failing and slow search engines by itself, so it goes to them directly rather than through their breakers,
+	// whose fallbacks would bring in the results of another member twice.
+	vector<string> member_ids;
+	string member_ids_str = util::getParam<string>(Main::instance().getConfig(), "federated_search_engines");
+	split(member_ids, member_ids_str, is_any_of(" ,"), token_compress_on);
+	shared_ptr<SearchEngine> candidates[] = {bing, aol};
+	vector<shared_ptr<SearchEngine> > members;
+	BOOST_FOREACH(const string &member_id, member_ids){
+		if (member_id.empty()){
+			continue;
+		}
+		size_t i = 0;
+		while (i < sizeof(candidates) / sizeof(candidates[0]) && candidates[i]->getSearchEngineId() != member_id){
+			++ i;
+		}
+		if (i < sizeof(candidates) / sizeof(candidates[0])){
+			members.push_back(candidates[i]);
+		}
+		else{
+			getLogger().error("Unknown search engine for federated search: " + member_id);
+		}
+	}
+	if (members.size() > 1){
+		int deadline = util::getParam<int>(Main::instance().getConfig(), "federated_search_deadline");
+		search_engines.push_back(shared_ptr<SearchEngine>(new FederatedSearchEngine(members, deadline)));
+	}
+
+	size_t cache_max_size = util::getParam<size_t>(Main::instance().getConfig(), "search_cache_max_size");
+	int cache_ttl = util::getParam<int>(Main::instance().getConfig(), "search_cache_ttl");
+	result_cache.reset(new SearchResultCache(cache_max_size, cache_ttl));
+
+	memory_budget = util::getParam<size_t>(Main::instance().getConfig(), "search_memory_budget");
+	searches_size = 0;
+	evicted_search_count = 0;
+	evicted_size = 0;
+	// Runs after LongTermHistoryManager has saved searches.
+	getUCAIRServer().idle_signal.sig.connect(2, bind(&SearchProxy::evictSearches, this));
+
+	max_prefetches_per_user = util::getParam<int>(Main::instance().getConfig(), "prefetch_max_per_user");
+	prefetch_count = 0;
+	getUCAIRServer().idle_signal.sig.connect(3, bind(&SearchProxy::startPrefetches, this));
+
+	single_flight_wait = util::getParam<int>(Main::instance().getConfig(), "single_flight_wait");
+	coalesced_fetch_count = 0;
 	return true;
 }
 
+shared_ptr<SearchEngine> SearchProxy::makeRecorded(const shared_ptr<SearchEngine> &search_engine){
+	string mode_name = util::getParam<string>(Main::instance().getConfig(), "recorded_search_mode");
+	RecordedSearchEngine::Mode mode;
+	if (! RecordedSearchEngine::parseMode(mode_name, mode)){
+		if (mode_name != "off"){
+			getLogger().error("Unknown recorded search mode: " + mode_name);
+		}
+		return search_engine;
+	}
+	filesystem::path dir(util::getParam<string>(Main::instance().getConfig(), "recorded_search_dir"));
+	if (! dir.is_complete()){
+		dir = filesystem::path(getProgramDataDir()) / dir;
+	}
+	int latency = util::getParam<int>(Main::instance().getConfig(), "recorded_search_latency");
+	double failure_rate = util::getParam<double>(Main::instance().getConfig(), "recorded_search_failure_rate");
+	getLogger().info("Search engine " + search_engine->getSearchEngineId() + " in " + mode_name + " mode, recorded pages in " + dir.string());
+	return shared_ptr<SearchEngine>(new RecordedSearchEngine(search_engine, mode, dir.string(), latency, failure_rate));
+}
+
 bool SearchProxy::finalize(){
+	result_cache->clear();
 	searches.clear();
+	searches_size = 0;
+	evicted_search_ids.clear();
+	prefetch_queue.clear();
+	for (map<string, list<shared_ptr<FlightFollower> > >::iterator itr = flights.begin(); itr != flights.end(); ++ itr){
+		BOOST_FOREACH(const shared_ptr<FlightFollower> &follower, itr->second){
+			follower->timer->cancel();
+		}
+	}
+	flights.clear();
 	search_engines.clear();
+	breakers.clear();
 	return true;
 }
 
@@ -63,7 +174,70 @@ bool SearchProxy::initializeUser(User &user) {
 	return true;
 }
 
-SearchProxy::ReturnCode SearchProxy::search(string &search_id, string &query_text, string &search_engine_id, int start_pos, int result_count){
+void SearchProxy::asyncSearch(string &search_id, string &query_text, string &search_engine_id, int start_pos, int result_count, const SearchCallback &callback){
+	shared_ptr<Search> fetched;
+	SearchEngine *search_engine = NULL;
+	ReturnCode rc = prepareFetch(search_id, query_text, search_engine_id, start_pos, result_count, fetched, search_engine);
+	if (rc != OK || ! fetched){
+		callback(rc);
+		return;
+	}
+	string flight_key;
+	if (single_flight_wait > 0){
+		flight_key = makeFlightKey(*fetched, start_pos, result_count);
+		map<string, list<shared_ptr<FlightFollower> > >::iterator flight_itr = flights.find(flight_key);
+		if (flight_itr != flights.end()){
+			// The same page is being fetched; wait for its results.
+			shared_ptr<FlightFollower> follower(new FlightFollower);
+			follower->fetched = fetched;
+			follower->search_engine = search_engine;
+			follower->start_pos = start_pos;
+			follower->result_count = result_count;
+			follower->callback = callback;
+			follower->timer.reset(new asio::deadline_timer(Main::instance().io_service, posix_time::milliseconds(single_flight_wait)));
+			follower->done = false;
+			follower->timer->async_wait(Main::instance().app_strand.wrap(
+					bind(&SearchProxy::onFlightWaitTimeout, this, follower, asio::placeholders::error)));
+			flight_itr->second.push_back(follower);
+			return;
+		}
+		flights[flight_key];
+	}
+	shared_ptr<bool> ok(new bool(false));
+	Main::instance().postBlocking(bind(&SearchProxy::fetchResults, search_engine, fetched, start_pos, result_count, ok),
+			bind(&SearchProxy::onResultsFetched, this, fetched, ok, callback, flight_key));
+}
+
+string SearchProxy::makeFlightKey(const Search &fetched, int start_pos, int result_count){
+	return str(format("%1%\t%2%\t%3%\t%4%") % fetched.getSearchEngineId() % SearchResultCache::normalizeQuery(fetched.query.text) % start_pos % result_count);
+}
+
+void SearchProxy::onFlightWaitTimeout(const shared_ptr<FlightFollower> &follower, const system::error_code &error){
+	if (error || follower->done){
+		return;
+	}
+	follower->done = true;
+	getLogger().info("Gave up waiting for results of query ( " + follower->fetched->query.text + " ) being fetched for another search");
+	shared_ptr<bool> ok(new bool(false));
+	Main::instance().postBlocking(bind(&SearchProxy::fetchResults, follower->search_engine, follower->fetched, follower->start_pos, follower->result_count, ok),
+			bind(&SearchProxy::onResultsFetched, this, follower->fetched, ok, follower->callback, string()));
+}
+
+void SearchProxy::copyResults(const Search &from, Search &to){
+	to.setTotalResultCount(from.getTotalResultCount());
+	to.setFallbackSearchEngineId(from.getFallbackSearchEngineId());
+	to.source_depths = from.source_depths;
+	to.query.spell_suggestion = from.query.spell_suggestion;
+	for (map<int, SearchResult>::const_iterator itr = from.results.begin(); itr != from.results.end(); ++ itr){
+		SearchResult &result = to.results[itr->first];
+		result = itr->second;
+		result.search_id = to.getSearchId();
+		result.doc_id = buildDocName(result.search_id, result.original_rank);
+	}
+}
+
+SearchProxy::ReturnCode SearchProxy::prepareFetch(string &search_id, string &query_text, string &search_engine_id, int &start_pos, int &result_count,
+		shared_ptr<Search> &fetched, SearchEngine *&search_engine){
 	if (searches.find(search_id) == searches.end()){
 		// new search
 		if (query_text.empty() || search_engine_id.empty()){
@@ -71,7 +245,7 @@ SearchProxy::ReturnCode SearchProxy::search(string &search_id, string &query_tex
 			return BAD_PARAM;
 		}
 
-		SearchEngine* search_engine = getSearchEngine(search_engine_id);
+		search_engine = getSearchEngine(search_engine_id);
 		if (! search_engine){
 			getLogger().error("Search engine not found: " + search_engine_id);
 			return BAD_PARAM;
@@ -82,17 +256,18 @@ SearchProxy::ReturnCode SearchProxy::search(string &search_id, string &query_tex
 			result_count = allowed_result_count;
 		}
 
-		Search search;
+		// The search is only added once results are in.
+		fetched.reset(new Search);
 		search_id = util::makeId();
-		search.setSearchId(search_id);
-		search.query.text = query_text;
-		search.query.parseKeywords();
-		search.setSearchEngineId(search_engine_id);
-		if (! search_engine->fetchResults(search, start_pos, result_count)){
-			getLogger().error("Failed to fetch results for query ( " + query_text + " ) from " + search_engine_id);
-			return BAD_CONNECTION;
+		fetched->setSearchId(search_id);
+		fetched->query.text = query_text;
+		fetched->query.parseKeywords();
+		fetched->setSearchEngineId(search_engine_id);
+		if (result_cache->seed(*fetched, start_pos, result_count)){
+			getLogger().debug("Found results of query ( " + query_text + " ) in cache");
+			addFetchedResults(*fetched);
+			fetched.reset();
 		}
-		searches[search_id] = search;
 	}
 	else{
 		// existing search
@@ -100,7 +275,7 @@ SearchProxy::ReturnCode SearchProxy::search(string &search_id, string &query_tex
 		query_text = search.query.text;
 		search_engine_id = search.getSearchEngineId();
 
-		SearchEngine* search_engine = getSearchEngine(search_engine_id);
+		search_engine = getSearchEngine(search_engine_id);
 
 		int allowed_result_count = search_engine->maxAllowedResultCount();
 		if (result_count > allowed_result_count){
@@ -114,25 +289,245 @@ SearchProxy::ReturnCode SearchProxy::search(string &search_id, string &query_tex
 		start_pos = search.results.size() + 1;
 
 		// Use a temporary search instance.
-		Search temp_search;
-		temp_search.setSearchId(search_id);
-		temp_search.query = search.query;
-		if (! search_engine->fetchResults(temp_search, start_pos, result_count)){
-			getLogger().error("Failed to fetch results for query ( " + search.query.text + " ) from " + search_engine_id);
-			return BAD_CONNECTION;
-		}
-		// Merge the temporary search instance.
-		search.setTotalResultCount(temp_search.getTotalResultCount());
-		for (map<int, SearchResult>::const_iterator itr = temp_search.results.begin(); itr != temp_search.results.end(); ++ itr){
-			search.results[itr->first] = itr->second;
+		fetched.reset(new Search);
+		fetched->setSearchId(search_id);
+		fetched->query = search.query;
+		fetched->setSearchEngineId(search_engine_id);
+		fetched->source_depths = search.source_depths;
+		// The cache only has results of the search engine asked, which cannot be added to results of a fallback.
+		if (search.getFallbackSearchEngineId().empty() && result_cache->seed(*fetched, start_pos, result_count)){
+			addFetchedResults(*fetched);
+			fetched.reset();
 		}
 	}
 	return OK;
 }
 
+void SearchProxy::clearStemmedTerms(const string &search_id){
+	map<string, Search>::iterator itr = searches.find(search_id);
+	if (itr == searches.end()){
+		return;
+	}
+	for (map<int, SearchResult>::iterator result_itr = itr->second.results.begin(); result_itr != itr->second.results.end(); ++ result_itr){
+		SearchResult &result = result_itr->second;
+		if (result.stemmed_terms.empty()){
+			continue;
+		}
+		size_t old_size = result.estimateSize();
+		vector<string>().swap(result.stemmed_terms);
+		searches_size -= min(old_size - result.estimateSize(), searches_size);
+	}
+}
+
+bool SearchProxy::addFetchedResults(const Search &fetched){
+	map<string, Search>::iterator itr = searches.find(fetched.getSearchId());
+	if (itr == searches.end()){
+		searches.insert(make_pair(fetched.getSearchId(), fetched));
+		searches_size += fetched.estimateSize();
+		return true;
+	}
+	// Merge the temporary search instance.
+	Search &search = itr->second;
+	if (! search.results.empty() && search.getFallbackSearchEngineId() != fetched.getFallbackSearchEngineId()){
+		// Ranks of different search engines do not line up.
+		getLogger().error("Results for query ( " + fetched.query.text + " ) came from a different search engine than earlier pages");
+		return false;
+	}
+	search.setFallbackSearchEngineId(fetched.getFallbackSearchEngineId());
+	search.setTotalResultCount(fetched.getTotalResultCount());
+	for (map<string, int>::const_iterator depth_itr = fetched.source_depths.begin(); depth_itr != fetched.source_depths.end(); ++ depth_itr){
+		search.source_depths[depth_itr->first] = depth_itr->second;
+	}
+	for (map<int, SearchResult>::const_iterator result_itr = fetched.results.begin(); result_itr != fetched.results.end(); ++ result_itr){
+		SearchResult &result = search.results[result_itr->first];
+		searches_size -= min(result.estimateSize(), searches_size);
+		result = result_itr->second;
+		searches_size += result.estimateSize();
+	}
+	return true;
+}
+
+void SearchProxy::evictSearches(){
+	if (searches_size <= memory_budget){
+		return;
+	}
+	// Least recently used searches first.
+	vector<pair<time_t, string> > candidates;
+	for (map<string, Search>::const_iterator itr = searches.begin(); itr != searches.end(); ++ itr){
+		const string &search_id = itr->first;
+		User *user = getUserManager().getUserBySearchId(search_id);
+		if (! user || ! user->isSearchExpired(search_id) || ! getLongTermHistoryManager().isSearchSaved(search_id)){
+			continue;
+		}
+		const UserSearchRecord *search_record = user->getSearchRecord(search_id);
+		candidates.push_back(make_pair(search_record ? search_record->getLastEventTime() : 0, search_id));
+	}
+	sort(candidates.begin(), candidates.end());
+
+	int count = 0;
+	size_t size = 0;
+	for (vector<pair<time_t, string> >::const_iterator candidate_itr = candidates.begin(); candidate_itr != candidates.end() && searches_size > memory_budget; ++ candidate_itr){
+		map<string, Search>::iterator itr = searches.find(candidate_itr->second);
+		User *user = getUserManager().getUserBySearchId(itr->first);
+		getLongTermHistoryManager().addEvictedSearch(user->getUserId(), itr->second);
+		size_t search_size = itr->second.estimateSize();
+		searches_size -= min(search_size, searches_size);
+		size += search_size;
+		++ count;
+		evicted_search_ids.insert(itr->first);
+		searches.erase(itr);
+	}
+	evicted_search_count += count;
+	evicted_size += size;
+	if (count > 0){
+		getLogger().info(str(format("Evicted %1% searches (%2% KB) from memory; %3% KB left") % count % (size / 1024) % (searches_size / 1024)));
+	}
+}
+
+void SearchProxy::fetchResults(SearchEngine *search_engine, const shared_ptr<Search> &fetched, int start_pos, int result_count, const shared_ptr<bool> &ok){
+	*ok = search_engine->fetchResults(*fetched, start_pos, result_count);
+}
+
+void SearchProxy::onResultsFetched(const shared_ptr<Search> &fetched, const shared_ptr<bool> &ok, const SearchCallback &callback, const string &flight_key){
+	list<shared_ptr<FlightFollower> > followers;
+	map<string, list<shared_ptr<FlightFollower> > >::iterator flight_itr = flight_key.empty() ? flights.end() : flights.find(flight_key);
+	if (flight_itr != flights.end()){
+		followers.swap(flight_itr->second);
+		flights.erase(flight_itr);
+	}
+
+	ReturnCode rc = *ok ? OK : BAD_CONNECTION;
+	if (! *ok){
+		getLogger().error("Failed to fetch results for query ( " + fetched->query.text + " ) from " + fetched->getSearchEngineId());
+	}
+	else{
+		// Results of a fallback are not cached under the search engine they stand in for,
+		// nor merged results, whose next page depends on how far each search engine has been read (see Search::source_depths).
+		if (fetched->getFallbackSearchEngineId().empty() && fetched->source_depths.empty()){
+			result_cache->put(*fetched);
+		}
+		if (! addFetchedResults(*fetched)){
+			rc = BAD_CONNECTION;
+		}
+	}
+	// Followers still waiting share the outcome, whether results or failure.
+	list<pair<shared_ptr<FlightFollower>, ReturnCode> > waiting;
+	BOOST_FOREACH(const shared_ptr<FlightFollower> &follower, followers){
+		if (follower->done){
+			continue;
+		}
+		follower->done = true;
+		follower->timer->cancel();
+		++ coalesced_fetch_count;
+		bool added = false;
+		if (*ok){
+			copyResults(*fetched, *follower->fetched);
+			added = addFetchedResults(*follower->fetched);
+		}
+		waiting.push_back(make_pair(follower, added ? OK : BAD_CONNECTION));
+	}
+	callback(rc);
+	for (list<pair<shared_ptr<FlightFollower>, ReturnCode> >::const_iterator itr = waiting.begin(); itr != waiting.end(); ++ itr){
+		itr->first->callback(itr->second);
+	}
+}
+
+void SearchProxy::schedulePrefetch(const string &search_id, int start_pos, int result_count){
+	if (max_prefetches_per_user <= 0){
+		return;
+	}
+	map<string, Search>::const_iterator search_itr = searches.find(search_id);
+	if (search_itr == searches.end()){
+		return;
+	}
+	const Search &search = search_itr->second;
+	if (start_pos > search.getTotalResultCount() || search.hasResults(start_pos, result_count)){
+		return;
+	}
+	User *user = getUserManager().getUserBySearchId(search_id);
+	if (! user){
+		return;
+	}
+	string user_id = user->getUserId();
+
+	// A new prefetch replaces the one queued for the same search, and takes the place of the oldest one of the user if over budget.
+	int user_prefetch_count = 0;
+	map<string, int>::const_iterator count_itr = running_prefetch_counts.find(user_id);
+	if (count_itr != running_prefetch_counts.end()){
+		user_prefetch_count = count_itr->second;
+	}
+	list<PrefetchTask>::iterator oldest_itr = prefetch_queue.end();
+	for (list<PrefetchTask>::iterator itr = prefetch_queue.begin(); itr != prefetch_queue.end(); ){
+		if (itr->search_id == search_id){
+			itr = prefetch_queue.erase(itr);
+			continue;
+		}
+		if (itr->user_id == user_id){
+			if (oldest_itr == prefetch_queue.end()){
+				oldest_itr = itr;
+			}
+			++ user_prefetch_count;
+		}
+		++ itr;
+	}
+	if (user_prefetch_count >= max_prefetches_per_user){
+		if (oldest_itr == prefetch_queue.end()){
+			// All running.
+			return;
+		}
+		prefetch_queue.erase(oldest_itr);
+	}
+
+	PrefetchTask task;
+	task.user_id = user_id;
+	task.search_id = search_id;
+	task.start_pos = start_pos;
+	task.result_count = result_count;
+	prefetch_queue.push_back(task);
+}
+
+void SearchProxy::startPrefetches(){
+	list<PrefetchTask> tasks;
+	tasks.swap(prefetch_queue);
+	BOOST_FOREACH(const PrefetchTask &task, tasks){
+		User *user = getUserManager().getUserBySearchId(task.search_id);
+		map<string, Search>::const_iterator search_itr = searches.find(task.search_id);
+		if (! user || user->isSearchExpired(task.search_id) || search_itr == searches.end()){
+			continue;
+		}
+		if (search_itr->second.hasResults(task.start_pos, task.result_count)){
+			// The user got there first.
+			continue;
+		}
+		getLogger().debug(str(format("Prefetching results from %1% to %2% of search %3%") % task.start_pos % (task.start_pos + task.result_count - 1) % task.search_id));
+		++ running_prefetch_counts[task.user_id];
+		string search_id = task.search_id;
+		string query_text;
+		string search_engine_id;
+		asyncSearch(search_id, query_text, search_engine_id, task.start_pos, task.result_count,
+				bind(&SearchProxy::onPrefetchDone, this, task.user_id, task.search_id, _1));
+	}
+}
+
+void SearchProxy::onPrefetchDone(const string &user_id, const string &search_id, ReturnCode rc){
+	map<string, int>::iterator itr = running_prefetch_counts.find(user_id);
+	if (itr != running_prefetch_counts.end() && -- itr->second <= 0){
+		running_prefetch_counts.erase(itr);
+	}
+	if (rc == OK){
+		++ prefetch_count;
+	}
+	else{
+		getLogger().info("Failed to prefetch results of search " + search_id);
+	}
+}
+
 const Search* SearchProxy::getSearch(const string &search_id) const {
 	map<string, Search>::const_iterator itr = searches.find(search_id);
 	if (itr == searches.end()){
+		if (evicted_search_ids.find(search_id) != evicted_search_ids.end()){
+			return getLongTermHistoryManager().getSearch(search_id);
+		}
 		return NULL;
 	}
 	return &itr->second;
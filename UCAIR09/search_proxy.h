@@ -3,11 +3,15 @@
 
 #include <list>
 #include <map>
+#include <set>
 #include <string>
+#include <boost/function.hpp>
 #include <boost/smart_ptr.hpp>
 #include "component.h"
 #include "main.h"
 #include "search_engine.h"
+#include "search_engine_breaker.h"
+#include "search_result_cache.h"
 
 namespace ucair {
 
@@ -20,20 +24,42 @@ public:
 
 	enum ReturnCode { OK, BAD_PARAM, BAD_CONNECTION };
 
-	/*! \brief Performs a search.
-	 *  It will not go to the search engine if an identical search with the given params has been done before.
+	/// Receives the outcome of asyncSearch.
+	typedef boost::function<void (ReturnCode)> SearchCallback;
+	/*! \brief Performs a search, without blocking while results are fetched from the search engine.
+	 *
+	 *  It will not go to the search engine if an identical search with the given params has been done before,
+	 *  or if the results are in the result cache (from a search for the same query, possibly by another user).
 	 *  If only search id is given, query text and search engine id will be returned (if search id is found).
 	 *  If only query text and search engine id are given, search id will be returned (whether search is old or new).
+	 *  These are returned right away. The search engine is queried on a worker thread, and the callback is invoked
+	 *  in the application strand once the results have been added (or right away if nothing needs to be fetched).
+	 *  If the same page (search engine, query, start pos and result count) is already being fetched for another asyncSearch,
+	 *  this one waits for its results instead of going to the search engine again, for up to single_flight_wait milliseconds.
 	 *  \param[in,out] search_id
 	 *  \param[in,out] query_text query text
 	 *  \param[in,out] search_engine_id search engine id
 	 *  \param[in] start_pos which result to start fetch with
 	 *  \param[in] result_count how many results to fetch
-	 *  \return one of OK, BAD_PARAM, BAD_CONNECTION
+	 *  \param[in] callback receives one of OK, BAD_PARAM, BAD_CONNECTION
 	 */
-	ReturnCode search(std::string &search_id, std::string &query_text, std::string &search_engine_id, int start_pos, int result_count);
+	void asyncSearch(std::string &search_id, std::string &query_text, std::string &search_engine_id, int start_pos, int result_count,
+			const SearchCallback &callback);
+
+	/*! \brief Queues results of a search to be fetched in the background, before the user asks for them.
+	 *
+	 *  Typically called for the next page after a page of results is shown. Queued prefetches start when the server is idle,
+	 *  and are dropped once their search expires. Each user has at most prefetch_max_per_user prefetches queued or running;
+	 *  beyond that the oldest one queued is dropped. Results are added as with asyncSearch.
+	 *  \param search_id search id
+	 *  \param start_pos which result to start fetch with
+	 *  \param result_count how many results to fetch
+	 */
+	void schedulePrefetch(const std::string &search_id, int start_pos, int result_count);
 
 	/*! \brief Returns a search instance.
+	 *
+	 *  A search that has been evicted from memory is served by LongTermHistoryManager, with the results that were saved.
 	 *  \param search_id search id
 	 *  \return NULL if not found
 	 */
@@ -46,15 +72,116 @@ public:
 	 */
 	const SearchResult* getResult(const std::string &search_id, int result_pos) const;
 
+	/*! \brief Frees the stemmed terms of the results of a search, once they have been indexed.
+	 *  \sa Document::stemmed_terms
+	 */
+	void clearStemmedTerms(const std::string &search_id);
+
 	/// Returns a search engine.
 	SearchEngine* getSearchEngine(const std::string &search_engine_id) const;
 	/// Returns a list of all search engines.
 	std::list<SearchEngine*> getAllSearchEngines() const;
 
+	/// Returns the cache of results shared by all searches.
+	const SearchResultCache& getResultCache() const { return *result_cache; }
+
+	/// Returns the number of searches in memory.
+	size_t getSearchCount() const { return searches.size(); }
+	/// Returns estimated memory taken by searches in memory, in bytes.
+	size_t getSearchesSize() const { return searches_size; }
+	/// Returns the number of searches evicted from memory.
+	long long getEvictedSearchCount() const { return evicted_search_count; }
+	/// Returns estimated memory freed by evicting searches, in bytes.
+	long long getEvictedSize() const { return evicted_size; }
+	/// Returns the number of prefetches that have completed.
+	long long getPrefetchCount() const { return prefetch_count; }
+	/// Returns the number of fetches that were saved by waiting for an identical fetch in flight.
+	long long getCoalescedFetchCount() const { return coalesced_fetch_count; }
+	/// Returns the circuit breakers guarding search engines.
+	const std::list<boost::shared_ptr<SearchEngineBreaker> >& getBreakers() const { return breakers; }
+
 private:
+	/// Puts a search engine in record or replay mode, as set in config; returns it as it is if the mode is off.
+	static boost::shared_ptr<SearchEngine> makeRecorded(const boost::shared_ptr<SearchEngine> &search_engine);
+
+	/*! \brief Works out what needs to be fetched for a search.
+	 *
+	 *  Params are as in asyncSearch(), with start pos and result count adjusted to what is to be fetched.
+	 *  \param[out] fetched set to a search instance to receive the results, left empty if there is nothing to fetch
+	 *  \param[out] search_engine search engine to fetch from
+	 */
+	ReturnCode prepareFetch(std::string &search_id, std::string &query_text, std::string &search_engine_id, int &start_pos, int &result_count,
+			boost::shared_ptr<Search> &fetched, SearchEngine *&search_engine);
+	/*! \brief Adds fetched results to the search they belong to, which is created if new.
+	 *  \return false if the results came from a different search engine than those the search has (see Search::getFallbackSearchEngineId)
+	 */
+	bool addFetchedResults(const Search &fetched);
+	/// Fetches results on a worker thread for asyncSearch.
+	static void fetchResults(SearchEngine *search_engine, const boost::shared_ptr<Search> &fetched, int start_pos, int result_count,
+			const boost::shared_ptr<bool> &ok);
+	/*! \brief Adds results fetched for asyncSearch, and invokes its callback.
+	 *  \param flight_key key of the flight the fetch leads, empty if it leads none
+	 */
+	void onResultsFetched(const boost::shared_ptr<Search> &fetched, const boost::shared_ptr<bool> &ok, const SearchCallback &callback,
+			const std::string &flight_key);
+
+	/// An asyncSearch waiting for the results of an identical fetch in flight.
+	class FlightFollower {
+	public:
+		boost::shared_ptr<Search> fetched; ///< receives a copy of the results
+		SearchEngine *search_engine;
+		int start_pos;
+		int result_count;
+		SearchCallback callback;
+		boost::shared_ptr<boost::asio::deadline_timer> timer; ///< ends the wait
+		bool done; ///< whether results have been handed over, or the follower has gone to fetch on its own
+	};
+	/// Returns the key of fetches that can share results: search engine, normalized query, start pos and result count.
+	static std::string makeFlightKey(const Search &fetched, int start_pos, int result_count);
+	/// Gives up waiting on a flight, and fetches results on its own.
+	void onFlightWaitTimeout(const boost::shared_ptr<FlightFollower> &follower, const boost::system::error_code &error);
+	/// Copies results fetched for one search into another, for the same query.
+	static void copyResults(const Search &from, Search &to);
+
+	/*! \brief Drops searches from memory, least recently used first, while searches take more than the memory budget.
+	 *
+	 *  Only searches that are expired and saved are dropped: they will not change,
+	 *  and are handed over to LongTermHistoryManager.
+	 */
+	void evictSearches();
+
+	/// Results of a search to be fetched ahead of time.
+	class PrefetchTask {
+	public:
+		std::string user_id;
+		std::string search_id;
+		int start_pos;
+		int result_count;
+	};
+	/// Starts queued prefetches whose searches are still active.
+	void startPrefetches();
+	/// Called when a prefetch completes.
+	void onPrefetchDone(const std::string &user_id, const std::string &search_id, ReturnCode rc);
 
 	std::map<std::string, Search> searches;
 	std::list<boost::shared_ptr<SearchEngine> > search_engines;
+	std::list<boost::shared_ptr<SearchEngineBreaker> > breakers;
+	boost::scoped_ptr<SearchResultCache> result_cache;
+
+	std::set<std::string> evicted_search_ids; ///< searches handed over to LongTermHistoryManager
+	size_t searches_size; ///< estimated memory taken by searches, in bytes
+	size_t memory_budget; ///< searches are evicted when they take more than this many bytes
+	long long evicted_search_count;
+	long long evicted_size;
+
+	std::list<PrefetchTask> prefetch_queue; ///< oldest first
+	std::map<std::string, int> running_prefetch_counts; ///< number of prefetches running, by user id
+	int max_prefetches_per_user;
+	long long prefetch_count;
+
+	std::map<std::string, std::list<boost::shared_ptr<FlightFollower> > > flights; ///< fetches in flight for asyncSearch, with those waiting on them, by key
+	int single_flight_wait; ///< milliseconds a follower waits for a flight; 0 disables coalescing
+	long long coalesced_fetch_count;
 };
 
 DECLARE_GET_COMPONENT(SearchProxy)
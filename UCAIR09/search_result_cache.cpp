@@ -0,0 +1,135 @@
+#include "search_result_cache.h"
+#include <vector>
+#include <boost/algorithm/string.hpp>
+#include <boost/foreach.hpp>
+#include <boost/lexical_cast.hpp>
+#include "common_util.h"
+#include "ucair_util.h"
+
+using namespace std;
+using namespace boost;
+
+namespace ucair {
+
+SearchResultCache::SearchResultCache(size_t max_size_, int ttl_):
+	max_size(max_size_),
+	ttl(ttl_),
+	size(0),
+	hit_count(0),
+	miss_count(0) {
+}
+
+string SearchResultCache::normalizeQuery(const string &query_text){
+	vector<string> tokens = util::tokenizeWithWhitespace(to_lower_copy(query_text));
+	return join(tokens, " ");
+}
+
+string SearchResultCache::makeKey(const string &normalized_query, const string &search_engine_id, int page_no){
+	return search_engine_id + "\t" + lexical_cast<string>(page_no) + "\t" + normalized_query;
+}
+
+void SearchResultCache::put(const Search &search){
+	if (max_size == 0 || ttl <= 0){
+		return;
+	}
+	string normalized_query = normalizeQuery(search.query.text);
+	posix_time::ptime now = posix_time::second_clock::universal_time();
+	for (map<int, SearchResult>::const_iterator itr = search.results.begin(); itr != search.results.end(); ++ itr){
+		int rank = itr->first;
+		string key = makeKey(normalized_query, search.getSearchEngineId(), (rank - 1) / PAGE_SIZE);
+		PageMap::iterator page_itr = pages.find(key);
+		if (page_itr != pages.end() && page_itr->second.expires < now){
+			erase(page_itr);
+			page_itr = pages.end();
+		}
+		if (page_itr == pages.end()){
+			page_itr = pages.insert(make_pair(key, Page())).first;
+			Page &page = page_itr->second;
+			page.expires = now + posix_time::seconds(ttl);
+			page.size = sizeof(Page) + key.size();
+			page.lru_itr = lru.insert(lru.begin(), key);
+			size += page.size;
+		}
+		Page &page = page_itr->second;
+		page.total_result_count = search.getTotalResultCount();
+		map<int, SearchResult>::iterator result_itr = page.results.find(rank);
+		if (result_itr != page.results.end()){
+			size_t old_size = result_itr->second.estimateSize();
+			page.size -= old_size;
+			size -= old_size;
+		}
+		SearchResult &cached_result = page.results[rank];
+		cached_result = itr->second;
+		// Only the search that fetched a result indexes it from these.
+		vector<string>().swap(cached_result.stemmed_terms);
+		size_t result_size = cached_result.estimateSize();
+		page.size += result_size;
+		size += result_size;
+		touch(page);
+	}
+	while (size > max_size && ! lru.empty()){
+		erase(pages.find(lru.back()));
+	}
+}
+
+bool SearchResultCache::seed(Search &search, int start_pos, int result_count){
+	if (max_size == 0 || ttl <= 0 || result_count <= 0){
+		return false;
+	}
+	string normalized_query = normalizeQuery(search.query.text);
+	posix_time::ptime now = posix_time::second_clock::universal_time();
+	// Check that everything is there before touching the search.
+	vector<Page*> used_pages;
+	for (int rank = start_pos; rank < start_pos + result_count; ++ rank){
+		int page_no = (rank - 1) / PAGE_SIZE;
+		if (used_pages.empty() || (rank - 1) % PAGE_SIZE == 0){
+			PageMap::iterator page_itr = pages.find(makeKey(normalized_query, search.getSearchEngineId(), page_no));
+			if (page_itr != pages.end() && page_itr->second.expires < now){
+				erase(page_itr);
+				page_itr = pages.end();
+			}
+			if (page_itr == pages.end()){
+				++ miss_count;
+				return false;
+			}
+			used_pages.push_back(&page_itr->second);
+		}
+		if (used_pages.back()->results.find(rank) == used_pages.back()->results.end()){
+			++ miss_count;
+			return false;
+		}
+	}
+	for (int rank = start_pos; rank < start_pos + result_count; ++ rank){
+		Page &page = *used_pages[(rank - 1) / PAGE_SIZE - (start_pos - 1) / PAGE_SIZE];
+		SearchResult &result = search.results[rank];
+		result = page.results[rank];
+		result.search_id = search.getSearchId();
+		result.doc_id = buildDocName(result.search_id, rank);
+	}
+	if (! used_pages.empty()){
+		search.setTotalResultCount(used_pages.front()->total_result_count);
+	}
+	BOOST_FOREACH(Page *page, used_pages){
+		touch(*page);
+	}
+	++ hit_count;
+	return true;
+}
+
+void SearchResultCache::clear(){
+	pages.clear();
+	lru.clear();
+	size = 0;
+}
+
+void SearchResultCache::erase(PageMap::iterator itr){
+	size -= itr->second.size;
+	lru.erase(itr->second.lru_itr);
+	pages.erase(itr);
+}
+
+void SearchResultCache::touch(Page &page){
+	lru.splice(lru.begin(), lru, page.lru_itr);
+}
+
+} // namespace ucair
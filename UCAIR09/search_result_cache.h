@@ -0,0 +1,82 @@
+#ifndef __search_result_cache_h__
+#define __search_result_cache_h__
+
+#include <list>
+#include <map>
+#include <string>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/utility.hpp>
+#include "search_engine.h"
+
+namespace ucair {
+
+/*! \brief Cache of search results, shared by all searches of all users.
+ *
+ *  Results are kept in pages of PAGE_SIZE ranks, keyed by normalized query text, search engine and page.
+ *  A new search for a query that has been seen recently can then be seeded from the cache instead of going to the search engine.
+ *  Pages expire after a while. The least recently used ones are evicted to keep the estimated memory size bounded.
+ *  Not thread-safe: used in the application strand.
+ */
+class SearchResultCache: private boost::noncopyable {
+public:
+	/*! \brief Constructor.
+	 *  \param max_size max estimated memory size of cached results in bytes (0 disables the cache)
+	 *  \param ttl seconds cached results are used for (0 disables the cache)
+	 */
+	SearchResultCache(size_t max_size, int ttl);
+
+	/// Adds all results of a search.
+	void put(const Search &search);
+
+	/*! \brief Copies cached results of a range of ranks into a search, for its query and search engine.
+	 *
+	 *  Results are given the search id of the search.
+	 *  \return true if all results in the range are cached; otherwise the search is left as it was
+	 */
+	bool seed(Search &search, int start_pos, int result_count);
+
+	/// Removes all results.
+	void clear();
+
+	/// Returns query text with case and spacing normalized, so that trivially different queries share cached results.
+	static std::string normalizeQuery(const std::string &query_text);
+
+	long long getHitCount() const { return hit_count; }
+	long long getMissCount() const { return miss_count; }
+	/// Returns estimated memory size of cached results in bytes.
+	size_t getSize() const { return size; }
+	size_t getPageCount() const { return pages.size(); }
+
+	/// Number of ranks in a page.
+	static const int PAGE_SIZE = 10;
+
+private:
+	/// Cached results of a query in a range of PAGE_SIZE ranks.
+	class Page {
+	public:
+		std::map<int, SearchResult> results; ///< results by rank
+		long long total_result_count; ///< search engine estimate of number of results
+		boost::posix_time::ptime expires;
+		size_t size; ///< estimated memory size in bytes
+		std::list<std::string>::iterator lru_itr; ///< position in lru
+	};
+	typedef std::map<std::string, Page> PageMap;
+
+	static std::string makeKey(const std::string &normalized_query, const std::string &search_engine_id, int page_no);
+
+	void erase(PageMap::iterator itr);
+	/// Marks a page as most recently used.
+	void touch(Page &page);
+
+	PageMap pages;
+	std::list<std::string> lru; ///< keys of pages, most recently used first
+	size_t max_size;
+	int ttl;
+	size_t size;
+	long long hit_count;
+	long long miss_count;
+};
+
+} // namespace ucair
+
+#endif
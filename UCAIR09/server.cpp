@@ -1,5 +1,8 @@
 #include "server.h"
+#include <vector>
 #include <boost/bind.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
 
 using namespace std;
 using namespace boost;
@@ -7,12 +10,16 @@ using namespace boost;
 namespace http {
 namespace server {
 
-Server::Server(asio::io_service &io_service, const string& address, const string& port, const RequestHandler &handler):
+Server::Server(asio::io_service &io_service, asio::io_service::strand &handler_strand_, const string& address, const string& port, const RequestHandler &handler, size_t io_thread_count_, const ConnectionOptions &connection_options_):
 	io_service_(io_service),
+	handler_strand(handler_strand_),
+	accept_strand(io_service_),
+	io_thread_count(io_thread_count_ > 0 ? io_thread_count_ : 1),
 	acceptor_(io_service_),
 	request_handler(handler),
-	connection_manager(),
-	new_connection(new Connection(io_service_, connection_manager, request_handler))
+	connection_options(connection_options_),
+	connection_manager(connection_options),
+	new_connection(new Connection(io_service_, handler_strand, connection_manager, request_handler, connection_options))
 {
 	// Open the acceptor with the option to reuse the address (i.e. SO_REUSEADDR).
 	asio::ip::tcp::resolver resolver(io_service_);
@@ -24,34 +31,47 @@ Server::Server(asio::io_service &io_service, const string& address, const string
 	acceptor_.listen();
 	acceptor_.async_accept(
 			new_connection->socket(),
-			bind(&Server::handleAccept, this, asio::placeholders::error));
+			accept_strand.wrap(bind(&Server::handleAccept, this, asio::placeholders::error)));
 }
 
 void Server::run(){
 	// The io_service::run() call will block until all asynchronous operations have finished.
 	// While the server is running, there is always at least one asynchronous operation outstanding:
 	//  the asynchronous accept call waiting for new incoming connections.
+	// The calling thread is one of the pool threads.
+	vector<shared_ptr<thread> > threads;
+	for (size_t i = 1; i < io_thread_count; ++ i){
+		threads.push_back(shared_ptr<thread>(new thread(bind(&Server::runIOService, this))));
+	}
+	runIOService();
+	for (size_t i = 0; i < threads.size(); ++ i){
+		threads[i]->join();
+	}
+}
+
+void Server::runIOService(){
 	io_service_.run();
 }
 
 void Server::stop(bool immediately){
-	if (immediately) {
+	if (immediately && io_thread_count == 1) {
+		// With a single io thread, nothing can be running in the accept strand right now.
 		handleStop();
 	}
 	else {
 		// Post a call to the stop function so that server::stop() is safe to call from any thread.
-		io_service_.post(bind(&Server::handleStop, this));
+		accept_strand.post(bind(&Server::handleStop, this));
 	}
 }
 
 void Server::handleAccept(const boost::system::error_code& e){
 	if (!e){
 		connection_manager.start(new_connection);
-		new_connection.reset(new Connection(io_service_, connection_manager, request_handler));
+		new_connection.reset(new Connection(io_service_, handler_strand, connection_manager, request_handler, connection_options));
 		acceptor_.async_accept(
 				new_connection->socket(),
-				bind(&Server::handleAccept, this,
-				asio::placeholders::error));
+				accept_strand.wrap(bind(&Server::handleAccept, this,
+				asio::placeholders::error)));
 	}
 }
 
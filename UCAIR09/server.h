@@ -14,19 +14,33 @@ class Server: private boost::noncopyable {
 public:
 	/*! Constructs the server to listen on the specified TCP address and port, and serve up files from the given directory.
 	 *  \param io_service IO service
+	 *  \param handler_strand strand through which all requests are handed to the request handler
 	 *  \param address IP address to bind to
 	 *  \param port port to bind to
 	 *  \param request_handler handler that processes requests to produce replies
+	 *  \param io_thread_count number of threads running the io_service (accepting, parsing and writing in parallel)
+	 *  \param connection_options keep-alive and other connection parameters
 	 */
-	explicit Server(boost::asio::io_service &io_service, const std::string& address, const std::string& port, const RequestHandler &request_handler);
+	explicit Server(boost::asio::io_service &io_service, boost::asio::io_service::strand &handler_strand, const std::string& address, const std::string& port, const RequestHandler &request_handler, std::size_t io_thread_count = 1, const ConnectionOptions &connection_options = ConnectionOptions());
 
-	/// Runs the server's io_service loop.
+	/// Runs the server's io_service loop on a pool of threads. Blocks until all of them exit.
 	void run();
 
-	/// Stops the server.
+	/*! \brief Stops the server.
+	 *  \param immediately stop synchronously if possible (only when there is a single io thread)
+	 */
 	void stop(bool immediately);
 
+	/// Returns connection admission counters.
+	AdmissionStats getAdmissionStats() const { return connection_manager.getStats(); }
+
+	/// Returns latencies of writing replies to sockets.
+	const ::util::LatencyHistogram& getWriteLatency() const { return connection_manager.getWriteLatency(); }
+
 private:
+	/// Runs the io_service loop (thread function).
+	void runIOService();
+
 	/// Handles completion of an asynchronous accept operation.
 	void handleAccept(const boost::system::error_code& e);
 
@@ -36,12 +50,24 @@ private:
 	/// The io_service used to perform asynchronous operations.
 	boost::asio::io_service &io_service_;
 
+	/// Strand through which requests are handed to the request handler.
+	boost::asio::io_service::strand &handler_strand;
+
+	/// Strand that serializes accept and stop (the acceptor is not thread-safe).
+	boost::asio::io_service::strand accept_strand;
+
+	/// Number of threads running the io_service.
+	std::size_t io_thread_count;
+
 	/// Acceptor used to listen for incoming connections.
 	boost::asio::ip::tcp::acceptor acceptor_;
 
 	/// Handler that processes requests to produce replies.
 	RequestHandler request_handler;
 
+	/// Parameters shared by all connections.
+	ConnectionOptions connection_options;
+
 	/// The connection manager which owns all live connections.
 	ConnectionManager connection_manager;
 
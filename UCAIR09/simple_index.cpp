@@ -1,6 +1,7 @@
 #include "simple_index.h"
 #include <algorithm>
 #include <cassert>
+#include <climits>
 #include <cmath>
 #include <boost/foreach.hpp>
 #include <boost/tuple/tuple.hpp>
@@ -9,10 +10,39 @@
 using namespace std;
 using namespace boost;
 
+namespace {
+
+/// Where a query term is in its doc list, in top-k retrieval.
+class TermCursor{
+public:
+	TermCursor(const indexing::PostingList &doc_list, int query_pos_, double query_term_count_, double col_prob_, double max_score_):
+		itr(doc_list.iterator()),
+		query_pos(query_pos_),
+		query_term_count(query_term_count_),
+		col_prob(col_prob_),
+		max_score(max_score_)
+	{
+	}
+
+	bool operator < (const TermCursor &other) const { return max_score < other.max_score; }
+
+	indexing::PostingList::Iterator itr;
+	int query_pos; ///< position of the term in the query
+	double query_term_count;
+	double col_prob;
+	double max_score; ///< most the term can add to the score of a doc, before normalizing by query length
+};
+
+/// Margin kept by bounds in top-k retrieval, so that rounding never prunes a doc that would make the top k.
+const double BOUND_SLACK = 1e-9;
+
+} // anonymous namespace
+
 namespace indexing {
 
 SimpleIndex::SimpleIndex(NameDict &term_dict_):
-	term_dict(term_dict_)
+	term_dict(term_dict_),
+	frozen(false)
 {
 	doc_info_list.push_back(DocInfo()); // dummy DocInfo for subscript 0
 }
@@ -21,17 +51,25 @@ void SimpleIndex::clear() {
 	doc_dict.clear();
 	doc_info_list.resize(1);
 	term_info_map.clear();
+	frozen = false;
+	frozen_doc_lists.clear();
+	frozen_term_lists.clear();
+	vector<TermBounds>().swap(frozen_term_bounds);
 }
 
 bool SimpleIndex::addDoc(const string &doc_name, const ValueMap &doc_term_counts){
 	if (doc_dict.getId(doc_name) != -1){
 		return false;
 	}
+	if (frozen){
+		thaw();
+	}
 	int doc_id = doc_dict.getId(doc_name, true);
 
 	doc_info_list.push_back(DocInfo());
 	DocInfo &doc_info = doc_info_list.back();
 
+	vector<TermInfo*> term_infos;
 	for (shared_ptr<ConstValueIterator> value_itr = doc_term_counts.const_iterator(); value_itr->ok(); value_itr->next()){
 		const int term_id = value_itr->id();
 		const double term_count = value_itr->get();
@@ -41,11 +79,81 @@ bool SimpleIndex::addDoc(const string &doc_name, const ValueMap &doc_term_counts
 		map<int, TermInfo>::iterator itr;
 		tie(itr, tuples::ignore) = term_info_map.insert(make_pair(term_id, TermInfo()));
 		itr->second.doc_list.push_back(make_pair(doc_id, term_count));
+		term_infos.push_back(&itr->second);
+	}
+
+	// Bounds need the doc length, known only now.
+	for (size_t i = 0; i < term_infos.size(); ++ i){
+		TermBounds &bounds = term_infos[i]->bounds;
+		if (term_infos[i]->doc_list.size() == 1 || doc_info.doc_length < bounds.min_doc_length){
+			bounds.min_doc_length = doc_info.doc_length;
+		}
+		bounds.max_weight = max(bounds.max_weight, doc_info.term_list[i].second);
 	}
 
 	return true;
 }
 
+void SimpleIndex::freeze(){
+	if (frozen){
+		return;
+	}
+	// One row per term id up to the largest in the index, so that a term's docs are found by subscript.
+	frozen_doc_lists.clear();
+	const vector<pair<int, float> > no_docs;
+	int max_term_id = term_info_map.empty() ? 0 : term_info_map.rbegin()->first;
+	frozen_term_bounds.assign(max_term_id + 1, TermBounds());
+	map<int, TermInfo>::const_iterator itr = term_info_map.begin();
+	for (int term_id = 0; term_id <= max_term_id; ++ term_id){
+		if (itr != term_info_map.end() && itr->first == term_id){
+			frozen_doc_lists.addRow(itr->second.doc_list);
+			frozen_term_bounds[term_id] = itr->second.bounds;
+			++ itr;
+		}
+		else{
+			frozen_doc_lists.addRow(no_docs);
+		}
+	}
+	term_info_map.clear();
+	frozen_doc_lists.shrinkToFit();
+
+	frozen_term_lists.clear();
+	BOOST_FOREACH(DocInfo &doc_info, doc_info_list){
+		sort(doc_info.term_list.begin(), doc_info.term_list.end());
+		frozen_term_lists.addRow(doc_info.term_list);
+		vector<pair<int, float> >().swap(doc_info.term_list);
+	}
+	frozen_term_lists.shrinkToFit();
+	frozen = true;
+}
+
+void SimpleIndex::thaw(){
+	for (int term_id = 1; term_id < frozen_doc_lists.getRowCount(); ++ term_id){
+		PostingList doc_list = frozen_doc_lists.getRow(term_id);
+		if (doc_list.empty()){
+			continue;
+		}
+		TermInfo &term_info = term_info_map[term_id];
+		term_info.bounds = frozen_term_bounds[term_id];
+		term_info.doc_list.reserve(doc_list.size());
+		for (PostingList::Iterator itr = doc_list.iterator(); itr.ok(); itr.next()){
+			term_info.doc_list.push_back(make_pair(itr.id(), itr.weight()));
+		}
+	}
+	for (int doc_id = 1; doc_id < (int) doc_info_list.size(); ++ doc_id){
+		PostingList term_list = frozen_term_lists.getRow(doc_id);
+		vector<pair<int, float> > &doc_term_list = doc_info_list[doc_id].term_list;
+		doc_term_list.reserve(term_list.size());
+		for (PostingList::Iterator itr = term_list.iterator(); itr.ok(); itr.next()){
+			doc_term_list.push_back(make_pair(itr.id(), itr.weight()));
+		}
+	}
+	frozen_doc_lists.clear();
+	frozen_term_lists.clear();
+	vector<TermBounds>().swap(frozen_term_bounds);
+	frozen = false;
+}
+
 int SimpleIndex::getDocCount() const {
 	return (int) doc_info_list.size() - 1;
 }
@@ -55,32 +163,116 @@ double SimpleIndex::getDocLength(int doc_id) const {
 	return doc_info_list[doc_id].doc_length;
 }
 
-const vector<pair<int, float> >* SimpleIndex::getTermList(int doc_id) const{
+PostingList SimpleIndex::getTermList(int doc_id) const{
 	assert(doc_id > 0 && doc_id <= getDocCount());
-	return &(doc_info_list[doc_id].term_list);
+	if (frozen){
+		return frozen_term_lists.getRow(doc_id);
+	}
+	const vector<pair<int, float> > &term_list = doc_info_list[doc_id].term_list;
+	return term_list.empty() ? PostingList() : PostingList(&term_list[0], (int) term_list.size());
 }
 
-const vector<pair<int, float> >* SimpleIndex::getDocList(int term_id) const{
+PostingList SimpleIndex::getDocList(int term_id) const{
+	if (frozen){
+		return frozen_doc_lists.getRow(term_id);
+	}
 	map<int, TermInfo>::const_iterator itr = term_info_map.find(term_id);
 	if (itr != term_info_map.end()) {
-		return &(itr->second.doc_list);
+		const vector<pair<int, float> > &doc_list = itr->second.doc_list;
+		return PostingList(&doc_list[0], (int) doc_list.size());
 	}
-	return NULL;
+	return PostingList();
 }
 
-SimpleKLRetriever::SimpleKLRetriever(const ValueMap &col_probs_, double default_col_prob_, double dir_prior_):
-	col_probs(col_probs_.copy()),
-	default_col_prob(default_col_prob_),
-	dir_prior(dir_prior_)
-{
+bool SimpleIndex::getTermBounds(int term_id, float &max_weight, double &min_doc_length) const{
+	const TermBounds *bounds = NULL;
+	if (frozen){
+		if (term_id >= 0 && term_id < (int) frozen_term_bounds.size() && ! frozen_doc_lists.getRow(term_id).empty()){
+			bounds = &frozen_term_bounds[term_id];
+		}
+	}
+	else{
+		map<int, TermInfo>::const_iterator itr = term_info_map.find(term_id);
+		if (itr != term_info_map.end()){
+			bounds = &itr->second.bounds;
+		}
+	}
+	if (! bounds){
+		return false;
+	}
+	max_weight = bounds->max_weight;
+	min_doc_length = bounds->min_doc_length;
+	return true;
 }
 
-double SimpleKLRetriever::getColProb(int term_id) const {
-	double prob = 0.0;
-	if (col_probs->get(term_id, prob)){
-		return prob;
+size_t SimpleIndex::estimateSize() const{
+	// Red-black tree nodes take about 4 pointers besides the value.
+	size_t size = doc_info_list.capacity() * sizeof(DocInfo) + term_info_map.size() * (sizeof(pair<int, TermInfo>) + 4 * sizeof(void*));
+	BOOST_FOREACH(const DocInfo &doc_info, doc_info_list){
+		size += doc_info.term_list.capacity() * sizeof(pair<int, float>);
+	}
+	for (map<int, TermInfo>::const_iterator itr = term_info_map.begin(); itr != term_info_map.end(); ++ itr){
+		size += itr->second.doc_list.capacity() * sizeof(pair<int, float>);
 	}
-	return default_col_prob;
+	return size + frozen_doc_lists.estimateSize() + frozen_term_lists.estimateSize() + frozen_term_bounds.capacity() * sizeof(TermBounds);
+}
+
+void SimpleIndex::FrozenLists::clear(){
+	vector<int>().swap(row_offsets);
+	vector<int>().swap(encoded_offsets);
+	vector<unsigned char>().swap(encoded_ids);
+	vector<float>().swap(weights);
+}
+
+void SimpleIndex::FrozenLists::addRow(const vector<pair<int, float> > &row){
+	if (row_offsets.empty()){
+		row_offsets.push_back(0);
+		encoded_offsets.push_back(0);
+	}
+	int prev_id = 0;
+	typedef pair<int, float> P;
+	BOOST_FOREACH(const P &p, row){
+		assert(p.first >= prev_id);
+		unsigned int delta = (unsigned int) (p.first - prev_id);
+		while (delta >= 0x80){
+			encoded_ids.push_back((unsigned char) (delta | 0x80));
+			delta >>= 7;
+		}
+		encoded_ids.push_back((unsigned char) delta);
+		weights.push_back(p.second);
+		prev_id = p.first;
+	}
+	row_offsets.push_back((int) weights.size());
+	encoded_offsets.push_back((int) encoded_ids.size());
+}
+
+void SimpleIndex::FrozenLists::shrinkToFit(){
+	vector<int>(row_offsets).swap(row_offsets);
+	vector<int>(encoded_offsets).swap(encoded_offsets);
+	vector<unsigned char>(encoded_ids).swap(encoded_ids);
+	vector<float>(weights).swap(weights);
+}
+
+PostingList SimpleIndex::FrozenLists::getRow(int row) const{
+	if (row < 0 || row >= getRowCount()){
+		return PostingList();
+	}
+	int length = row_offsets[row + 1] - row_offsets[row];
+	if (length == 0){
+		return PostingList();
+	}
+	return PostingList(&encoded_ids[encoded_offsets[row]], &weights[row_offsets[row]], length);
+}
+
+size_t SimpleIndex::FrozenLists::estimateSize() const{
+	return (row_offsets.capacity() + encoded_offsets.capacity()) * sizeof(int)
+		+ encoded_ids.capacity() + weights.capacity() * sizeof(float);
+}
+
+SimpleKLRetriever::SimpleKLRetriever(const ColProbs &col_probs_, double dir_prior_):
+	col_probs(&col_probs_),
+	dir_prior(dir_prior_)
+{
 }
 
 void SimpleKLRetriever::retrieve(const SimpleIndex &index, const ValueMap &query_term_counts, std::vector<std::pair<int, double> > &ranking) const {
@@ -99,14 +291,10 @@ void SimpleKLRetriever::retrieve(const SimpleIndex &index, const ValueMap &query
 		const double col_prob = getColProb(term_id);
 		col_likelihood += query_term_count * log(col_prob);
 
-		const vector<pair<int, float> > *doc_list = index.getDocList(term_id);
-		if (doc_list) {
-			typedef pair<int, float> P;
-			BOOST_FOREACH(const P &p, *doc_list) {
-				const int doc_id = p.first;
-				const float doc_term_count = p.second;
-				doc_scores[doc_id] += query_term_count * log(1.0 + doc_term_count / dir_prior / col_prob);
-			}
+		for (PostingList::Iterator itr = index.getDocList(term_id).iterator(); itr.ok(); itr.next()) {
+			const int doc_id = itr.id();
+			const float doc_term_count = itr.weight();
+			doc_scores[doc_id] += query_term_count * log(1.0 + doc_term_count / dir_prior / col_prob);
 		}
 	}
 
@@ -121,4 +309,158 @@ void SimpleKLRetriever::retrieve(const SimpleIndex &index, const ValueMap &query
 	sort(ranking.begin(), ranking.end(), util::cmp2ndReverse<int, double>);
 }
 
+void SimpleKLRetriever::retrieve(const SimpleIndex &index, const ValueMap &query_term_counts, int k, vector<pair<int, double> > &ranking) const {
+	ranking.clear();
+	vector<Hit> heap;
+	retrieveTop(index, 0, query_term_counts, k, heap);
+	sort(heap.begin(), heap.end());
+	BOOST_FOREACH(const Hit &hit, heap) {
+		ranking.push_back(make_pair(hit.doc_id, hit.score));
+	}
+}
+
+void SimpleKLRetriever::retrieve(const vector<const SimpleIndex*> &indices, const ValueMap &query_term_counts, int k,
+		vector<pair<pair<int, int>, double> > &ranking) const {
+	ranking.clear();
+	// Later indices start with the k-th score of earlier ones, so they are pruned harder.
+	vector<Hit> heap;
+	for (size_t i = 0; i < indices.size(); ++ i) {
+		retrieveTop(*indices[i], (int) i, query_term_counts, k, heap);
+	}
+	sort(heap.begin(), heap.end());
+	BOOST_FOREACH(const Hit &hit, heap) {
+		ranking.push_back(make_pair(make_pair(hit.index_pos, hit.doc_id), hit.score));
+	}
+}
+
+void SimpleKLRetriever::addHit(const Hit &hit, size_t k, vector<Hit> &heap) {
+	if (heap.size() < k) {
+		heap.push_back(hit);
+		push_heap(heap.begin(), heap.end());
+	}
+	else if (hit < heap.front()) {
+		pop_heap(heap.begin(), heap.end());
+		heap.back() = hit;
+		push_heap(heap.begin(), heap.end());
+	}
+}
+
+void SimpleKLRetriever::retrieveTop(const SimpleIndex &index, int index_pos, const ValueMap &query_term_counts, int k, vector<Hit> &heap) const {
+	if (k <= 0) {
+		return;
+	}
+	// The score of a doc is (doc_score + col_likelihood) / query_length + length_score, where doc_score sums
+	// query_term_count * log(1 + doc_term_count / dir_prior / col_prob) over the query terms in the doc, as in retrieve().
+	double query_length = 0.0;
+	double col_likelihood = 0.0;
+	double max_length_score = 0.0;
+	bool bounded = true;
+	int query_term_total = 0;
+	vector<TermCursor> cursors;
+	for (shared_ptr<ConstValueIterator> value_itr = query_term_counts.const_iterator(); value_itr->ok(); value_itr->next()){
+		const int query_pos = query_term_total ++;
+		const int term_id = value_itr->id();
+		const double query_term_count = value_itr->get();
+		query_length += query_term_count;
+		const double col_prob = getColProb(term_id);
+		col_likelihood += query_term_count * log(col_prob);
+		bounded = bounded && query_term_count > 0.0;
+
+		float max_weight;
+		double min_doc_length;
+		if (! index.getTermBounds(term_id, max_weight, min_doc_length)) {
+			continue;
+		}
+		const double length_score = log(dir_prior / (min_doc_length + dir_prior));
+		if (cursors.empty() || length_score > max_length_score) {
+			max_length_score = length_score;
+		}
+		cursors.push_back(TermCursor(index.getDocList(term_id), query_pos, query_term_count, col_prob, query_term_count * log(1.0 + max_weight / dir_prior / col_prob)));
+	}
+	if (! bounded) {
+		// Scores only grow with matching terms when query term weights are positive; score every doc instead.
+		vector<pair<int, double> > ranking;
+		retrieve(index, query_term_counts, ranking);
+		typedef pair<int, double> P;
+		BOOST_FOREACH(const P &p, ranking) {
+			addHit(Hit(p.second, index_pos, p.first), k, heap);
+		}
+		return;
+	}
+
+	sort(cursors.begin(), cursors.end());
+	vector<double> max_doc_scores(cursors.size()); ///< most the terms up to i can add to doc_score
+	for (size_t i = 0; i < cursors.size(); ++ i) {
+		max_doc_scores[i] = (i > 0 ? max_doc_scores[i - 1] : 0.0) + cursors[i].max_score;
+	}
+
+	// Scores of the terms in the doc at hand, by position in the query.
+	vector<double> term_scores(query_term_total);
+	vector<char> term_matched(query_term_total, 0);
+
+	// Terms before first_essential cannot bring a doc into the top k on their own,
+	// so docs are found through the other terms, and only looked up in these.
+	size_t first_essential = 0;
+	while (true) {
+		if (heap.size() == (size_t) k) {
+			while (first_essential < cursors.size()
+					&& (max_doc_scores[first_essential] + col_likelihood) / query_length + max_length_score <= heap.front().score - BOUND_SLACK) {
+				++ first_essential;
+			}
+		}
+		int doc_id = INT_MAX;
+		for (size_t i = first_essential; i < cursors.size(); ++ i) {
+			if (cursors[i].itr.ok()) {
+				doc_id = min(doc_id, cursors[i].itr.id());
+			}
+		}
+		if (doc_id == INT_MAX) {
+			break;
+		}
+
+		// The partial score only serves the bounds; the score itself is summed up below.
+		double partial_score = 0.0;
+		for (size_t i = first_essential; i < cursors.size(); ++ i) {
+			TermCursor &cursor = cursors[i];
+			if (cursor.itr.ok() && cursor.itr.id() == doc_id) {
+				const double term_score = cursor.query_term_count * log(1.0 + cursor.itr.weight() / dir_prior / cursor.col_prob);
+				term_scores[cursor.query_pos] = term_score;
+				term_matched[cursor.query_pos] = 1;
+				partial_score += term_score;
+				cursor.itr.next();
+			}
+		}
+		const double length_score = log(dir_prior / (index.getDocLength(doc_id) + dir_prior));
+		bool pruned = false;
+		for (size_t i = first_essential; i -- > 0; ) {
+			if (heap.size() == (size_t) k
+					&& (partial_score + max_doc_scores[i] + col_likelihood) / query_length + length_score <= heap.front().score - BOUND_SLACK) {
+				pruned = true;
+				break;
+			}
+			TermCursor &cursor = cursors[i];
+			cursor.itr.skipTo(doc_id);
+			if (cursor.itr.ok() && cursor.itr.id() == doc_id) {
+				const double term_score = cursor.query_term_count * log(1.0 + cursor.itr.weight() / dir_prior / cursor.col_prob);
+				term_scores[cursor.query_pos] = term_score;
+				term_matched[cursor.query_pos] = 1;
+				partial_score += term_score;
+			}
+		}
+
+		// Terms are added in query order, as in retrieve(), so that a doc gets exactly the same score.
+		double doc_score = 0.0;
+		for (int query_pos = 0; query_pos < query_term_total; ++ query_pos) {
+			if (term_matched[query_pos]) {
+				doc_score += term_scores[query_pos];
+				term_matched[query_pos] = 0;
+			}
+		}
+		// Like retrieve(), leaves out docs that the query terms add nothing to.
+		if (! pruned && doc_score > 0.0) {
+			addHit(Hit((doc_score + col_likelihood) / query_length + length_score, index_pos, doc_id), k, heap);
+		}
+	}
+}
+
 } // namespace indexing
@@ -10,10 +10,107 @@
 
 namespace indexing {
 
+/*! \brief A list of (id, weight) pairs in a SimpleIndex, viewed where it is stored.
+ *
+ *  Valid until the index changes. Ids are either stored with their weights as pairs,
+ *  or, in a frozen index, delta and varint encoded, apart from their weights.
+ */
+class PostingList{
+public:
+	class Iterator;
+
+	/// An empty list.
+	PostingList(): pairs(NULL), encoded_ids(NULL), weights(NULL), length(0) {}
+
+	/// A list of pairs.
+	PostingList(const std::pair<int, float> *pairs_, int length_): pairs(pairs_), encoded_ids(NULL), weights(NULL), length(length_) {}
+
+	/// A list of ascending ids, each encoded as a varint of its difference with the previous one, and their weights.
+	PostingList(const unsigned char *encoded_ids_, const float *weights_, int length_): pairs(NULL), encoded_ids(encoded_ids_), weights(weights_), length(length_) {}
+
+	/// Returns the number of pairs.
+	int size() const { return length; }
+
+	bool empty() const { return length == 0; }
+
+	/// Returns an iterator at the first pair.
+	Iterator iterator() const;
+
+private:
+	friend class Iterator;
+
+	const std::pair<int, float> *pairs;
+	const unsigned char *encoded_ids;
+	const float *weights;
+	int length;
+};
+
+/// Iterates over a PostingList, in the style of ConstValueIterator (but not virtual).
+class PostingList::Iterator{
+public:
+	Iterator(const PostingList &list_): list(list_), pos(0), current_id(0), current_weight(0.0f), encoded_pos(list_.encoded_ids) { read(); }
+
+	/// Whether there is id/weight at current position.
+	bool ok() const { return pos < list.length; }
+
+	/// Move to the next position.
+	void next() { ++ pos; read(); }
+
+	/// Move to the first position whose id is at least a given id.
+	void skipTo(int id) {
+		while (ok() && current_id < id) {
+			next();
+		}
+	}
+
+	/// Id at the current position.
+	int id() const { return current_id; }
+
+	/// Weight at the current position.
+	float weight() const { return current_weight; }
+
+private:
+	void read(){
+		if (! ok()){
+			return;
+		}
+		if (list.pairs){
+			current_id = list.pairs[pos].first;
+			current_weight = list.pairs[pos].second;
+			return;
+		}
+		unsigned int delta = 0;
+		for (int shift = 0; ; shift += 7){
+			unsigned char b = *encoded_pos ++;
+			delta |= (unsigned int) (b & 0x7f) << shift;
+			if (! (b & 0x80)){
+				break;
+			}
+		}
+		current_id += (int) delta;
+		current_weight = list.weights[pos];
+	}
+
+	PostingList list;
+	int pos;
+	int current_id;
+	float current_weight;
+	const unsigned char *encoded_pos;
+};
+
+inline PostingList::Iterator PostingList::iterator() const {
+	return Iterator(*this);
+}
+
 /*! \brief A simple in-memory inverted index.
  *
  *  Maintains a term-doc matrix. One can look up terms in a doc and docs having a term.
  *  Index is initially empty and docs can be added to it.
+ *
+ *  Once all docs are added, the index can be frozen: postings are moved from one tree node and vector per term
+ *  into a compressed sparse row layout, with offsets by term id (or doc id), doc ids (or term ids) delta and varint encoded,
+ *  and weights in a contiguous array. This takes less memory and is faster to scan.
+ *  Adding a doc to a frozen index thaws it first, which copies all postings back, so freeze an index only when it is built.
  *  \sa SimpleKLRetriever
  */
 class SimpleIndex{
@@ -34,6 +131,12 @@ public:
 	 */
 	bool addDoc(const std::string &doc_name, const ValueMap &doc_term_counts);
 
+	/// Moves the postings into the compact layout; see class description.
+	void freeze();
+
+	/// Whether the index is frozen.
+	bool isFrozen() const { return frozen; }
+
 	/// Returns number of docs in index.
 	int getDocCount() const;
 
@@ -41,23 +144,38 @@ public:
 	double getDocLength(int doc_id) const;
 
 	/*! \brief Returns terms in a doc (term ids and weights).
+	 *
+	 *  In a frozen index, term ids are in ascending order.
 	 *  \param doc_id doc id
-	 *  \return NULL if doc does not exist in index
 	 */
-	const std::vector<std::pair<int, float> >* getTermList(int doc_id) const;
-	/*! \brief Returns docs having a term (doc ids and term weights in the corresponding docs)
+	PostingList getTermList(int doc_id) const;
+	/*! \brief Returns docs having a term (doc ids, in ascending order, and term weights in the corresponding docs)
 	 *  \param term_id term id
-	 *  \return NULL if term does not exist in index
+	 *  \return an empty list if term does not exist in index
+	 */
+	PostingList getDocList(int term_id) const;
+
+	/*! \brief Returns bounds of the postings of a term, for pruning in top-k retrieval.
+	 *  \param[in] term_id term id
+	 *  \param[out] max_weight largest weight of the term in a doc
+	 *  \param[out] min_doc_length length of the shortest doc having the term
+	 *  \return false if term does not exist in index
 	 */
-	const std::vector<std::pair<int, float> >* getDocList(int term_id) const;
+	bool getTermBounds(int term_id, float &max_weight, double &min_doc_length) const;
 
 	/// Returns the term id-name dict.
 	NameDict& getTermDict() { return term_dict; }
 	/// Returns the doc id-name dict.
 	NameDict& getDocDict() { return doc_dict; }
 
+	/// Returns a rough estimate of the memory taken by the postings, in bytes.
+	size_t estimateSize() const;
+
 private:
 
+	/// Moves the postings back from the compact layout, so that docs can be added.
+	void thaw();
+
 	NameDict &term_dict; ///< term id-name dict
 	NameDict doc_dict; ///< doc id-name dict
 
@@ -66,17 +184,61 @@ private:
 	public:
 		DocInfo(): doc_length(0.0) {}
 		double doc_length; ///< doc length
-		std::vector<std::pair<int, float> > term_list; ///< term ids and weights
+		std::vector<std::pair<int, float> > term_list; ///< term ids and weights; empty once frozen
+	};
+
+	/// Bounds of the postings of a term; see getTermBounds.
+	class TermBounds{
+	public:
+		TermBounds(): max_weight(0.0f), min_doc_length(0.0) {}
+		float max_weight;
+		double min_doc_length;
 	};
 
 	class TermInfo{
 	public:
 		std::vector<std::pair<int, float> > doc_list; ///< doc ids and term weights in the corresponding docs
+		TermBounds bounds;
+	};
+
+	/*! \brief Lists of (id, weight) pairs, one per row, end to end.
+	 *
+	 *  Ids in a row are ascending, and stored as varints of their differences; weights are stored apart.
+	 */
+	class FrozenLists{
+	public:
+		/// Removes all rows.
+		void clear();
+
+		/// Appends a row, whose ids must be ascending.
+		void addRow(const std::vector<std::pair<int, float> > &row);
+
+		/// Gives back memory reserved for more rows.
+		void shrinkToFit();
+
+		/// Returns the number of rows.
+		int getRowCount() const { return (int) row_offsets.size() - 1; }
+
+		/// Returns a row, or an empty list if there is no such row.
+		PostingList getRow(int row) const;
+
+		size_t estimateSize() const;
+
+	private:
+		std::vector<int> row_offsets; ///< weights of row r at [row_offsets[r], row_offsets[r + 1]); empty if there are no rows
+		std::vector<int> encoded_offsets; ///< encoded ids of row r start at encoded_offsets[r]
+		std::vector<unsigned char> encoded_ids;
+		std::vector<float> weights;
 	};
 
 	std::vector<DocInfo> doc_info_list; ///< map from doc id (array subscript) to DocInfo
 
-	std::map<int, TermInfo> term_info_map; /// map from term id to TermInfo
+	std::map<int, TermInfo> term_info_map; /// map from term id to TermInfo; empty once frozen
+
+	bool frozen;
+	FrozenLists frozen_doc_lists; ///< docs having a term, by term id
+	FrozenLists frozen_term_lists; ///< terms in a doc, by doc id
+	std::vector<TermBounds> frozen_term_bounds; ///< by term id
 };
 
 /*! A simple KL retrieval method to work with SimpleIndex
@@ -86,11 +248,10 @@ class SimpleKLRetriever {
 public:
 
 	/*! \brief Constructor.
-	 *  \param col_probs term probabilities in a background collection
-	 *  \param default_col_prob background probability for a term that has not appeared in collection
+	 *  \param col_probs term probabilities in a background collection; referred to, not copied, so it must outlive the retriever
 	 *  \param dir_prior Dirichlet prior
 	 */
-	SimpleKLRetriever(const ValueMap &col_probs, double default_col_prob, double dir_prior);
+	SimpleKLRetriever(const ColProbs &col_probs, double dir_prior);
 
 	/*! \brief Ranks docs given a query.
 	 *  \param[in] SimpleIndex simple inverted index
@@ -100,17 +261,65 @@ public:
 	 */
 	void retrieve(const SimpleIndex &index, const ValueMap &query_term_counts, std::vector<std::pair<int, double> > &ranking) const;
 
+	/*! \brief Ranks docs given a query, keeping only the top k.
+	 *
+	 *  Finds the same top docs as retrieve() above, going through the docs in order of doc id, with MaxScore pruning:
+	 *  the score a term can add to a doc is bounded using the term's largest weight in a doc, and the doc length part
+	 *  of the score using the shortest doc having a term. Once k docs are found, terms whose bounds together cannot beat
+	 *  the k-th score are only looked up for docs found through other terms, and a doc is dropped as soon as
+	 *  its bound falls below the k-th score. Docs with the same score are ranked by doc id.
+	 *  Scores are the same as those of retrieve(), to the last bit, and docs that the query terms add nothing to are
+	 *  left out in the same way, so the ranking is the first k of retrieve() (up to the order of docs with the same score).
+	 *  \param[in] index simple inverted index
+	 *  \param[in] query_term_counts query term ids and weights
+	 *  \param[in] k number of docs to keep
+	 *  \param[out] ranking doc ids and relevance scores ranked by score.
+	 */
+	void retrieve(const SimpleIndex &index, const ValueMap &query_term_counts, int k, std::vector<std::pair<int, double> > &ranking) const;
+
+	/*! \brief Ranks docs of several indices together, keeping only the top k, as above.
+	 *  \param[in] indices simple inverted indices
+	 *  \param[in] query_term_counts query term ids and weights
+	 *  \param[in] k number of docs to keep
+	 *  \param[out] ranking (position of index in indices, doc id) pairs and relevance scores ranked by score.
+	 *               docs with the same score are ranked by index position, then doc id.
+	 */
+	void retrieve(const std::vector<const SimpleIndex*> &indices, const ValueMap &query_term_counts, int k,
+			std::vector<std::pair<std::pair<int, int>, double> > &ranking) const;
+
 private:
 
+	/// A doc found in top-k retrieval.
+	class Hit{
+	public:
+		Hit(double score_, int index_pos_, int doc_id_): score(score_), index_pos(index_pos_), doc_id(doc_id_) {}
+
+		/// Whether this hit ranks before another.
+		bool operator < (const Hit &other) const {
+			if (score != other.score) {
+				return score > other.score;
+			}
+			return index_pos != other.index_pos ? index_pos < other.index_pos : doc_id < other.doc_id;
+		}
+
+		double score;
+		int index_pos;
+		int doc_id;
+	};
+
+	/// Adds docs of an index that make the top k to a heap of at most k hits, whose front is the last ranked.
+	void retrieveTop(const SimpleIndex &index, int index_pos, const ValueMap &query_term_counts, int k, std::vector<Hit> &heap) const;
+
+	/// Adds a hit to a heap of at most k hits, if it makes the top k.
+	static void addHit(const Hit &hit, size_t k, std::vector<Hit> &heap);
+
 	/*! \brief Returns probability of a term in the background collection.
 	 *
 	 *  If a term has not appeared in the collection, just return a default value.
 	 */
-	double getColProb(int term_id) const;
-
-	boost::shared_ptr<const ValueMap> col_probs; ///< map from term ids to their probabilities in the background collection
+	double getColProb(int term_id) const { return col_probs->get(term_id); }
 
-	double default_col_prob; ///< background probability for a term that has not appeared in collection
+	const ColProbs *col_probs; ///< term probabilities in the background collection
 
 	double dir_prior; ///< Dirichlet prior
 };
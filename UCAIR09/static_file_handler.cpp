@@ -3,6 +3,8 @@
 #include <boost/bind.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/foreach.hpp>
+#include <boost/format.hpp>
 #include "common_util.h"
 #include "config.h"
 #include "ucair_util.h"
@@ -54,12 +56,14 @@ string extensionToType(const string& extension_){
 
 namespace ucair {
 
-StaticFileHandler::StaticFileHandler() : static_prefix("/static") {
+StaticFileHandler::StaticFileHandler() : static_prefix("/static"), check_interval(0), max_cached_file_size(0) {
 }
 
 bool StaticFileHandler::initialize(){
 	getUCAIRServer().registerHandler(RequestHandler::STATIC, static_prefix, bind(&StaticFileHandler::handleStaticFile, this, _1, _2));
 	doc_root = util::getParam<string>(Main::instance().getConfig(), "doc_root");
+	check_interval = util::getParam<int>(Main::instance().getConfig(), "static_file_check_interval");
+	max_cached_file_size = util::getParam<size_t>(Main::instance().getConfig(), "static_file_max_cached_size");
 	return true;
 }
 
@@ -86,35 +90,167 @@ void StaticFileHandler::handleStaticFile(Request &request, Reply &reply){
 	}
 
 	filesystem::path full_path = doc_root / path;
+	CachedFile *file = getFile(full_path);
+	if (! file){
+		getUCAIRServer().err(reply_status::not_found);
+	}
+
+	reply.setHeader("Content-Type", file->content_type);
+	reply.setHeader("Last-Modified", file->last_modified_string);
+
+	// Use a compressed variant if the client accepts it.
+	UCAIRServer &server = getUCAIRServer();
+	shared_ptr<const string> content = file->content;
+	http::util::ContentEncoding encoding = http::util::IDENTITY;
+	string etag = file->etag;
+	if (file->size >= server.getCompressMinSize()){
+		encoding = server.getContentEncoding(reply);
+		if (encoding != http::util::IDENTITY && content){
+			shared_ptr<const string> &compressed_content = file->compressed_content[encoding];
+			if (! compressed_content){
+				shared_ptr<string> s(new string);
+				http::util::compress(*content, *s, encoding, server.getCompressLevel());
+				compressed_content = s;
+			}
+			if (compressed_content->size() < content->size()){
+				content = compressed_content;
+			}
+			else{
+				encoding = http::util::IDENTITY;
+			}
+		}
+		else if (file->incompressible.count(encoding)){
+			encoding = http::util::IDENTITY;
+		}
+		if (encoding != http::util::IDENTITY){
+			// A strong ETag identifies the exact bytes sent.
+			etag.insert(etag.length() - 1, "-" + http::util::toString(encoding));
+		}
+	}
+	reply.setHeader("ETag", etag);
+
+	if (isNotModified(request, *file, etag)){
+		reply.status = reply_status::not_modified;
+		return;
+	}
+
+	if (! content){
+		// Too large to be kept in memory.
+		ifstream fin(full_path.string().c_str(), ios::in | ios::binary);
+		if (! fin){
+			getUCAIRServer().err(reply_status::not_found);
+		}
+		shared_ptr<string> s(new string);
+		util::readFile(fin, *s);
+		content = s;
+		if (encoding != http::util::IDENTITY){
+			shared_ptr<string> compressed_content(new string);
+			http::util::compress(*content, *compressed_content, encoding, server.getCompressLevel());
+			if (compressed_content->size() < content->size()){
+				server.countCompression(content->size(), compressed_content->size());
+				content = compressed_content;
+			}
+			else{
+				// Not worth trying again for this file.
+				file->incompressible.insert(encoding);
+				encoding = http::util::IDENTITY;
+				reply.setHeader("ETag", file->etag);
+			}
+		}
+	}
+	else if (encoding != http::util::IDENTITY){
+		server.countCompression(file->content->size(), content->size());
+	}
+
+	// Shared content is not compressed again by the server.
+	reply.shared_content = content;
+	if (encoding != http::util::IDENTITY){
+		reply.setHeader("Content-Encoding", http::util::toString(encoding));
+	}
+}
+
+StaticFileHandler::CachedFile* StaticFileHandler::getFile(const filesystem::path &full_path){
+	posix_time::ptime now = posix_time::microsec_clock::universal_time();
+	map<string, CachedFile>::iterator itr = cached_files.find(full_path.string());
+	if (itr != cached_files.end() && now < itr->second.check_time + posix_time::seconds(check_interval)){
+		return &itr->second;
+	}
 
 	// Only serves regular files (for security reasons).
 	if (! is_regular_file(full_path)){
-		getUCAIRServer().err(reply_status::not_found);
+		if (itr != cached_files.end()){
+			cached_files.erase(itr);
+		}
+		return NULL;
 	}
 
-	// Checks If-Modified-Since.
-	time_t last_modified = filesystem::last_write_time(full_path);
-	string s = request.getHeader("If-Modified-Since");
-	if (! s.empty()){
-		time_t if_modified_since = util::to_time_t(util::stringToTime(s, util::internet_time_format));
-		if (last_modified == if_modified_since){
-			reply.status = reply_status::not_modified;
-			return;
+	if (itr == cached_files.end() || itr->second.last_modified != filesystem::last_write_time(full_path)){
+		CachedFile file;
+		if (! loadFile(full_path, file)){
+			if (itr != cached_files.end()){
+				cached_files.erase(itr);
+			}
+			return NULL;
 		}
+		itr = cached_files.insert(make_pair(full_path.string(), CachedFile())).first;
+		itr->second = file;
 	}
+	itr->second.check_time = now;
+	return &itr->second;
+}
 
-	// Open the file to send back.
-	ifstream fin(full_path.string().c_str(), ios::in | ios::binary);
-	if (! fin){
-		getUCAIRServer().err(reply_status::not_found);
+bool StaticFileHandler::loadFile(const filesystem::path &full_path, CachedFile &file){
+	file.last_modified = filesystem::last_write_time(full_path);
+	uintmax_t size = filesystem::file_size(full_path);
+	file.size = static_cast<size_t>(size);
+	file.content_type = mime_types::extensionToType(full_path.extension());
+	posix_time::ptime t = posix_time::from_time_t(file.last_modified);
+	file.last_modified_string = util::timeToString(t, util::internet_time_format);
+
+	if (size <= max_cached_file_size){
+		ifstream fin(full_path.string().c_str(), ios::in | ios::binary);
+		if (! fin){
+			return false;
+		}
+		shared_ptr<string> content(new string);
+		util::readFile(fin, *content);
+		file.content = content;
+		unsigned long checksum = crc32(0, reinterpret_cast<const Bytef*>(content->data()), static_cast<uInt>(content->size()));
+		file.etag = str(format("\"%08x-%x\"") % checksum % content->size());
+	}
+	else{
+		file.etag = str(format("\"%x-%x\"") % file.last_modified % size);
 	}
+	return true;
+}
 
-	// Fill out the reply to be sent to the client.
-	util::readFile(fin, reply.content);
-	reply.setHeader("Content-Type", mime_types::extensionToType(path.extension()));
+bool StaticFileHandler::isNotModified(const Request &request, const CachedFile &file, const string &etag){
+	// If-None-Match takes precedence over If-Modified-Since.
+	string if_none_match = request.getHeader("If-None-Match");
+	if (! if_none_match.empty()){
+		vector<string> tags;
+		split(tags, if_none_match, is_any_of(","));
+		BOOST_FOREACH(string &tag, tags){
+			trim(tag);
+			if (starts_with(tag, "W/")){
+				erase_head(tag, 2);
+			}
+			if (tag == "*" || tag == etag || tag == file.etag){
+				return true;
+			}
+		}
+		return false;
+	}
 
-	posix_time::ptime t = posix_time::from_time_t(last_modified);
-	reply.setHeader("Last-Modified", util::timeToString(t, util::internet_time_format));
+	string if_modified_since = request.getHeader("If-Modified-Since");
+	if (! if_modified_since.empty()){
+		// Browsers send back the Last-Modified value unchanged, so parsing is rarely needed.
+		if (if_modified_since == file.last_modified_string){
+			return true;
+		}
+		return util::to_time_t(util::stringToTime(if_modified_since, util::internet_time_format)) == file.last_modified;
+	}
+	return false;
 }
 
 } // namespace ucair
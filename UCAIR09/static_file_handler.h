@@ -1,14 +1,25 @@
 #ifndef __static_file_handler_h__
 #define __static_file_handler_h__
 
+#include <ctime>
+#include <map>
+#include <set>
 #include <string>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/shared_ptr.hpp>
 #include "component.h"
+#include "content_encoding.h"
 #include "ucair_server.h"
 #include "main.h"
 
 namespace ucair {
 
-/// Handler of static files for the UCAIR server.
+/*! \brief Handler of static files for the UCAIR server.
+ *
+ *  Files are kept in memory together with their reply headers.
+ *  A cached file is checked for modification at most once every static_file_check_interval seconds.
+ */
 class StaticFileHandler: public Component {
 public:
 
@@ -16,7 +27,7 @@ public:
 
 	bool initialize();
 
-	/// Page handler. Reads file content and use it for reply body.
+	/// Page handler. Uses (cached) file content for reply body.
 	void handleStaticFile(Request &request, Reply &reply);
 
 	std::string static_prefix; ///< where this handler is hooked. default is "/static"
@@ -26,6 +37,38 @@ public:
 	 *  then /static/foo/bar.htm will map to C:/ucair/foo/bar.htm
 	 */
 	std::string doc_root;
+
+private:
+	/// A file in memory.
+	struct CachedFile {
+		boost::posix_time::ptime check_time; ///< when the file was last checked for modification
+		time_t last_modified; ///< file modification time
+		size_t size; ///< file size
+		boost::shared_ptr<const std::string> content; ///< file content, NULL if file is too large to be cached
+		std::string content_type; ///< Content-Type header
+		std::string last_modified_string; ///< Last-Modified header
+		std::string etag; ///< ETag header, computed from content
+		/// Compressed variants of content, computed when first requested.
+		std::map<http::util::ContentEncoding, boost::shared_ptr<const std::string> > compressed_content;
+		/// Encodings found not to shrink a file too large to be cached, which is then sent as is.
+		std::set<http::util::ContentEncoding> incompressible;
+	};
+
+	/*! \brief Returns a file from the cache, loading it if not cached or modified.
+	 *  \return NULL if the file does not exist
+	 */
+	CachedFile* getFile(const boost::filesystem::path &full_path);
+
+	/// Reads a file into the cache.
+	bool loadFile(const boost::filesystem::path &full_path, CachedFile &file);
+
+	/// Checks whether a conditional request can be answered with 304 Not Modified.
+	static bool isNotModified(const Request &request, const CachedFile &file, const std::string &etag);
+
+	std::map<std::string, CachedFile> cached_files; ///< map from full path to file
+
+	int check_interval; ///< seconds a cached file is used without checking for modification
+	size_t max_cached_file_size; ///< larger files are read from disk every time
 };
 
 DECLARE_GET_COMPONENT(StaticFileHandler)
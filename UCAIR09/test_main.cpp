@@ -1,16 +1,354 @@
 #include "test_main.h"
+#include <cmath>
+#include <fstream>
 #include <iostream>
 #include <map>
+#include <boost/algorithm/string.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/foreach.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_real.hpp>
+#include <boost/random/variate_generator.hpp>
+#include <boost/tuple/tuple.hpp>
 
+#include "aol_wrapper.h"
 #include "bing_wrapper.h"
+#include "common_util.h"
+#include "federated_search_engine.h"
+#include "index_util.h"
+#include "latency_histogram.h"
+#include "request.h"
+#include "request_parser.h"
+#include "simple_index.h"
 
 using namespace std;
+using namespace boost;
 
 namespace ucair {
 
+/// Times the HTTP request parser on a typical browser request for a static file, whole and split across two reads.
+void benchmarkRequestParser() {
+	const string data =
+		"GET /static/css/ucair.css?v=20100412 HTTP/1.1\r\n"
+		"Host: localhost:8080\r\n"
+		"User-Agent: Mozilla/5.0 (Windows; U; Windows NT 6.1; en-US; rv:1.9.2.3) Gecko/20100401 Firefox/3.6.3 (.NET CLR 3.5.30729)\r\n"
+		"Accept: text/css,*/*;q=0.1\r\n"
+		"Accept-Language: en-us,en;q=0.5\r\n"
+		"Accept-Encoding: gzip,deflate\r\n"
+		"Accept-Charset: ISO-8859-1,utf-8;q=0.7,*;q=0.7\r\n"
+		"Keep-Alive: 115\r\n"
+		"Connection: keep-alive\r\n"
+		"Referer: http://localhost:8080/search?sid=1271087635&page=2\r\n"
+		"Cookie: ucair_user=2f9c1e7a; __utma=111872281.1404283957.1270678519.1271081409.1271087022.9; __utmz=111872281.1270678519.1.1.utmcsr=(direct)|utmccn=(direct)|utmcmd=(none)\r\n"
+		"If-Modified-Since: Mon, 12 Apr 2010 15:44:10 GMT\r\n"
+		"Cache-Control: max-age=0\r\n"
+		"\r\n";
+	const int iterations = 200000;
+	const char *begin = data.data();
+	const char *end = begin + data.size();
+
+	http::server::Request request;
+	http::server::RequestParser parser(8 * 1024);
+	tribool result;
+	const char *pos;
+
+	posix_time::ptime start_time = posix_time::microsec_clock::universal_time();
+	for (int i = 0; i < iterations; ++ i) {
+		request.reset();
+		parser.reset();
+		tie(result, pos) = parser.parse(request, begin, end);
+		if (! result || pos != end) {
+			cerr << "parse failed" << endl;
+			return;
+		}
+	}
+	posix_time::time_duration whole = posix_time::microsec_clock::universal_time() - start_time;
+
+	start_time = posix_time::microsec_clock::universal_time();
+	for (int i = 0; i < iterations; ++ i) {
+		request.reset();
+		parser.reset();
+		const char *split = begin + 1 + i % (data.size() - 1);
+		tie(result, pos) = parser.parse(request, begin, split);
+		tie(result, pos) = parser.parse(request, pos, end);
+		if (! result || pos != end) {
+			cerr << "parse failed" << endl;
+			return;
+		}
+	}
+	posix_time::time_duration split = posix_time::microsec_clock::universal_time() - start_time;
+
+	cout << data.size() << " byte request, " << request.headers.size() << " header fields" << endl;
+	cout << "whole: " << whole.total_microseconds() * 1000.0 / iterations << " ns/request" << endl;
+	cout << "split in two reads: " << split.total_microseconds() * 1000.0 / iterations << " ns/request" << endl;
+}
+
+/*! \brief Times the search page parsers on saved search pages.
+ *  \param dir directory of saved pages, whose file names start with the search engine id (e.g. bing_czhai_11.htm)
+ */
+void benchmarkSearchPageParsers(const string &dir) {
+	namespace fs = boost::filesystem;
+	fs::path path(dir);
+	if (! fs::exists(path)) {
+		cerr << "No saved search pages in " << dir << endl;
+		return;
+	}
+	const int iterations = 500;
+	fs::directory_iterator end_itr;
+	for (fs::directory_iterator itr(path); itr != end_itr; ++ itr) {
+		string file_name = itr->leaf();
+		bool (*parse_page)(Search &search, const string &content) = NULL;
+		if (starts_with(file_name, "bing")) {
+			parse_page = &BingWrapper::parsePage;
+		}
+		else if (starts_with(file_name, "aol")) {
+			parse_page = &AOLWrapper::parsePage;
+		}
+		else {
+			continue;
+		}
+		ifstream fin(itr->path().string().c_str(), ios::binary);
+		string content;
+		util::readFile(fin, content);
+
+		Search search;
+		parse_page(search, content);
+		posix_time::ptime start_time = posix_time::microsec_clock::universal_time();
+		for (int i = 0; i < iterations; ++ i) {
+			Search s;
+			parse_page(s, content);
+		}
+		posix_time::time_duration elapsed = posix_time::microsec_clock::universal_time() - start_time;
+		cout << file_name << ": " << content.size() << " bytes, " << search.results.size() << " results, "
+			<< elapsed.total_microseconds() / (double) iterations << " us/page" << endl;
+	}
+}
+
+/*! \brief Times term lookups in a term dict loaded from a collection statistics file.
+ *  \param col_stats_file file of term counts, as read by indexing::loadColProbs
+ */
+void benchmarkTermDict(const string &col_stats_file) {
+	indexing::NameDict term_dict;
+	indexing::ColProbs col_probs;
+	posix_time::ptime start_time = posix_time::microsec_clock::universal_time();
+	if (! indexing::loadColProbs(col_stats_file, term_dict, col_probs)) {
+		cerr << "Cannot load " << col_stats_file << endl;
+		return;
+	}
+	posix_time::time_duration load = posix_time::microsec_clock::universal_time() - start_time;
+
+	vector<string> terms;
+	for (int id = 1; id <= term_dict.size(); ++ id) {
+		terms.push_back(term_dict.getName(id));
+	}
+	const int iterations = 20;
+	long long id_sum = 0;
+	start_time = posix_time::microsec_clock::universal_time();
+	for (int i = 0; i < iterations; ++ i) {
+		BOOST_FOREACH(const string &term, terms) {
+			id_sum += term_dict.getId(term);
+		}
+	}
+	posix_time::time_duration lookup = posix_time::microsec_clock::universal_time() - start_time;
+
+	cout << term_dict.size() << " terms, loaded in " << load.total_milliseconds() << " ms" << endl;
+	cout << "lookup: " << lookup.total_microseconds() * 1000.0 / iterations / terms.size() << " ns/term (" << id_sum << ")" << endl;
+}
+
+/*! \brief Times building, freezing and searching a synthetic long-term search history index.
+ *  \param doc_count number of searches in the history
+ */
+void benchmarkSearchIndex(int doc_count) {
+	typedef map<int, double> TermCounts;
+	const int terms_per_doc = 30;
+	const int vocabulary_size = 50000;
+	const int query_count = 1000;
+	mt19937 random(42);
+	// Term ids with a density of about 1 / id, as words in text.
+	variate_generator<mt19937&, uniform_real<> > draw(random, uniform_real<>(0.0, log((double) vocabulary_size)));
+
+	vector<TermCounts> models(doc_count);
+	BOOST_FOREACH(TermCounts &model, models) {
+		while ((int) model.size() < terms_per_doc) {
+			model[(int) exp(draw())] += 1.0 / terms_per_doc;
+		}
+	}
+	vector<TermCounts> queries(query_count);
+	BOOST_FOREACH(TermCounts &query, queries) {
+		for (int i = 0; i < 3; ++ i) {
+			query[(int) exp(draw())] = 1.0;
+		}
+	}
+
+	indexing::NameDict term_dict;
+	indexing::SimpleIndex index(term_dict);
+	posix_time::ptime start_time = posix_time::microsec_clock::universal_time();
+	for (int i = 0; i < doc_count; ++ i) {
+		index.addDoc(lexical_cast<string>(i), *indexing::ValueMap::from(models[i]));
+	}
+	posix_time::time_duration build = posix_time::microsec_clock::universal_time() - start_time;
+	size_t built_size = index.estimateSize();
+
+	indexing::ColProbs col_probs;
+	col_probs.clear(1.0 / vocabulary_size);
+	for (int term_id = 1; term_id <= vocabulary_size; ++ term_id) {
+		col_probs.set(term_id, 1.0 / term_id / log((double) vocabulary_size));
+	}
+	indexing::SimpleKLRetriever retriever(col_probs, 1.0);
+	vector<pair<int, double> > ranking;
+	long long hit_count[2] = {0, 0};
+	posix_time::time_duration retrieve[2];
+	posix_time::time_duration freeze;
+	for (int frozen = 0; frozen < 2; ++ frozen) {
+		if (frozen) {
+			start_time = posix_time::microsec_clock::universal_time();
+			index.freeze();
+			freeze = posix_time::microsec_clock::universal_time() - start_time;
+		}
+		start_time = posix_time::microsec_clock::universal_time();
+		BOOST_FOREACH(TermCounts &query, queries) {
+			retriever.retrieve(index, *indexing::ValueMap::from(query), ranking);
+			hit_count[frozen] += ranking.size();
+		}
+		retrieve[frozen] = posix_time::microsec_clock::universal_time() - start_time;
+	}
+	const int k = 10;
+	start_time = posix_time::microsec_clock::universal_time();
+	BOOST_FOREACH(TermCounts &query, queries) {
+		retriever.retrieve(index, *indexing::ValueMap::from(query), k, ranking);
+	}
+	posix_time::time_duration retrieve_top = posix_time::microsec_clock::universal_time() - start_time;
+
+	// The top k must be the first k of the full ranking, with the same scores; docs with the same score may come in any order there.
+	int top_mismatch_count = 0;
+	vector<pair<int, double> > top_ranking;
+	BOOST_FOREACH(TermCounts &query, queries) {
+		retriever.retrieve(index, *indexing::ValueMap::from(query), ranking);
+		retriever.retrieve(index, *indexing::ValueMap::from(query), k, top_ranking);
+		map<int, double> scores(ranking.begin(), ranking.end());
+		bool ok = top_ranking.size() == min(ranking.size(), (size_t) k);
+		for (size_t i = 0; ok && i < top_ranking.size(); ++ i) {
+			ok = top_ranking[i].second == ranking[i].second && scores[top_ranking[i].first] == top_ranking[i].second;
+		}
+		if (! ok) {
+			++ top_mismatch_count;
+		}
+	}
+
+	cout << doc_count << " docs, " << terms_per_doc << " terms each" << endl;
+	cout << "build: " << build.total_milliseconds() << " ms, " << built_size / 1024 << " KB" << endl;
+	cout << "freeze: " << freeze.total_milliseconds() << " ms, " << index.estimateSize() / 1024 << " KB" << endl;
+	cout << "retrieve: " << retrieve[0].total_microseconds() / (double) query_count << " us/query, frozen: "
+		<< retrieve[1].total_microseconds() / (double) query_count << " us/query, top " << k << ": "
+		<< retrieve_top.total_microseconds() / (double) query_count << " us/query" << endl;
+	if (hit_count[0] != hit_count[1]) {
+		cerr << "frozen index found " << hit_count[1] << " docs rather than " << hit_count[0] << endl;
+	}
+	if (top_mismatch_count > 0) {
+		cerr << "top " << k << " differs from the full ranking for " << top_mismatch_count << " queries" << endl;
+	}
+}
+
+/// Search engine that makes up a fixed number of results, at urls of its own, for tests.
+class ListSearchEngine: public SearchEngine {
+public:
+	ListSearchEngine(const string &id_, int total_count_): id(id_), total_count(total_count_) {}
+	string getSearchEngineId() const { return id; }
+	string getSearchEngineName() const { return id; }
+	bool fetchResults(Search &search, int &start_pos, int &result_count) {
+		for (int rank = start_pos; rank < start_pos + result_count && rank <= total_count; ++ rank) {
+			SearchResult &result = search.results[rank];
+			result.url = "http://" + id + ".example.com/" + lexical_cast<string>(rank);
+			result.title = id + " " + lexical_cast<string>(rank);
+		}
+		search.setTotalResultCount(total_count);
+		return true;
+	}
+private:
+	string id;
+	int total_count;
+};
+
+/*! \brief Fetches two pages from a federated search over two search engines with no results in common,
+ *  the way SearchProxy fetches pages, and checks that every result of either comes exactly once.
+ */
+void testFederatedSearchPages() {
+	const int result_count = 10;
+	const int page_count = 2;
+	vector<shared_ptr<SearchEngine> > members;
+	members.push_back(shared_ptr<SearchEngine>(new ListSearchEngine("a", 100)));
+	members.push_back(shared_ptr<SearchEngine>(new ListSearchEngine("b", 100)));
+	FederatedSearchEngine search_engine(members, 1000);
+
+	Search search;
+	search.query.text = "test";
+	search.setSearchId("test");
+	for (int page = 1; page <= page_count; ++ page) {
+		Search fetched;
+		fetched.query = search.query;
+		fetched.setSearchId(search.getSearchId());
+		fetched.source_depths = search.source_depths;
+		int start_pos = search.results.size() + 1;
+		int count = result_count;
+		if (! search_engine.fetchResults(fetched, start_pos, count)) {
+			cerr << "federated search failed on page " << page << endl;
+			return;
+		}
+		search.results.insert(fetched.results.begin(), fetched.results.end());
+		search.source_depths = fetched.source_depths;
+	}
+
+	map<string, int> url_counts;
+	for (map<int, SearchResult>::const_iterator itr = search.results.begin(); itr != search.results.end(); ++ itr) {
+		++ url_counts[itr->second.url];
+	}
+	int missing_count = 0;
+	int repeated_count = 0;
+	BOOST_FOREACH(const shared_ptr<SearchEngine> &member, members) {
+		for (int rank = 1; rank <= page_count * result_count; ++ rank) {
+			int url_count = url_counts["http://" + member->getSearchEngineId() + ".example.com/" + lexical_cast<string>(rank)];
+			if (url_count == 0) {
+				++ missing_count;
+			}
+			else if (url_count > 1) {
+				++ repeated_count;
+			}
+		}
+	}
+	cout << "federated search: " << search.results.size() << " results in " << page_count << " pages" << endl;
+	if (missing_count > 0 || repeated_count > 0 || search.results.rbegin()->first != (int) search.results.size()) {
+		cerr << "federated search pages lost " << missing_count << " results and repeated " << repeated_count << endl;
+	}
+}
+
+/// Checks that the last bucket of a latency histogram takes only values past the largest power of two it splits into buckets.
+void testLatencyHistogramBounds() {
+	const long long max_bucketed = (1LL << 40) - 1;
+	util::LatencyHistogram below, above;
+	below.record(max_bucketed);
+	above.record(max_bucketed + 1);
+	util::LatencyHistogram::Snapshot below_counts = below.getSnapshot();
+	util::LatencyHistogram::Snapshot above_counts = above.getSnapshot();
+	if (below_counts.bucket_counts.back() != 0 || below_counts.getPercentile(100) != max_bucketed) {
+		cerr << max_bucketed << " us went into the overflow bucket of the latency histogram" << endl;
+	}
+	if (above_counts.bucket_counts.back() != 1 || above_counts.getPercentile(100) != max_bucketed + 1) {
+		cerr << max_bucketed + 1 << " us did not go into the overflow bucket of the latency histogram" << endl;
+	}
+}
+
 void testMain() {
 	// Put your adhoc test code here.
 
+	benchmarkRequestParser();
+	benchmarkSearchPageParsers("serp_samples");
+	benchmarkTermDict("system_files/col_stats");
+	benchmarkSearchIndex(20000);
+	testFederatedSearchPages();
+	testLatencyHistogramBounds();
+
 	/*BingWrapper search_engine;
 
 	int start_pos = 1;
@@ -1,5 +1,6 @@
 #include "ucair_server.h"
 #include <iostream>
+#include <sstream>
 #include <boost/algorithm/string.hpp>
 #include <boost/bind.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
@@ -9,6 +10,7 @@
 #include "common_util.h"
 #include "config.h"
 #include "error.h"
+#include "http_download.h"
 #include "logger.h"
 
 using namespace std;
@@ -70,7 +72,9 @@ Reply::Reply(http::server::Reply &rep_):
 	headers(rep_.headers),
 	content(rep_.content),
 	doc_type(xml::util::NO_DOC_TYPE),
-	rep(rep_)
+	rep(rep_),
+	accepted_encoding(http::util::IDENTITY),
+	context(NULL)
 {
 	dom_root.setSelfDestroy();
 }
@@ -79,6 +83,7 @@ void Reply::reset(){
 	status = rep.status;
 	headers = rep.headers;
 	content.clear();
+	shared_content.reset();
 	dom_root.destroy();
 	doc_type = xml::util::NO_DOC_TYPE;
 	internal_redirect_path.clear();
@@ -105,13 +110,38 @@ void Reply::setCookie(const string &name, const string &value) {
 }
 
 UCAIRServer::UCAIRServer() :
-	idle_signal(Main::instance().io_service) {
+	idle_signal(Main::instance().io_service, Main::instance().app_strand),
+	stopped(false),
+	compress_level(0),
+	compress_min_size(0),
+	bytes_before_compression(0),
+	bytes_after_compression(0),
+	requests_in_flight(0) {
 }
 
 bool UCAIRServer::initialize(){
 	Main &main = Main::instance();
 	server_address = util::getParam<string>(main.getConfig(), "httpd_address");
 	server_port = util::getParam<string>(main.getConfig(), "httpd_port");
+	int io_thread_count = util::getParam<int>(main.getConfig(), "httpd_io_threads");
+	http::server::ConnectionOptions connection_options;
+	connection_options.keep_alive_timeout = util::getParam<int>(main.getConfig(), "httpd_keep_alive_timeout");
+	connection_options.max_keep_alive_requests = util::getParam<int>(main.getConfig(), "httpd_max_keep_alive_requests");
+	connection_options.header_timeout = util::getParam<int>(main.getConfig(), "httpd_header_timeout");
+	connection_options.body_timeout = util::getParam<int>(main.getConfig(), "httpd_body_timeout");
+	connection_options.write_timeout = util::getParam<int>(main.getConfig(), "httpd_write_timeout");
+	connection_options.max_connections = util::getParam<size_t>(main.getConfig(), "httpd_max_connections");
+	connection_options.max_queued_requests = util::getParam<size_t>(main.getConfig(), "httpd_max_queued_requests");
+	connection_options.retry_after = util::getParam<int>(main.getConfig(), "httpd_retry_after");
+	http::util::HTTPClientOptions client_options;
+	client_options.connect_timeout = util::getParam<int>(main.getConfig(), "http_client_connect_timeout");
+	client_options.read_timeout = util::getParam<int>(main.getConfig(), "http_client_read_timeout");
+	client_options.max_redirects = util::getParam<int>(main.getConfig(), "http_client_max_redirects");
+	client_options.max_idle_connections_per_host = util::getParam<size_t>(main.getConfig(), "http_client_max_idle_connections_per_host");
+	client_options.idle_timeout = util::getParam<int>(main.getConfig(), "http_client_idle_timeout");
+	client_options.dns_cache_ttl = util::getParam<int>(main.getConfig(), "http_client_dns_cache_ttl");
+	compress_level = util::getParam<int>(main.getConfig(), "compress_level");
+	compress_min_size = util::getParam<size_t>(main.getConfig(), "compress_min_size");
 	string doc_type = util::getParam<string>(main.getConfig(), "default_doc_type");
 	if (doc_type == "html_4.01_loose"){
 		default_doc_type = xml::util::HTML_4_01_LOOSE;
@@ -129,17 +159,27 @@ bool UCAIRServer::initialize(){
 		default_doc_type = xml::util::NO_DOC_TYPE;
 	}
 
-	server.reset(new http::server::Server(Main::instance().io_service, server_address, server_port, bind(&UCAIRServer::dispatchRequest, this, _1, _2)));
+	registerHandler(RequestHandler::CGI_OTHER, "/metrics", bind(&UCAIRServer::displayMetrics, this, _1, _2));
+
+	// Request dispatch goes through the application strand, so handlers need not be thread-safe.
+	server.reset(new http::server::Server(main.io_service, main.app_strand, server_address, server_port, bind(&UCAIRServer::dispatchRequest, this, _1, _2), io_thread_count, connection_options));
+	http_client.reset(new http::util::HTTPClient(main.io_service, client_options));
 	return true;
 }
 
 void UCAIRServer::stop(){
 	getLogger().info("Stopping UCAIR server");
+	stopped = true;
+	// Pending downloads would keep the io_service running; later ones run on their own.
+	http_client->stop();
+	http::util::setDownloadClient(NULL);
 	server->stop(true);
 }
 
 void UCAIRServer::start() {
 	getLogger().info("Starting UCAIR server");
+	// Downloads can go through the shared client only while the io_service is running.
+	http::util::setDownloadClient(http_client.get());
 	server->run();
 }
 
@@ -148,82 +188,205 @@ void UCAIRServer::registerHandler(const RequestHandler::Classification &classifi
 	handlers.back().classification = classification;
 	handlers.back().prefix = prefix;
 	handlers.back().callback = callback;
+	handlers.back().latency.reset(new util::LatencyHistogram);
+}
+
+void UCAIRServer::registerAsyncHandler(const RequestHandler::Classification &classification, const string &prefix, const RequestHandler::AsyncCallback &callback){
+	handlers.push_back(RequestHandler());
+	handlers.back().classification = classification;
+	handlers.back().prefix = prefix;
+	handlers.back().async_callback = callback;
+	handlers.back().latency.reset(new util::LatencyHistogram);
+}
+
+/// State of a request being dispatched. Kept alive while the request handler is suspended.
+class RequestContext: public enable_shared_from_this<RequestContext> {
+public:
+	RequestContext(http::server::Request &req, http::server::Reply &rep):
+		request(req),
+		reply(rep),
+		handler(NULL),
+		path(request.url_components.path),
+		redirect_try(0),
+		compressible(false),
+		pending(0),
+		generation(0)
+	{
+		reply.context = this;
+	}
+
+	Request request;
+	Reply reply;
+	RequestHandler *handler; ///< handler selected for the current path
+	posix_time::ptime handler_start; ///< when the handler was invoked
+	string path; ///< request path, or internal redirect path
+	int redirect_try; ///< number of handlers tried
+	bool compressible; ///< whether the reply can be compressed
+	int pending; ///< number of suspensions not yet resumed
+	int generation; ///< bumped whenever outstanding completions become void
+	function<void ()> send; ///< sends the wrapped reply, once it has been deferred
+};
+
+void RequestHandler::Completion::resume(const function<void ()> &continuation) const {
+	Main::instance().app_strand.post(bind(&UCAIRServer::resume, &getUCAIRServer(), context, generation, continuation));
+}
+
+void RequestHandler::Completion::operator() () const {
+	resume(function<void ()>());
+}
+
+RequestHandler::Completion UCAIRServer::suspend(Reply &reply){
+	assert(reply.context);
+	RequestContext &context = *reply.context;
+	if (context.send.empty()){
+		context.send = reply.rep.defer();
+	}
+	++ context.pending;
+	return RequestHandler::Completion(context.shared_from_this(), context.generation);
 }
 
 void UCAIRServer::dispatchRequest(http::server::Request &req, http::server::Reply &rep){
-	Request request(req);
-	Reply reply(rep);
+	// Requests already queued in the application strand may arrive after components are finalized.
+	if (stopped){
+		rep.status = reply_status::service_unavailable;
+		return;
+	}
+
+	++ requests_in_flight;
+	shared_ptr<RequestContext> context(new RequestContext(req, rep));
+	Request &request = context->request;
+	Reply &reply = context->reply;
+	reply.accepted_encoding = http::util::negotiateContentEncoding(request.getHeader("Accept-Encoding"));
 
 	getLogger().info(request.method + " " + request.url);
 
 	// Only handle GET and POST
 	if (request.method != "GET" && request.method != "POST"){
 		reply.status = reply_status::not_implemented;
+		finish(*context);
 	}
 	else{
-		string path = request.url_components.path;
-
-		// Limits the number of redirects to prevent infinite loop.
-		for (int redirect_try = 0; redirect_try < 3; ++ redirect_try){
-			RequestHandler *selected_handler = NULL;
-			// Find the handler with longest prefix
-			BOOST_FOREACH(RequestHandler &handler, handlers){
-				if (starts_with(path, handler.prefix)){
-					if (! selected_handler || handler.prefix.length() > selected_handler->prefix.length()){
-						selected_handler = &handler;
-					}
+		dispatch(context);
+	}
+}
+
+void UCAIRServer::dispatch(const shared_ptr<RequestContext> &context){
+	Request &request = context->request;
+	Reply &reply = context->reply;
+
+	// Limits the number of redirects to prevent infinite loop.
+	for (; context->redirect_try < 3; ++ context->redirect_try){
+		RequestHandler *selected_handler = NULL;
+		// Find the handler with longest prefix
+		BOOST_FOREACH(RequestHandler &handler, handlers){
+			if (starts_with(context->path, handler.prefix)){
+				if (! selected_handler || handler.prefix.length() > selected_handler->prefix.length()){
+					selected_handler = &handler;
 				}
 			}
-			if (! selected_handler){
-				// No handler can handle this request path.
-				reply.status = reply_status::not_found;
-				break;
-			}
+		}
+		if (! selected_handler){
+			// No handler can handle this request path.
+			reply.status = reply_status::not_found;
+			break;
+		}
 
-			if (redirect_try == 0){
-				// If CGI, parse form data.
-				if (selected_handler->classification == RequestHandler::CGI_HTML || selected_handler->classification == RequestHandler::CGI_OTHER){
-					reply.status = parseFormData(request);
-					if (reply.status != reply_status::ok){
-						break;
-					}
+		if (context->redirect_try == 0){
+			// If CGI, parse form data.
+			if (selected_handler->classification == RequestHandler::CGI_HTML || selected_handler->classification == RequestHandler::CGI_OTHER){
+				posix_time::ptime start = posix_time::microsec_clock::universal_time();
+				reply.status = parseFormData(request);
+				form_data_latency.recordSince(start);
+				if (reply.status != reply_status::ok){
+					break;
 				}
-				parseCookieData(request);
 			}
+			posix_time::ptime start = posix_time::microsec_clock::universal_time();
+			parseCookieData(request);
+			cookie_latency.recordSince(start);
+		}
 
-			try{
-				reply.doc_type = default_doc_type;
-				try {
-					selected_handler->callback(request, reply);
-				}
-				catch (Error &e) {
-					getLogger().error(e.what());
-					if (const string* error_msg = boost::get_error_info<ErrorMsg>(e)){
-						getLogger().error(*error_msg);
-					}
-					err(reply_status::internal_server_error, e.what());
-				}
-				catch (std::exception &e){
-					getLogger().error(e.what());
-					err(reply_status::internal_server_error, e.what());
-				}
+		context->handler = selected_handler;
+		context->handler_start = posix_time::microsec_clock::universal_time();
+		reply.doc_type = default_doc_type;
+		bool completed;
+		if (selected_handler->async_callback){
+			completed = runHandler(*context, bind(selected_handler->async_callback, ref(request), ref(reply), suspend(reply)));
+		}
+		else{
+			completed = runHandler(*context, bind(selected_handler->callback, ref(request), ref(reply)));
+		}
+		if (completed && context->pending > 0){
+			// Carried on by resume.
+			return;
+		}
+
+		if (! handleOutcome(*context)){
+			break;
+		}
+	}
+
+	finish(*context);
+}
+
+void UCAIRServer::resume(const shared_ptr<RequestContext> &context, int generation, const function<void ()> &continuation){
+	if (stopped || generation != context->generation){
+		// The connection is gone, or the handler has been aborted.
+		return;
+	}
+	-- context->pending;
+
+	bool completed = true;
+	if (continuation){
+		completed = runHandler(*context, continuation);
+	}
+	if (completed && context->pending > 0){
+		return;
+	}
+
+	if (handleOutcome(*context)){
+		++ context->redirect_try;
+		dispatch(context);
+	}
+	else{
+		finish(*context);
+	}
+}
+
+bool UCAIRServer::runHandler(RequestContext &context, const function<void ()> &handler){
+	Reply &reply = context.reply;
+	try{
+		try {
+			handler();
+		}
+		catch (Error &e) {
+			getLogger().error(e.what());
+			if (const string* error_msg = boost::get_error_info<ErrorMsg>(e)){
+				getLogger().error(*error_msg);
+			}
+			err(reply_status::internal_server_error, e.what());
+		}
+		catch (std::exception &e){
+			getLogger().error(e.what());
+			err(reply_status::internal_server_error, e.what());
+		}
+	}
+	catch (RequestHandler::Interrupt &x){
+		// If it is thrown by UCAIRServer::err (with HTTP status code and error message)
+		if (const pair<int, string>* interrupt_info = get_error_info<RequestHandler::InterruptInfo>(x)){
+			int status = interrupt_info->first;
+			if (status == INTERNAL_REDIRECT_CODE) {
+				reply.internal_redirect_path = interrupt_info->second;
 			}
-			catch (RequestHandler::Interrupt &x){
-				// If it is thrown by UCAIRServer::err (with HTTP status code and error message)
-				if (const pair<int, string>* interrupt_info = get_error_info<RequestHandler::InterruptInfo>(x)){
-					int status = interrupt_info->first;
-					if (status == INTERNAL_REDIRECT_CODE) {
-						reply.internal_redirect_path = interrupt_info->second;
-					}
-					else if (status == EXTERNAL_REDIRECT_CODE) {
-						reply.external_redirect_url = interrupt_info->second;
-					}
-					else {
-						const string &error_message = interrupt_info->second;
-						reply.reset();
-						reply.status = status;
-						string status_str = reply_status::toString(status);
-						static const char* html_format = "\
+			else if (status == EXTERNAL_REDIRECT_CODE) {
+				reply.external_redirect_url = interrupt_info->second;
+			}
+			else {
+				const string &error_message = interrupt_info->second;
+				reply.reset();
+				reply.status = status;
+				string status_str = reply_status::toString(status);
+				static const char* html_format = "\
 <html>\
 <head>\
 <title>%1%</title>\
@@ -233,34 +396,102 @@ void UCAIRServer::dispatchRequest(http::server::Request &req, http::server::Repl
 <p>%3%</p>\
 </body>\
 </html>";
-						reply.content = str(format(html_format) % xml::util::quote(status_str) % status % xml::util::quote(error_message));
-					}
-				}
+				reply.content = str(format(html_format) % xml::util::quote(status_str) % status % xml::util::quote(error_message));
 			}
+		}
+		// Whatever the handler was waiting for no longer matters.
+		context.pending = 0;
+		++ context.generation;
+		return false;
+	}
+	return true;
+}
 
-			if (! reply.internal_redirect_path.empty()){
-				// internal redirect
-				path = reply.internal_redirect_path;
-				reply.reset(); // then goes to the next redirect_try
-			}
-			else if (! reply.external_redirect_url.empty()){
-				// external redirect
-				string temp = reply.external_redirect_url;
-				reply.reset(); // this will clear reply.external_redirect_url
-				reply.status = reply_status::moved_temporarily;
-				reply.setHeader("Location", temp);
-				break;
-			}
-			else{
-				// Handler completes normally.
-				if (selected_handler->classification == RequestHandler::CGI_HTML){
-					makeHTML(reply);
-				}
-				break;
-			}
+bool UCAIRServer::handleOutcome(RequestContext &context){
+	Reply &reply = context.reply;
+	context.handler->latency->recordSince(context.handler_start);
+	if (! reply.internal_redirect_path.empty()){
+		// internal redirect
+		context.path = reply.internal_redirect_path;
+		reply.reset(); // then goes to the next redirect_try
+		return true;
+	}
+	else if (! reply.external_redirect_url.empty()){
+		// external redirect
+		string temp = reply.external_redirect_url;
+		reply.reset(); // this will clear reply.external_redirect_url
+		reply.status = reply_status::moved_temporarily;
+		reply.setHeader("Location", temp);
+	}
+	else{
+		// Handler completes normally.
+		if (context.handler->classification == RequestHandler::CGI_HTML){
+			makeHTML(reply);
+		}
+		context.compressible = context.handler->classification == RequestHandler::CGI_HTML || context.handler->classification == RequestHandler::STATIC;
+	}
+	return false;
+}
+
+void UCAIRServer::finish(RequestContext &context){
+	Request &request = context.request;
+	Reply &reply = context.reply;
+
+	if (reply.isStreaming()){
+		if (reply.status != reply.rep.status){
+			getLogger().error(str(format("Status %d cannot be sent, part of the reply has been sent already") % reply.status));
+		}
+	}
+	else{
+		setCommonHeaders(reply);
+	}
+
+	++ reply_counts[reply.status];
+	-- requests_in_flight;
+
+	// Inform watchers of handler completion.
+	request_handled_signal(request, reply);
+	idle_signal.waitFor(posix_time::seconds(1)); // TODO: use config value
+
+	getLogger().info(str(format("%d %s") % reply.status % http::server::reply_status::toString(reply.status)));
+
+	if (reply.compressor){
+		compressChunk(reply, true);
+	}
+	else if (context.compressible && ! reply.isStreaming()){
+		compressReply(reply);
+	}
+	updateWrappedReply(reply);
+
+	++ context.generation;
+	if (context.send){
+		context.send();
+	}
+}
+
+bool UCAIRServer::flush(Reply &reply){
+	if (reply.rep.flush_handler.empty() || reply.dom_root){
+		return false;
+	}
+	if (! reply.isStreaming()){
+		makeHTML(reply);
+		setCommonHeaders(reply);
+		// The size of the whole page is unknown, so compress regardless of compress_min_size.
+		http::util::ContentEncoding encoding = getContentEncoding(reply);
+		if (encoding != http::util::IDENTITY){
+			reply.compressor.reset(new http::util::Compressor(encoding, compress_level));
+			reply.setHeader("Content-Encoding", http::util::toString(encoding));
 		}
 	}
+	if (reply.compressor){
+		compressChunk(reply, false);
+	}
+	updateWrappedReply(reply);
+	reply.content.clear();
+	return reply.rep.flush();
+}
 
+void UCAIRServer::setCommonHeaders(Reply &reply){
 	// Sets the date header.
 	posix_time::ptime now = posix_time::microsec_clock::universal_time();
 	reply.setHeader("Date", util::timeToString(now, util::internet_time_format));
@@ -271,16 +502,61 @@ void UCAIRServer::dispatchRequest(http::server::Request &req, http::server::Repl
 		string value = itr->second;
 		reply.setHeader("Set-Cookie", str(format("%s=%s; expires=Wed, 01-Jan-2020 00:00:00 GMT; path=/") % name % value), true);
 	}
+}
 
-	// Inform watchers of handler completion.
-	request_handled_signal(request, reply);
-	idle_signal.waitFor(posix_time::seconds(1)); // TODO: use config value
+http::util::ContentEncoding UCAIRServer::getContentEncoding(Reply &reply){
+	if (compress_level == 0){
+		return http::util::IDENTITY;
+	}
+	// Images and the like are compressed already.
+	multimap<string, string>::const_iterator itr = reply.headers.find("Content-Type");
+	if (itr == reply.headers.end()){
+		return http::util::IDENTITY;
+	}
+	const string &content_type = itr->second;
+	if (! starts_with(content_type, "text/") && ! contains(content_type, "javascript") && ! contains(content_type, "xml") && ! contains(content_type, "json")){
+		return http::util::IDENTITY;
+	}
+	reply.setHeader("Vary", "Accept-Encoding");
+	return reply.accepted_encoding;
+}
 
-	getLogger().info(str(format("%d %s") % reply.status % http::server::reply_status::toString(reply.status)));
+void UCAIRServer::countCompression(size_t original_size, size_t compressed_size){
+	bytes_before_compression += original_size;
+	bytes_after_compression += compressed_size;
+}
 
-	// Update wrapped http::server::reply
-	rep.status = reply.status;
-	swap(rep.headers, reply.headers); // save copying
+void UCAIRServer::compressReply(Reply &reply){
+	if (reply.status != reply_status::ok || reply.shared_content || reply.content.size() < compress_min_size || reply.headers.find("Content-Encoding") != reply.headers.end()){
+		return;
+	}
+	http::util::ContentEncoding encoding = getContentEncoding(reply);
+	if (encoding == http::util::IDENTITY){
+		return;
+	}
+	string compressed;
+	http::util::compress(reply.content, compressed, encoding, compress_level);
+	if (compressed.size() < reply.content.size()){
+		countCompression(reply.content.size(), compressed.size());
+		reply.content.swap(compressed);
+		reply.setHeader("Content-Encoding", http::util::toString(encoding));
+	}
+}
+
+void UCAIRServer::compressChunk(Reply &reply, bool finish){
+	string compressed;
+	reply.compressor->compress(reply.content, compressed, finish);
+	countCompression(reply.content.size(), compressed.size());
+	reply.content.swap(compressed);
+}
+
+void UCAIRServer::updateWrappedReply(Reply &reply){
+	http::server::Reply &rep = reply.rep;
+	if (! rep.isStreaming()){
+		rep.status = reply.status;
+		swap(rep.headers, reply.headers); // save copying
+		rep.shared_content = reply.shared_content;
+	}
 	swap(rep.content, reply.content);
 }
 
@@ -321,7 +597,9 @@ void UCAIRServer::parseCookieData(Request &request) {
 }
 
 void UCAIRServer::makeHTML(Reply &reply){
-	if (reply.status == reply_status::ok){
+	// Once flushed, the beginning of the page (with doc type) has been sent.
+	if (reply.status == reply_status::ok && ! reply.isStreaming()){
+		posix_time::ptime start = posix_time::microsec_clock::universal_time();
 		reply.setHeader("Content-Type", "text/html");
 		if (reply.dom_root){
 			reply.content = xml::util::makeHTML(reply.dom_root, reply.doc_type);
@@ -329,7 +607,63 @@ void UCAIRServer::makeHTML(Reply &reply){
 		else {
 			reply.content = xml::util::makeHTML(reply.content, reply.doc_type);
 		}
+		make_html_latency.recordSince(start);
+	}
+}
+
+/// Writes a latency histogram as a Prometheus summary, in seconds.
+static void writeLatencySummary(ostream &out, const string &name, const string &labels, const util::LatencyHistogram &histogram){
+	static const double quantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+	util::LatencyHistogram::Snapshot snapshot = histogram.getSnapshot();
+	for (size_t i = 0; i < sizeof(quantiles) / sizeof(quantiles[0]); ++ i){
+		out << format("%s{%s,quantile=\"%g\"} %.6f\n") % name % labels % quantiles[i] % (snapshot.getPercentile(quantiles[i] * 100.0) / 1e6);
+	}
+	out << format("%s_sum{%s} %.6f\n") % name % labels % (snapshot.sum / 1e6);
+	out << format("%s_count{%s} %d\n") % name % labels % snapshot.count;
+	out << format("%s_max{%s} %.6f\n") % name % labels % (snapshot.max / 1e6);
+}
+
+void UCAIRServer::displayMetrics(Request &request, Reply &reply){
+	ostringstream out;
+	out << "# HELP ucair_stage_latency_seconds Time spent in each stage of request handling.\n";
+	out << "# TYPE ucair_stage_latency_seconds summary\n";
+	writeLatencySummary(out, "ucair_stage_latency_seconds", "stage=\"form_data\"", form_data_latency);
+	writeLatencySummary(out, "ucair_stage_latency_seconds", "stage=\"cookies\"", cookie_latency);
+	writeLatencySummary(out, "ucair_stage_latency_seconds", "stage=\"make_html\"", make_html_latency);
+	writeLatencySummary(out, "ucair_stage_latency_seconds", "stage=\"socket_write\"", server->getWriteLatency());
+
+	out << "# HELP ucair_handler_latency_seconds Time from invoking a request handler until it completes, including time suspended.\n";
+	out << "# TYPE ucair_handler_latency_seconds summary\n";
+	BOOST_FOREACH(const RequestHandler &handler, handlers){
+		writeLatencySummary(out, "ucair_handler_latency_seconds", "prefix=\"" + handler.prefix + "\"", *handler.latency);
+	}
+
+	out << "# HELP ucair_replies_total Replies sent by request handlers, by status.\n";
+	out << "# TYPE ucair_replies_total counter\n";
+	for (map<int, long long>::const_iterator itr = reply_counts.begin(); itr != reply_counts.end(); ++ itr){
+		out << format("ucair_replies_total{status=\"%d\"} %d\n") % itr->first % itr->second;
 	}
+	out << "# HELP ucair_requests_in_flight Requests being handled, including suspended ones.\n";
+	out << "# TYPE ucair_requests_in_flight gauge\n";
+	out << "ucair_requests_in_flight " << requests_in_flight << "\n";
+
+	http::server::AdmissionStats stats = getAdmissionStats();
+	out << "# TYPE ucair_connections_active gauge\n";
+	out << "ucair_connections_active " << stats.active_connections << "\n";
+	out << "# TYPE ucair_requests_queued gauge\n";
+	out << "ucair_requests_queued " << stats.queued_requests << "\n";
+	out << "# TYPE ucair_connections_accepted_total counter\n";
+	out << "ucair_connections_accepted_total " << stats.accepted_connections << "\n";
+	out << "# TYPE ucair_connections_rejected_total counter\n";
+	out << "ucair_connections_rejected_total " << stats.rejected_connections << "\n";
+	out << "# TYPE ucair_requests_shed_total counter\n";
+	out << "ucair_requests_shed_total " << stats.shed_requests << "\n";
+	out << "# TYPE ucair_connections_timed_out_total counter\n";
+	out << "ucair_connections_timed_out_total " << stats.timed_out_connections << "\n";
+
+	reply.setHeader("Content-Type", "text/plain; version=0.0.4");
+	reply.setHeader("Cache-Control", "no-store");
+	reply.content = out.str();
 }
 
 void UCAIRServer::internalRedirect(const string &new_path){
@@ -9,7 +9,10 @@
 #include <boost/signal.hpp>
 #include <boost/smart_ptr.hpp>
 #include "component.h"
+#include "content_encoding.h"
 #include "delayed_signal.h"
+#include "http_client.h"
+#include "latency_histogram.h"
 #include "main.h"
 #include "request.h"
 #include "reply.h"
@@ -70,6 +73,8 @@ private:
 
 namespace reply_status = http::server::reply_status;
 
+class RequestContext;
+
 /// HTTP reply. Provides more information than http::server::Reply.
 class Reply {
 public:
@@ -79,6 +84,8 @@ public:
 	int status; ///< reply status
 	std::multimap<std::string, std::string> headers; ///< headers (name to value)
 	std::string content; ///< reply body
+	/// If set, used as reply body instead of content, so that cached data need not be copied.
+	boost::shared_ptr<const std::string> shared_content;
 
 	xml::dom::Node dom_root; ///< root of the DOM tree
 	xml::util::HTMLDocType doc_type; ///< doc type
@@ -107,8 +114,19 @@ public:
 	std::map<std::string, std::string> cookie_data;
 	void setCookie(const std::string &name, const std::string &value);
 
+	/// Whether part of the reply has already been sent by UCAIRServer::flush.
+	bool isStreaming() const { return rep.isStreaming(); }
+
 private:
 	http::server::Reply &rep;
+
+	http::util::ContentEncoding accepted_encoding; ///< preferred content coding accepted by the client
+	boost::shared_ptr<http::util::Compressor> compressor; ///< compresses chunks of a streamed reply
+
+	RequestContext *context; ///< request being dispatched, for UCAIRServer::suspend
+
+friend class UCAIRServer;
+friend class RequestContext;
 };
 
 struct RequestHandler {
@@ -127,12 +145,44 @@ struct RequestHandler {
 		STATIC, CGI_HTML, CGI_OTHER
 	} classification;
 
+	/*! \brief Lets a suspended request handler carry on.
+	 *
+	 *  Returned by UCAIRServer::suspend. It can be copied, and called from any thread (e.g. when a download finishes),
+	 *  but only once for each suspend.
+	 */
+	class Completion {
+	public:
+		/*! \brief Runs the rest of the request handler in the application strand.
+		 *
+		 *  The continuation runs just like the handler itself: it may use UCAIRServer::err and the redirect functions,
+		 *  flush the reply, or suspend again. The reply is sent once it returns without suspending.
+		 */
+		void resume(const boost::function<void ()> &continuation) const;
+		/// Sends the reply as it is.
+		void operator() () const;
+
+	private:
+		Completion(const boost::shared_ptr<RequestContext> &context_, int generation_): context(context_), generation(generation_) {}
+
+		boost::shared_ptr<RequestContext> context;
+		int generation; ///< tells a stale completion (e.g. of a handler that has thrown since) from a current one
+
+	friend class UCAIRServer;
+	};
+
 	typedef boost::function<void(Request&, Reply&)> Callback;
 	/// Callback function that accepts a request and produces a reply.
 	Callback callback;
 
+	typedef boost::function<void(Request&, Reply&, const Completion&)> AsyncCallback;
+	/// Used instead of callback by a handler that completes the reply through a Completion.
+	AsyncCallback async_callback;
+
 	/// This handler will be invoked if the prefix is the longest matching one of request path.
 	std::string prefix;
+
+	/// Time from invoking the handler until it completes, including time suspended.
+	boost::shared_ptr<util::LatencyHistogram> latency;
 };
 
 class UCAIRServer: public Component {
@@ -157,6 +207,24 @@ public:
 			const std::string &prefix,
 			const RequestHandler::Callback &callback);
 
+	/*! \brief Registers a page handler that completes asynchronously.
+	 *
+	 *  The handler is suspended (see suspend) before it is called, and the reply is sent
+	 *  when it uses the completion passed in, rather than when it returns.
+	 *  Any handler registered with registerHandler can suspend itself as well; this is for handlers that always do.
+	 */
+	void registerAsyncHandler(
+			const RequestHandler::Classification &classification,
+			const std::string &prefix,
+			const RequestHandler::AsyncCallback &callback);
+
+	/*! \brief Suspends the current request handler, so that it can wait for something without holding up the server.
+	 *
+	 *  The handler starts the wait, arranges for the returned completion to be used when it is over, and returns.
+	 *  Other requests are handled in the meantime. The request and reply objects stay valid until the reply is sent.
+	 */
+	RequestHandler::Completion suspend(Reply &reply);
+
 	/*! \brief Redirects to an internal path.
 	 *
 	 *  This will throw an internal exception and abort execution of the current page handler.
@@ -174,6 +242,32 @@ public:
 	 */
 	void err(int status, const std::string &error_message = "");
 
+	/*! \brief Sends the HTML page produced so far in reply.content to the client, and clears it.
+	 *
+	 *  Lets a CGI_HTML handler send the top of a page before doing something slow.
+	 *  Status, headers and cookies are sent on the first flush and cannot be changed afterwards.
+	 *  \return false if the page cannot be sent in parts (e.g. HTTP/1.0 client), in which case content is left as is
+	 */
+	bool flush(Reply &reply);
+
+	/*! \brief Chooses how to compress a reply, based on what the client accepts and the reply content type.
+	 *
+	 *  Also sets the Vary header, as the reply then depends on Accept-Encoding.
+	 *  \return IDENTITY if compression is disabled or not worthwhile for the content type
+	 */
+	http::util::ContentEncoding getContentEncoding(Reply &reply);
+	/// Compression level for replies, 0 if disabled.
+	int getCompressLevel() const { return compress_level; }
+	/// Replies smaller than this are not compressed.
+	size_t getCompressMinSize() const { return compress_min_size; }
+
+	/// Adds to compression counters.
+	void countCompression(size_t original_size, size_t compressed_size);
+	/// Total size of reply bodies that were compressed.
+	long long getBytesBeforeCompression() const { return bytes_before_compression; }
+	/// Total size of reply bodies that were compressed, after compression.
+	long long getBytesAfterCompression() const { return bytes_after_compression; }
+
 	/// Signal that indicates dispatch has completed.
 	boost::signal<void(Request&, Reply&)> request_handled_signal;
 	DelayedSignal idle_signal;
@@ -181,6 +275,18 @@ public:
 	/// Stops the UCAIR system (not just the server) after handling the current request.
 	void shutdownSystem();
 
+	/// Returns connection admission counters of the HTTP server.
+	http::server::AdmissionStats getAdmissionStats() const { return server->getAdmissionStats(); }
+
+	/// Returns the HTTP client for downloads, which runs on the io_service of the server.
+	http::util::HTTPClient& getHTTPClient() { return *http_client; }
+
+	/*! \brief Page handler that serves latencies of request handling stages and reply counters.
+	 *
+	 *  Uses the Prometheus text format, so that it can be scraped as well as read.
+	 */
+	void displayMetrics(Request &request, Reply &reply);
+
 	std::string getAddress() const { return server_address; }
 	std::string getPort() const {return server_port; }
 
@@ -195,6 +301,27 @@ private:
 	void dispatchRequest(http::server::Request &request,
 			http::server::Reply &reply);
 
+	/// Runs handlers for the request path, following internal redirects, until one suspends or the reply is ready.
+	void dispatch(const boost::shared_ptr<RequestContext> &context);
+
+	/*! \brief Runs a request handler, or the continuation of a suspended one.
+	 *
+	 *  Exceptions are turned into error pages and redirects.
+	 *  \return false if the handler was aborted by an exception (any suspension it made is then void)
+	 */
+	bool runHandler(RequestContext &context, const boost::function<void ()> &handler);
+
+	/// Continues a suspended request handler. Called through RequestHandler::Completion.
+	void resume(const boost::shared_ptr<RequestContext> &context, int generation, const boost::function<void ()> &continuation);
+
+	/*! \brief Deals with the outcome of a request handler that has completed.
+	 *  \return true if an internal redirect is to be followed
+	 */
+	bool handleOutcome(RequestContext &context);
+
+	/// Finishes the reply, and sends it if it has been deferred.
+	void finish(RequestContext &context);
+
 	/*! \brief Parses form data from request.
 	 *
 	 *  Looks at request URL in the case of GET and request body in the case of POST.
@@ -209,14 +336,43 @@ private:
 	/// Does some post-processing to produce an HTML page.
 	void makeHTML(Reply &reply);
 
+	/// Sets headers that go with every reply, such as Date and Set-Cookie.
+	void setCommonHeaders(Reply &reply);
+
+	/// Copies status and headers into the wrapped http::server::Reply, and moves content over.
+	void updateWrappedReply(Reply &reply);
+
+	/// Compresses reply content if the client accepts it and it is worthwhile.
+	void compressReply(Reply &reply);
+
+	/// Compresses reply content as the next piece of a streamed reply.
+	void compressChunk(Reply &reply, bool finish);
+
 	std::list<RequestHandler> handlers; ///< list of request handler
 
 	boost::scoped_ptr<http::server::Server> server; ///< wraps http::server::Server
 
+	boost::scoped_ptr<http::util::HTTPClient> http_client; ///< pooled client for downloads (search results, feeds)
+
 	xml::util::HTMLDocType default_doc_type; ///< default HTML doc type
 
 	std::string server_address;
 	std::string server_port;
+
+	bool stopped; ///< set once the server starts shutting down
+
+	int compress_level; ///< zlib compression level for replies, 0 to disable compression
+	size_t compress_min_size; ///< min size of a reply to be compressed
+	long long bytes_before_compression;
+	long long bytes_after_compression;
+
+	util::LatencyHistogram form_data_latency; ///< time to parse form data
+	util::LatencyHistogram cookie_latency; ///< time to parse cookies
+	util::LatencyHistogram make_html_latency; ///< time to post-process HTML pages
+	std::map<int, long long> reply_counts; ///< number of replies by status
+	int requests_in_flight; ///< requests dispatched and not yet replied to, including suspended ones
+
+friend class RequestHandler::Completion;
 };
 
 DECLARE_GET_COMPONENT(UCAIRServer)
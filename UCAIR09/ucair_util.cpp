@@ -46,7 +46,12 @@ void indexDocument(indexing::SimpleIndex &index, const Document &doc) {
 		return;
 	}
 	map<int, double> term_counts;
-	indexing::countTerms(index.getTermDict(), doc.title + " " + doc.summary, term_counts);
+	if (! doc.stemmed_terms.empty()) {
+		indexing::countTerms(index.getTermDict(), doc.stemmed_terms, term_counts);
+	}
+	else {
+		indexing::countTerms(index.getTermDict(), doc.title + " " + doc.summary, term_counts);
+	}
 	index.addDoc(doc.doc_id, *indexing::ValueMap::from(term_counts));
 }
 
@@ -154,11 +154,24 @@ void User::updateSearchIndices(bool force_update) {
 	index_outdated = false;
 }
 
-vector<pair<string, double> > User::searchInHistory(const indexing::ValueMap &query_terms) {
+vector<pair<string, double> > User::searchInHistory(const indexing::ValueMap &query_terms, int max_count) {
 	updateSearchIndices();
 	// Search both short-term and long-term.
 	vector<pair<string, double> > search_scores;
-	indexing::SimpleKLRetriever retriever(*indexing::ValueMap::from(getIndexManager().getColProbs()), getIndexManager().getDefaultColProb(), dir_prior);
+	indexing::SimpleKLRetriever retriever(getIndexManager().getColProbs(), dir_prior);
+	if (max_count > 0) {
+		vector<const indexing::SimpleIndex*> indices;
+		indices.push_back(short_term_search_index.get());
+		indices.push_back(long_term_search_index.get());
+		vector<pair<pair<int, int>, double> > hits;
+		retriever.retrieve(indices, query_terms, max_count, hits);
+		typedef pair<pair<int, int>, double> H;
+		BOOST_FOREACH(const H &hit, hits) {
+			indexing::SimpleIndex &index = hit.first.first == 0 ? *short_term_search_index : *long_term_search_index;
+			search_scores.push_back(make_pair(index.getDocDict().getName(hit.first.second), hit.second));
+		}
+		return search_scores;
+	}
 	vector<pair<int, double> > scores;
 	retriever.retrieve(*short_term_search_index, query_terms, scores);
 	typedef pair<int, double> P;
@@ -178,7 +191,7 @@ vector<pair<string, double> > User::searchInHistory(const indexing::ValueMap &qu
 map<int, double> User::getIndexedSearchModel(const string &search_id) {
 	updateSearchIndices();
 	map<int, double> result;
-	const vector<pair<int, float> > *term_list = NULL;
+	indexing::PostingList term_list;
 	int doc_id = long_term_search_index->getDocDict().getId(search_id);
 	if (doc_id > 0) {
 		term_list = long_term_search_index->getTermList(doc_id);
@@ -189,11 +202,8 @@ map<int, double> User::getIndexedSearchModel(const string &search_id) {
 			term_list = short_term_search_index->getTermList(doc_id);
 		}
 	}
-	if (term_list) {
-		typedef pair<int, float> P;
-		BOOST_FOREACH(const P &p, *term_list) {
-			result[p.first] = p.second;
-		}
+	for (indexing::PostingList::Iterator itr = term_list.iterator(); itr.ok(); itr.next()) {
+		result[itr.id()] = itr.weight();
 	}
 	return result;
 }
@@ -81,9 +81,11 @@ public:
 	/*! \brief Search short-term and long-term history for a given query.
 	 *
 	 *  \param query_terms query model
+	 *  \param max_count number of top searches to return, or 0 for all that match; the top ones are found
+	 *         without scoring every match (see indexing::SimpleKLRetriever), and ties are ranked short-term first
 	 *  \return vector of (search id, relevance score) pairs
 	 */
-	std::vector<std::pair<std::string, double> > searchInHistory(const indexing::ValueMap &query_terms);
+	std::vector<std::pair<std::string, double> > searchInHistory(const indexing::ValueMap &query_terms, int max_count = 0);
 	/// Returns the search model for a given search if it has been indexed.
 	std::map<int, double> getIndexedSearchModel(const std::string &search_id);
 
@@ -73,11 +73,25 @@ string quote(const string &input){
 }
 
 string unquote(const string &input){
-	// inefficient
-	string output = input;
-	for (size_t i = 0; i < entities::characters.size(); ++ i){
-		replace_all(output, string_const_range(entities::references[i].begin(), entities::references[i].end()), string_const_range(entities::characters.begin() + i, entities::characters.begin() + i + 1));
+	string output;
+	output.reserve(input.size());
+	size_t pos = 0;
+	for (size_t amp = input.find('&'); amp != string::npos; amp = input.find('&', pos)){
+		output.append(input, pos, amp - pos);
+		size_t i = 0;
+		while (i < entities::characters.size() && input.compare(amp, entities::references[i].size(), entities::references[i]) != 0){
+			++ i;
+		}
+		if (i < entities::characters.size()){
+			output += entities::characters[i];
+			pos = amp + entities::references[i].size();
+		}
+		else{
+			output += '&';
+			pos = amp + 1;
+		}
 	}
+	output.append(input, pos, string::npos);
 	return output;
 }
 